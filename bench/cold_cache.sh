@@ -0,0 +1,95 @@
+#!/bin/bash
+#
+# Cold cache benchmark of the stat order. A tree of files is created on an
+# ext4 image mounted through a loop device. The inodes of each directory are
+# allocated in creation order while getdents returns the names in hash order.
+# Every iteration runs mdu once in getdents order and once with --inode-order,
+# each after the page cache is dropped. The time and the read requests and
+# sectors which reached the loop device are logged for both orders.
+#
+# Needs root for losetup, mount and drop_caches.
+
+if [[ $# -ne 3 ]]; then
+  echo "usage: $0 [ITERATIONS] [THREAD COUNT] [FILES PER DIR]"
+  exit
+fi
+
+log_file="bench.log"
+iterations=$1
+threads=$2
+files=$3
+dirs=16
+
+mdu="$(dirname "$0")/../mdu_competition"
+work=$(mktemp -d)
+image="$work/fs.img"
+mnt="$work/mnt"
+
+cleanup() {
+  umount "$mnt" 2>/dev/null
+  [[ -n $loop ]] && losetup -d "$loop"
+  rm -rf "$work"
+}
+trap cleanup EXIT
+
+truncate -s 2G "$image"
+mkfs.ext4 -q -F -N $((dirs * files * 2)) "$image" || exit 1
+loop=$(losetup -f --show "$image") || exit 1
+mkdir "$mnt"
+mount "$loop" "$mnt" || exit 1
+
+for ((d = 0; d < dirs; d++)); do
+  mkdir "$mnt/d$d"
+  for ((f = 0; f < files; f++)); do
+    echo "$f" > "$mnt/d$d/f$f"
+  done
+done
+
+# a remount evicts the inodes just created, which drop_caches may not
+umount "$mnt" && mount "$loop" "$mnt" || exit 1
+
+dev=$(basename "$loop")
+
+run_cold() { # [option]
+  sync
+  echo 3 > /proc/sys/vm/drop_caches
+
+  # fields 1 and 3 of the stat file are read requests and sectors read
+  read -r ios_a _ sect_a _ < "/sys/block/$dev/stat"
+  start=$(date +%s.%N)
+  "$mdu" -j "$threads" $1 "$mnt" > /dev/null
+  end=$(date +%s.%N)
+  read -r ios_b _ sect_b _ < "/sys/block/$dev/stat"
+
+  echo "$(awk "BEGIN {print $end - $start}") $((ios_b - ios_a))" \
+    "$((sect_b - sect_a))"
+}
+
+echo "----- New test -----" >> $log_file
+echo "Iterations: $iterations    Threads: $threads    Files: $((dirs * files))" \
+  >> $log_file
+
+orders=("" "--inode-order")
+declare -A total_time total_ios total_sect
+
+# the orders take turns so that both see the same state of the host
+for ((i = 1; i <= iterations; i++)); do
+  for order in "${orders[@]}"; do
+    read -r t ios sect <<< "$(run_cold "$order")"
+    total_time[$order.]=$(awk "BEGIN {print ${total_time[$order.]:-0} + $t}")
+    total_ios[$order.]=$((${total_ios[$order.]:-0} + ios))
+    total_sect[$order.]=$((${total_sect[$order.]:-0} + sect))
+  done
+done
+
+for order in "${orders[@]}"; do
+  name=${order:-"--getdents-order"}
+  line=$(printf "%-16s time: %.4fs    reads: %d    sectors: %d" "$name" \
+    "$(awk "BEGIN {print ${total_time[$order.]} / $iterations}")" \
+    $((total_ios[$order.] / iterations)) $((total_sect[$order.] / iterations)))
+
+  echo "$line" >> $log_file
+  echo "$line"
+done
+
+echo "Saved results to $log_file"
@@ -0,0 +1,61 @@
+#!/bin/bash
+#
+# Benchmark of the specialized counting kernels. mdu_competition picks a loop
+# compiled for the options of the scan, bench/mdu_generic (make bench) tests
+# every option for every entry instead. Both count DIR on a warm cache, so
+# the system calls are the same and the difference is the user time spent in
+# the loop. The binaries take turns for each option set.
+
+if [[ $# -ne 3 ]]; then
+  echo "usage: $0 [ITERATIONS] [THREAD COUNT] [DIR]"
+  exit
+fi
+
+log_file="bench.log"
+iterations=$1
+threads=$2
+dir=$3
+
+root="$(dirname "$0")/.."
+bins=("$root/mdu_competition" "$root/bench/mdu_generic")
+option_sets=("" "--summary" "--top 10 files")
+
+for bin in "${bins[@]}"; do
+  [[ -x $bin ]] || { echo "$bin is missing, run make bench"; exit 1; }
+done
+
+"${bins[0]}" "$dir" > /dev/null # warm the cache
+
+run() { # [binary] [options]
+  TIMEFORMAT="%R %U %S"
+  { time "$1" -j "$threads" $2 "$dir" > /dev/null; } 2>&1
+}
+
+echo "----- New test -----" >> $log_file
+echo "Iterations: $iterations    Threads: $threads    Dir: $dir" >> $log_file
+
+for opts in "${option_sets[@]}"; do
+  declare -A real user sys
+  for ((i = 1; i <= iterations; i++)); do
+    for bin in "${bins[@]}"; do
+      read -r r u s <<< "$(run "$bin" "$opts")"
+      real[$bin]=$(awk "BEGIN {print ${real[$bin]:-0} + $r}")
+      user[$bin]=$(awk "BEGIN {print ${user[$bin]:-0} + $u}")
+      sys[$bin]=$(awk "BEGIN {print ${sys[$bin]:-0} + $s}")
+    done
+  done
+
+  for bin in "${bins[@]}"; do
+    line=$(printf "%-16s %-16s real: %.4fs    user: %.4fs    sys: %.4fs" \
+      "${opts:-plain}" "$(basename "$bin")" \
+      "$(awk "BEGIN {print ${real[$bin]} / $iterations}")" \
+      "$(awk "BEGIN {print ${user[$bin]} / $iterations}")" \
+      "$(awk "BEGIN {print ${sys[$bin]} / $iterations}")")
+
+    echo "$line" >> $log_file
+    echo "$line"
+  done
+  unset real user sys
+done
+
+echo "Saved results to $log_file"
@@ -0,0 +1,78 @@
+/**
+ * Benchmark of sharded scans against threaded ones. A tree is scanned on a
+ * warm cache with one process of THREADS threads, then with 2, 4, ... up to
+ * THREADS processes splitting the threads between them, and the mean wall
+ * time and the blocks of each are printed.
+ *
+ * @file procs_bench.c
+ * @author Elias Svensson (c24esn@cs.umu.se)
+ * @date 2025-11-18
+ */
+
+// --------------- Headers -------------------------------------------------- //
+
+#include "mdu_scan_competition.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// --------------- Constants ------------------------------------------------ //
+
+#define DEFAULT_DIR "/usr"
+#define DEFAULT_THREADS 8
+#define DEFAULT_RUNS 5
+
+// --------------- Declaration of internal functions ------------------------ //
+
+/**
+ * @brief Scan PATH RUNS times with NR_PROCS processes of THREADS threads each
+ * and print the result. One process is a plain threaded scan
+ */
+static void bench(const char *path, const int nr_procs, const short threads,
+                  const int runs);
+
+// --------------- Definition of functions ---------------------------------- //
+
+int main(int argc, char *argv[]) {
+  const char *path = argc > 1 ? argv[1] : DEFAULT_DIR;
+  const short threads = argc > 2 ? atoi(argv[2]) : DEFAULT_THREADS;
+  const int runs = argc > 3 ? atoi(argv[3]) : DEFAULT_RUNS;
+
+  if (threads < 1 || runs < 1) {
+    fprintf(stderr, "usage: %s [DIR] [THREADS] [RUNS]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  mdu_du(path, NULL); // warm the cache
+
+  for (int procs = 1; procs <= threads; procs *= 2) {
+    bench(path, procs, threads / procs, runs);
+  }
+
+  return EXIT_SUCCESS;
+}
+
+static void bench(const char *path, const int nr_procs, const short threads,
+                  const int runs) {
+  mdu_options_t opts;
+  mdu_options_init(&opts);
+  opts.nr_threads = threads;
+
+  double secs = 0;
+  long blocks = 0;
+
+  for (int i = 0; i < runs; i++) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // the pool of a threaded scan is gone when it returns, so forking is safe
+    blocks = nr_procs == 1 ? mdu_du(path, &opts)
+                           : mdu_du_procs(path, &opts, nr_procs, NULL);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    secs += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  }
+
+  printf("procs: %d\tthreads: %d\ttime: %.4fs\tblocks: %ld\n", nr_procs,
+         threads, secs / runs, blocks);
+}
@@ -0,0 +1,208 @@
+/**
+ * Benchmark of the schedules of the thread pool. Three trees are created in a
+ * directory: a wide one (one level of many directories), a deep one (a full
+ * binary tree) and chains (a few long paths with files along them). Each tree
+ * is scanned with every schedule on a warm cache, and the mean wall time and
+ * the most directories queued at once are printed.
+ *
+ * @file schedule_bench.c
+ * @author Elias Svensson (c24esn@cs.umu.se)
+ * @date 2025-11-12
+ */
+
+// --------------- Preprocessor directives ---------------------------------- //
+
+#define _XOPEN_SOURCE 700 // nftw()
+
+// --------------- Headers -------------------------------------------------- //
+
+#include "mdu_scan_competition.h"
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// --------------- Constants ------------------------------------------------ //
+
+#define DEFAULT_THREADS 8
+#define DEFAULT_RUNS 5
+#define WIDE_DIRS 20000   /* Directories below the root of the wide tree */
+#define DEEP_LEVELS 14    /* Levels of the binary tree */
+#define CHAINS 8          /* Paths of the chain tree */
+#define CHAIN_LEN 400     /* Directories along each chain */
+#define FILES_PER_DIR 2
+
+// --------------- Declaration of internal functions ------------------------ //
+
+/**
+ * @brief Create a directory with FILES_PER_DIR small files in it
+ *
+ * @param path      the directory to create
+ */
+static void make_dir(const char *path);
+
+/**
+ * @brief Create a full binary tree of directories
+ *
+ * @param path      the root to create, used as a buffer for the paths below
+ * @param levels    the levels left
+ */
+static void make_binary(char *path, const int levels);
+
+/**
+ * @brief Scan PATH RUNS times with a pool using SCHEDULE and print the result
+ */
+static void bench(const char *restrict tree, const char *restrict path,
+                  const short threads, const int runs,
+                  const tpool_schedule_t schedule);
+
+/**
+ * @brief Remove an entry for nftw()
+ */
+static int remove_entry(const char *path, const struct stat *st, int flag,
+                        struct FTW *ftw);
+
+// --------------- Definition of functions ---------------------------------- //
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s DIR [THREADS] [RUNS]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  const short threads = argc > 2 ? atoi(argv[2]) : DEFAULT_THREADS;
+  const int runs = argc > 3 ? atoi(argv[3]) : DEFAULT_RUNS;
+  char path[PATH_MAX];
+
+  // the trees are created below DIR and removed afterwards
+  snprintf(path, sizeof(path), "%s/schedule_bench", argv[1]);
+  if (mkdir(path, 0755)) {
+    perror(path);
+    return EXIT_FAILURE;
+  }
+
+  snprintf(path, sizeof(path), "%s/schedule_bench/wide", argv[1]);
+  make_dir(path);
+  const size_t wide_len = strlen(path);
+  for (int i = 0; i < WIDE_DIRS; i++) {
+    snprintf(path + wide_len, sizeof(path) - wide_len, "/%d", i);
+    make_dir(path);
+  }
+
+  snprintf(path, sizeof(path), "%s/schedule_bench/deep", argv[1]);
+  make_binary(path, DEEP_LEVELS);
+
+  snprintf(path, sizeof(path), "%s/schedule_bench/chains", argv[1]);
+  make_dir(path);
+  for (int i = 0; i < CHAINS; i++) {
+    size_t len = strlen(path);
+    len += snprintf(path + len, sizeof(path) - len, "/%d", i);
+    make_dir(path);
+
+    for (int k = 0; k < CHAIN_LEN; k++) {
+      len += snprintf(path + len, sizeof(path) - len, "/c");
+      make_dir(path);
+    }
+    snprintf(path, sizeof(path), "%s/schedule_bench/chains", argv[1]);
+  }
+
+  static const char *const trees[] = {"wide", "deep", "chains"};
+  static const tpool_schedule_t schedules[] = {TPOOL_LIFO, TPOOL_FIFO,
+                                               TPOOL_HYBRID};
+
+  for (size_t t = 0; t < sizeof(trees) / sizeof(trees[0]); t++) {
+    snprintf(path, sizeof(path), "%s/schedule_bench/%s", argv[1], trees[t]);
+    mdu_du(path, NULL); // warm the cache
+
+    for (size_t s = 0; s < sizeof(schedules) / sizeof(schedules[0]); s++) {
+      bench(trees[t], path, threads, runs, schedules[s]);
+    }
+  }
+
+  snprintf(path, sizeof(path), "%s/schedule_bench", argv[1]);
+  nftw(path, remove_entry, 64, FTW_DEPTH | FTW_PHYS);
+
+  return EXIT_SUCCESS;
+}
+
+static void make_dir(const char *path) {
+  mkdir(path, 0755);
+
+  for (int i = 0; i < FILES_PER_DIR; i++) {
+    char file[PATH_MAX];
+    snprintf(file, sizeof(file), "%s/f%d", path, i);
+
+    const int fd = open(file, O_WRONLY | O_CREAT, 0644);
+    if (write(fd, file, strlen(file)) < 0) {
+      perror(file);
+    }
+    close(fd);
+  }
+}
+
+static void make_binary(char *path, const int levels) {
+  make_dir(path);
+  if (levels == 1) {
+    return;
+  }
+
+  const size_t len = strlen(path);
+  for (int i = 0; i < 2; i++) {
+    snprintf(path + len, PATH_MAX - len, "/%d", i);
+    make_binary(path, levels - 1);
+  }
+  path[len] = '\0';
+}
+
+static void bench(const char *restrict tree, const char *restrict path,
+                  const short threads, const int runs,
+                  const tpool_schedule_t schedule) {
+  static const char *const names[] = {"lifo", "fifo", "hybrid"};
+
+  tpool_t *pool = mdu_pool_create_schedule(threads, schedule);
+  mdu_options_t opts;
+  mdu_options_init(&opts);
+  opts.pool = pool;
+
+  double secs = 0;
+  long peak = 0;
+  long blocks = 0;
+
+  for (int i = 0; i < runs; i++) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    mdu_scan_t *scan = mdu_scan_start(path, &opts);
+    mdu_scan_wait(scan);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    secs += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    mdu_progress_t progress;
+    mdu_scan_progress(scan, &progress);
+    if (progress.peak_pending > peak) {
+      peak = progress.peak_pending;
+    }
+    blocks = mdu_scan_blocks(scan);
+    mdu_scan_destroy(scan);
+  }
+
+  printf("%-8s %-8s threads: %d\ttime: %.4fs\tpeak queued: %ld\tblocks: %ld\n",
+         tree, names[schedule], threads, secs / runs, peak, blocks);
+
+  tpool_destroy(pool);
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag,
+                        struct FTW *ftw) {
+  (void)st;
+  (void)flag;
+  (void)ftw;
+
+  return remove(path);
+}
@@ -0,0 +1,151 @@
+/**
+ * Benchmark of the schedules of the thread pool on a simulated file system,
+ * see fs_competition.h. The tree and the latencies are the same in every run,
+ * so schedules and thread counts can be compared without the noise of a disk
+ * or the page cache. Every scan has to arrive at the blocks of the tree.
+ *
+ * @file sim_bench.c
+ * @author Elias Svensson (c24esn@cs.umu.se)
+ * @date 2025-11-13
+ */
+
+// --------------- Headers -------------------------------------------------- //
+
+#include "fs_competition.h"
+#include "mdu_scan_competition.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// --------------- Constants ------------------------------------------------ //
+
+#define DEFAULT_THREADS 8
+#define DEFAULT_RUNS 3
+
+// --------------- Declaration of internal functions ------------------------ //
+
+/**
+ * @brief Scan the root of FS RUNS times with a pool using SCHEDULE and print
+ * the result
+ *
+ * @return          0 if every scan got the blocks of FS, else 1
+ */
+static int bench(fs_t *fs, const short threads, const short stat_threads,
+                 const int runs, const tpool_schedule_t schedule);
+
+// --------------- Definition of functions ---------------------------------- //
+
+int main(int argc, char *argv[]) {
+  fs_sim_options_t sim;
+  fs_sim_options_init(&sim);
+  short threads = DEFAULT_THREADS;
+  short stat_threads = 0;
+  int runs = DEFAULT_RUNS;
+
+  static const struct option long_opts[] = {
+      {"seed", required_argument, NULL, 'r'},
+      {"nodes", required_argument, NULL, 'n'},
+      {"depth", required_argument, NULL, 'd'},
+      {"fanout", required_argument, NULL, 'f'},
+      {"files", required_argument, NULL, 'F'},
+      {"open-us", required_argument, NULL, 'o'},
+      {"getdents-us", required_argument, NULL, 'g'},
+      {"stat-us", required_argument, NULL, 's'},
+      {"stat-threads", required_argument, NULL, 'P'},
+      {"runs", required_argument, NULL, 'R'},
+      {NULL, 0, NULL, 0},
+  };
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "j:", long_opts, NULL)) != -1) {
+    if (opt == 'j') {
+      threads = atoi(optarg);
+    } else if (opt == 'r') {
+      sim.seed = atoi(optarg);
+    } else if (opt == 'n') {
+      sim.max_nodes = atol(optarg);
+    } else if (opt == 'd') {
+      sim.depth = atoi(optarg);
+    } else if (opt == 'f') {
+      sim.fanout = atoi(optarg);
+    } else if (opt == 'F') {
+      sim.files = atoi(optarg);
+    } else if (opt == 'o') {
+      sim.open_ns = atof(optarg) * 1000;
+    } else if (opt == 'g') {
+      sim.getdents_ns = atof(optarg) * 1000;
+    } else if (opt == 's') {
+      sim.stat_ns = atof(optarg) * 1000;
+    } else if (opt == 'P') {
+      stat_threads = atoi(optarg);
+    } else if (opt == 'R') {
+      runs = atoi(optarg);
+    } else {
+      fprintf(stderr,
+              "usage: %s [-j THREADS] [--stat-threads N] [--runs N] "
+              "[--seed N] [--nodes N] [--depth N] [--fanout N] [--files N] "
+              "[--open-us US] [--getdents-us US] [--stat-us US]\n",
+              argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  fs_t *fs = fs_sim_create(&sim);
+  printf("tree: %ld entries, %ld blocks\n", fs_sim_nodes(fs),
+         fs_sim_blocks(fs));
+
+  int err = 0;
+  err |= bench(fs, threads, stat_threads, runs, TPOOL_LIFO);
+  err |= bench(fs, threads, stat_threads, runs, TPOOL_FIFO);
+  err |= bench(fs, threads, stat_threads, runs, TPOOL_HYBRID);
+
+  fs_destroy(fs);
+
+  return err ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static int bench(fs_t *fs, const short threads, const short stat_threads,
+                 const int runs, const tpool_schedule_t schedule) {
+  static const char *const names[] = {"lifo", "fifo", "hybrid"};
+
+  tpool_t *pool = mdu_pool_create_schedule(threads, schedule);
+  mdu_options_t opts;
+  mdu_options_init(&opts);
+  opts.pool = pool;
+  opts.stat_threads = stat_threads;
+  opts.fs = fs;
+
+  double secs = 0;
+  long peak = 0;
+  int err = 0;
+
+  for (int i = 0; i < runs; i++) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    mdu_scan_t *scan = mdu_scan_start("/", &opts);
+    mdu_scan_wait(scan);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    secs += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    mdu_progress_t progress;
+    mdu_scan_progress(scan, &progress);
+    if (progress.peak_pending > peak) {
+      peak = progress.peak_pending;
+    }
+    if (mdu_scan_blocks(scan) != fs_sim_blocks(fs)) {
+      fprintf(stderr, "%s: got %ld blocks\n", names[schedule],
+              mdu_scan_blocks(scan));
+      err = 1;
+    }
+    mdu_scan_destroy(scan);
+  }
+
+  printf("%-8s threads: %d\ttime: %.4fs\tpeak queued: %ld\n", names[schedule],
+         threads, secs / runs, peak);
+
+  tpool_destroy(pool);
+  return err;
+}
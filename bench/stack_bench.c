@@ -0,0 +1,172 @@
+/**
+ * Stress test and benchmark for the stack in stack_competition.c. Every thread
+ * pushes unique tokens and pops whatever is on top, some threads work on a
+ * shared stack and some on their own stack which the others steal from, like
+ * the workers of the thread pool do. When all threads are done every token
+ * has to have been popped exactly once.
+ *
+ * @file stack_bench.c
+ * @author Elias Svensson (c24esn@cs.umu.se)
+ * @date 2025-10-28
+ */
+
+// --------------- Headers -------------------------------------------------- //
+
+#include "stack_competition.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// --------------- Constants ------------------------------------------------ //
+
+#define DEFAULT_THREADS 64
+#define DEFAULT_OPS 200000
+#define BURST 16 /* pushes in a row before popping */
+
+// --------------- Structs -------------------------------------------------- //
+
+typedef struct bench_t {
+  stack_t *shared;
+  stack_t **own;
+  atomic_uchar *seen; /* times each token was popped */
+  int nr_threads;
+  long ops;
+} bench_t;
+
+typedef struct arg_t {
+  bench_t *b;
+  int id;
+} arg_t;
+
+// --------------- Declaration of internal functions ------------------------ //
+
+/**
+ * @brief Push and pop tokens on the shared stack, the own stack and steal
+ * from the other threads
+ *
+ * @param arg       a pointer to a struct of type arg_t
+ */
+static void *run(void *arg);
+
+/**
+ * @brief Mark a popped token as seen
+ *
+ * @param b         the benchmark
+ * @param val       the popped value, NULL is ignored
+ */
+static void mark(bench_t *b, void *val);
+
+// --------------- Definition of functions ---------------------------------- //
+
+int main(int argc, char *argv[]) {
+  bench_t b;
+  b.nr_threads = argc > 1 ? atoi(argv[1]) : DEFAULT_THREADS;
+  b.ops = argc > 2 ? atol(argv[2]) : DEFAULT_OPS;
+
+  if (b.nr_threads < 1 || b.ops < 1) {
+    fprintf(stderr, "usage: %s [THREADS] [OPS PER THREAD]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  b.shared = stack_create();
+  b.own = calloc(b.nr_threads, sizeof(stack_t *));
+  b.seen = calloc(b.nr_threads * b.ops + 1, sizeof(atomic_uchar));
+
+  pthread_t *threads = calloc(b.nr_threads, sizeof(pthread_t));
+  arg_t *args = calloc(b.nr_threads, sizeof(arg_t));
+
+  for (int i = 0; i < b.nr_threads; i++) {
+    b.own[i] = stack_create();
+  }
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for (int i = 0; i < b.nr_threads; i++) {
+    args[i].b = &b;
+    args[i].id = i;
+    pthread_create(&threads[i], NULL, run, &args[i]);
+  }
+
+  for (int i = 0; i < b.nr_threads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  // drain what is left
+  while (!stack_is_empty(b.shared)) {
+    mark(&b, stack_pop(b.shared));
+  }
+  for (int i = 0; i < b.nr_threads; i++) {
+    while (!stack_is_empty(b.own[i])) {
+      mark(&b, stack_pop(b.own[i]));
+    }
+  }
+
+  long missing = 0;
+  long duplicate = 0;
+  for (long t = 1; t <= b.nr_threads * b.ops; t++) {
+    const unsigned char n = atomic_load(&b.seen[t]);
+    missing += n == 0;
+    duplicate += n > 1;
+  }
+
+  const double secs =
+      (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  printf("threads: %d\tops: %ld\ttime: %.3fs\tMops/s: %.2f\n", b.nr_threads,
+         2 * b.nr_threads * b.ops, secs, 2 * b.nr_threads * b.ops / secs / 1e6);
+
+  if (missing || duplicate) {
+    printf("FAILED: %ld missing, %ld popped more than once\n", missing,
+           duplicate);
+    return EXIT_FAILURE;
+  }
+
+  for (int i = 0; i < b.nr_threads; i++) {
+    stack_destroy(b.own[i]);
+  }
+  stack_destroy(b.shared);
+  free(b.own);
+  free(b.seen);
+  free(threads);
+  free(args);
+
+  return EXIT_SUCCESS;
+}
+
+static void *run(void *arg) {
+  arg_t *a = (arg_t *)arg;
+  bench_t *b = a->b;
+  stack_t *own = b->own[a->id];
+  uintptr_t token = (uintptr_t)a->id * b->ops + 1;
+
+  for (long i = 0; i < b->ops; i += BURST) {
+    // odd threads hammer the shared stack, even ones use their own
+    stack_t *target = a->id % 2 ? b->shared : own;
+
+    for (long k = i; k < i + BURST && k < b->ops; k++) {
+      stack_push(target, (void *)token++);
+    }
+
+    for (long k = i; k < i + BURST && k < b->ops; k++) {
+      void *val = stack_pop(target);
+      if (!val) {
+        // steal like an idle worker would
+        val = stack_pop(b->own[(a->id + k) % b->nr_threads]);
+      }
+      mark(b, val);
+    }
+  }
+
+  return NULL;
+}
+
+static void mark(bench_t *b, void *val) {
+  if (val) {
+    atomic_fetch_add(&b->seen[(uintptr_t)val], 1);
+  }
+}
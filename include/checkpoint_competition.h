@@ -0,0 +1,100 @@
+/**
+ * This module stores the state of an unfinished scan, see
+ * mdu_scan_checkpoint(): the directories not counted yet and the totals of
+ * everything counted before them. A scan started from it with
+ * mdu_options_t.resume counts only those directories on top of the totals, and
+ * ends up with the results of a scan run without a break.
+ *
+ * The file starts with a line per field and ends with the paths of the
+ * directories, each ended by a '\0', so any path can be stored. Paths and
+ * strings in the header are written with their length first for the same
+ * reason.
+ *
+ * @file checkpoint_competition.h
+ * @author Elias Svensson (c24esn@cs.umu.se)
+ * @date 2025-11-17
+ */
+
+#ifndef __CHECKPOINT_COMPETITION_H
+#define __CHECKPOINT_COMPETITION_H
+
+#include <stddef.h>
+#include <time.h>
+
+// --------------- Constants ------------------------------------------------ //
+
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_INODES (1U << 0)  /* Inodes were counted, not blocks */
+#define CHECKPOINT_SUMMARY (1U << 1) /* COUNTERS hold an mdu_summary_t */
+
+// --------------- Structs -------------------------------------------------- //
+
+/**
+ * @typedef checkpoint_t
+ * @brief a consistent cut of a scan: every directory was either counted in
+ * full or is in DIRS
+ *
+ */
+typedef struct checkpoint_t {
+  char *root;      /* Path the scan was started at */
+  char *where;     /* Source of mdu_options_t.where, NULL for none */
+  time_t now;      /* Time the ages of the scan are taken at */
+  unsigned flags;  /* CHECKPOINT_* flags of what was counted */
+  long blocks;     /* Total so far, with the root */
+  long entries;    /* Entries counted so far */
+  long *counters;  /* Other results of the scan, in an order it picks */
+  int nr_counters;
+  char *dirs;      /* Paths of the directories left, each ended by '\0' */
+  size_t dirs_len; /* Bytes used in DIRS */
+  size_t dirs_cap;
+  long nr_dirs;
+} checkpoint_t;
+
+// --------------- Declaration of external functions ------------------------ //
+
+/**
+ * @brief Allocate an empty checkpoint. The memory allocated needs to be freed
+ * by calling checkpoint_destroy()
+ *
+ * @param root      the path the scan was started at, copied
+ * @param nr_counters   the length of checkpoint_t.counters, set to 0
+ * @return          a pointer to a struct of type checkpoint_t
+ */
+checkpoint_t *checkpoint_create(const char *root, const int nr_counters);
+
+/**
+ * @brief Read a checkpoint saved by checkpoint_save()
+ *
+ * @param file      the file to read
+ * @return          a pointer to a struct of type checkpoint_t. NULL if the file
+ * could not be read or is not a checkpoint of this version
+ */
+checkpoint_t *checkpoint_load(const char *file);
+
+/**
+ * @brief Write a checkpoint to FILE. The file is replaced atomically and
+ * synced to disk before the call returns, so a crash leaves either the old or
+ * the new checkpoint
+ *
+ * @param cp        a pointer to a struct of type checkpoint_t
+ * @param file      the file to write
+ * @return          0 on success, -1 on error
+ */
+int checkpoint_save(const checkpoint_t *restrict cp, const char *restrict file);
+
+/**
+ * @brief Deallocate a checkpoint
+ *
+ * @param cp        a pointer to a struct of type checkpoint_t, may be NULL
+ */
+void checkpoint_destroy(checkpoint_t *cp);
+
+/**
+ * @brief Add a directory left to count
+ *
+ * @param cp        a pointer to a struct of type checkpoint_t
+ * @param path      the path of the directory, copied
+ */
+void checkpoint_add_dir(checkpoint_t *restrict cp, const char *restrict path);
+
+#endif // !__CHECKPOINT_COMPETITION_H
@@ -0,0 +1,71 @@
+/**
+ * This module estimates the blocks used by a file tree without reading all of
+ * it. It uses random probes (Knuth's estimator): a probe walks from the root
+ * to a leaf, taking a random subdirectory at every level. At each directory
+ * on the way the blocks of its entries are multiplied by the product of the
+ * number of subdirectories met above it. This gives an unbiased estimate of
+ * the total, and the mean of many probes is reported with a 95% confidence
+ * interval.
+ *
+ * @file estimate_competition.h
+ * @author Elias Svensson (c24esn@cs.umu.se)
+ * @date 2025-11-10
+ */
+
+#ifndef __ESTIMATE_COMPETITION_H
+#define __ESTIMATE_COMPETITION_H
+
+// --------------- Structs -------------------------------------------------- //
+
+/**
+ * @typedef estimate_options_t
+ * @brief when to stop probing. Initialize with estimate_options_init()
+ *
+ */
+typedef struct estimate_options_t {
+  short nr_threads;  /* Threads probing in parallel */
+  double max_error;  /* Stop when the interval is within this share, 0.02 */
+  double budget;     /* Stop after this many seconds, 0 for no limit */
+  long min_probes;   /* Probes before the error is first tested */
+  long max_probes;   /* Stop after this many probes */
+} estimate_options_t;
+
+/**
+ * @typedef estimate_t
+ * @brief the result of estimate_blocks()
+ *
+ */
+typedef struct estimate_t {
+  double blocks; /* Estimated total blocks */
+  double error;  /* Half width of the 95% confidence interval, in blocks */
+  long probes;   /* Probes made */
+  long reads;    /* Directories read, the cost of the estimate */
+} estimate_t;
+
+// --------------- Declaration of external functions ------------------------ //
+
+/**
+ * @brief Set every option to its default: one thread, a 2% error and no time
+ * budget
+ *
+ * @param opts      the options to initialize
+ */
+void estimate_options_init(estimate_options_t *opts);
+
+/**
+ * @brief Estimate the blocks used by the tree at PATH. Probes until the error
+ * of the estimate is within estimate_options_t.max_error of it, the budget is
+ * spent or max_probes probes are made. The error is tested after min_probes
+ * probes and then each time they have doubled, and has to be met by two tests
+ * in a row
+ *
+ * @param path      the file or directory to estimate
+ * @param opts      the options to use, NULL for the defaults
+ * @param result    set to the estimate
+ * @return          0 on success, -1 if PATH could not be accessed
+ */
+int estimate_blocks(const char *restrict path,
+                    const estimate_options_t *restrict opts,
+                    estimate_t *restrict result);
+
+#endif // !__ESTIMATE_COMPETITION_H
@@ -0,0 +1,109 @@
+/**
+ * This module defines the file system backend of a scan: the calls a scan
+ * makes to open, read and stat directories, so that they can be served by
+ * something else than the kernel. A scan without a backend makes the system
+ * calls directly.
+ *
+ * The backend here is a simulated file system, a tree generated in memory
+ * from a seed with a latency added to every call. Runs on it do not depend
+ * on the page cache or on a disk, so changes to the scheduling of a scan can
+ * be compared at the latencies of e.g. NFS on any machine.
+ *
+ * @file fs_competition.h
+ * @author Elias Svensson (c24esn@cs.umu.se)
+ * @date 2025-11-13
+ */
+
+#ifndef __FS_COMPETITION_H
+#define __FS_COMPETITION_H
+
+#include <stddef.h>
+#include <sys/stat.h>
+
+// --------------- Structs -------------------------------------------------- //
+
+/**
+ * @typedef fs_t
+ * @brief a file system backend. The calls follow the system calls they
+ * replace: they return -1 and set errno on error, descriptors are only valid
+ * in the same backend, and AT_FDCWD is the root of the backend. Every call
+ * may be made by many threads at once
+ *
+ */
+typedef struct fs_t {
+  /* Open the directory PATH relative to DIRFD, like openat(2) */
+  int (*openat)(struct fs_t *fs, const int dirfd, const char *path);
+  /* Read linux_dirent64 records of FD into BUF, like getdents64(2) */
+  int (*getdents)(struct fs_t *fs, const int fd, void *buf,
+                  const size_t size);
+  /* Stat NAME relative to DIRFD without following links, like fstatat(2) */
+  int (*fstatat)(struct fs_t *fs, const int dirfd, const char *name,
+                 struct stat *st);
+  /* Close a descriptor from OPENAT */
+  int (*close)(struct fs_t *fs, const int fd);
+  /* Free the backend */
+  void (*destroy)(struct fs_t *fs);
+} fs_t;
+
+/**
+ * @typedef fs_sim_options_t
+ * @brief the tree and the latencies of a simulated file system. Initialize
+ * with fs_sim_options_init()
+ *
+ */
+typedef struct fs_sim_options_t {
+  unsigned seed;    /* The same seed and options give the same tree */
+  long max_nodes;   /* The most entries in the tree, including the root */
+  short depth;      /* Levels of directories below the root */
+  short fanout;     /* Mean subdirectories of a directory above DEPTH */
+  short files;      /* Mean files of a directory */
+  long open_ns;     /* Latency of an open */
+  long getdents_ns; /* Latency of a getdents call */
+  long stat_ns;     /* Latency of a stat */
+} fs_sim_options_t;
+
+// --------------- Declaration of external functions ------------------------ //
+
+/**
+ * @brief Set the options of a simulated file system to their defaults: about
+ * a million entries in 8 levels, with no latency
+ *
+ * @param opts      the options to initialize
+ */
+void fs_sim_options_init(fs_sim_options_t *opts);
+
+/**
+ * @brief Generate a simulated file system. Directories are named "dN" and
+ * files "fN", where N counts from 0 in every directory. The memory allocated
+ * needs to be freed by calling fs_destroy()
+ *
+ * @param opts      the options to use, NULL for the defaults
+ * @return          a pointer to a struct of type fs_t
+ */
+fs_t *fs_sim_create(const fs_sim_options_t *opts);
+
+/**
+ * @brief Get the blocks used by a simulated file system, which a scan of its
+ * root has to arrive at
+ *
+ * @param fs        a pointer to a simulated file system
+ * @return          the total amount of blocks
+ */
+long fs_sim_blocks(const fs_t *fs);
+
+/**
+ * @brief Get the entries of a simulated file system, including the root
+ *
+ * @param fs        a pointer to a simulated file system
+ * @return          the amount of entries
+ */
+long fs_sim_nodes(const fs_t *fs);
+
+/**
+ * @brief Deallocate a backend
+ *
+ * @param fs        a pointer to a struct of type fs_t, may be NULL
+ */
+void fs_destroy(fs_t *fs);
+
+#endif // !__FS_COMPETITION_H
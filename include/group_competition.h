@@ -0,0 +1,138 @@
+/**
+ * This module breaks the usage of a scan down by owner, group, file extension
+ * and age, for mdu_options_t.group_by. Every kind of grouping is a table of
+ * its own from a key to the entries and blocks with that key. A groups_t
+ * holds one table per kind asked for and is not thread safe: each thread
+ * fills its own, and they are merged when the scan is done.
+ *
+ * @file group_competition.h
+ * @author Elias Svensson (c24esn@cs.umu.se)
+ * @date 2025-11-15
+ */
+
+#ifndef __GROUP_COMPETITION_H
+#define __GROUP_COMPETITION_H
+
+#include <stdint.h>
+#include <sys/stat.h>
+#include <time.h>
+
+// --------------- Constants ------------------------------------------------ //
+
+#define GROUP_EXT_MAX 16 /* Longer extensions count as none, with the '\0' */
+
+// --------------- Structs -------------------------------------------------- //
+
+/**
+ * @typedef group_kind_t
+ * @brief what to group entries by. A set of kinds is a mask of
+ * (1 << kind) bits
+ *
+ */
+typedef enum group_kind_t {
+  GROUP_UID, /* Owner of the entry */
+  GROUP_GID, /* Group of the entry */
+  GROUP_EXT, /* Extension of a regular file, others have none */
+  GROUP_AGE, /* Time since the last modification, see group_age_name() */
+  GROUP_KINDS
+} group_kind_t;
+
+/**
+ * @typedef group_entry_t
+ * @brief the entries and blocks with one key
+ *
+ */
+typedef struct group_entry_t {
+  union {
+    uint64_t id;             /* uid, gid or age bucket */
+    char ext[GROUP_EXT_MAX]; /* The extension, "" for none */
+    uint64_t words[2];       /* The key as a whole */
+  };
+  long entries; /* Entries with the key, 0 for an empty slot */
+  long blocks;  /* Blocks of those entries */
+} group_entry_t;
+
+/**
+ * @typedef groups_t
+ * @brief a table per kind of grouping
+ *
+ */
+typedef struct groups_t groups_t;
+
+// --------------- Declaration of external functions ------------------------ //
+
+/**
+ * @brief Allocate empty tables for a set of kinds. The memory allocated needs
+ * to be freed by calling groups_destroy()
+ *
+ * @param kinds     a mask of (1 << group_kind_t) bits
+ * @param now       the time the ages are taken at
+ * @return          a pointer to a struct of type groups_t
+ */
+groups_t *groups_create(const unsigned kinds, const time_t now);
+
+/**
+ * @brief Deallocate the tables
+ *
+ * @param groups    a pointer to a struct of type groups_t, may be NULL
+ */
+void groups_destroy(groups_t *groups);
+
+/**
+ * @brief Add an entry to the table of every kind
+ *
+ * @param groups    a pointer to a struct of type groups_t
+ * @param st        the result of lstat on the entry
+ * @param name      the name of the entry, for its extension
+ * @param blocks    the blocks to add, as counted by the scan
+ */
+void groups_add(groups_t *restrict groups, const struct stat *restrict st,
+                const char *restrict name, const long blocks);
+
+/**
+ * @brief Merge the tables of ALL[1] to ALL[N - 1] into ALL[0]. The kinds are
+ * merged in parallel when the tables are large. Every groups_t must have been
+ * created with the same kinds
+ *
+ * @param all       the tables to merge
+ * @param n         the amount of tables
+ */
+void groups_merge(groups_t *const *all, const int n);
+
+/**
+ * @brief Get the entries of one kind, sorted from the most blocks. The array
+ * is valid until the next call or change to the tables
+ *
+ * @param groups    a pointer to a struct of type groups_t
+ * @param kind      the kind to get
+ * @param len       set to the amount of entries
+ * @return          an array owned by GROUPS, NULL if KIND was not asked for
+ */
+const group_entry_t *groups_get(groups_t *restrict groups,
+                                const group_kind_t kind, long *restrict len);
+
+/**
+ * @brief Parse a comma separated list of "uid", "gid", "ext" and "age"
+ *
+ * @param list      the list
+ * @return          a mask of (1 << group_kind_t) bits, 0 if a kind is unknown
+ */
+unsigned groups_parse(const char *list);
+
+/**
+ * @brief Get the name of a kind, as in groups_parse()
+ *
+ * @param kind      a group_kind_t
+ * @return          a static string
+ */
+const char *group_kind_name(const group_kind_t kind);
+
+/**
+ * @brief Get the name of an age bucket, e.g. "<7d"
+ *
+ * @param bucket    group_entry_t.id of a GROUP_AGE entry
+ * @return          a static string
+ */
+const char *group_age_name(const uint64_t bucket);
+
+#endif // !__GROUP_COMPETITION_H
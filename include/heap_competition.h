@@ -0,0 +1,100 @@
+/**
+ * This module implements a bounded min-heap. It keeps the N entries with the
+ * largest keys seen so far, which makes it usable as a top-N collector. A heap
+ * is not thread safe, each thread is expected to own one and merge them when
+ * all work is done.
+ *
+ * @file heap_competition.h
+ * @author Elias Svensson (c24esn@cs.umu.se)
+ * @date 2025-10-27
+ */
+
+#ifndef __HEAP_COMPETITION_H
+#define __HEAP_COMPETITION_H
+
+#include <stdbool.h>
+
+// --------------- Structs -------------------------------------------------- //
+
+/**
+ * @typedef heap_entry_t
+ * @brief a single entry in a heap. The value is owned by the heap
+ *
+ */
+typedef struct heap_entry_t {
+  long key;  /* Value to order by */
+  char *val; /* Heap allocated string, freed by the heap */
+} heap_entry_t;
+
+/**
+ * @typedef heap_t
+ * @brief a bounded min-heap of heap_entry_t
+ *
+ */
+typedef struct heap_t heap_t;
+
+// --------------- Declaration of external functions ------------------------ //
+
+/**
+ * @brief Allocate a heap which holds at most CAPACITY entries. The memory
+ * allocated needs to be freed by calling heap_destroy()
+ *
+ * @param capacity      the max amount of entries to keep
+ * @return              a pointer to a struct of type heap_t
+ */
+heap_t *heap_create(const int capacity);
+
+/**
+ * @brief Deallocate a heap and every value still inside of it
+ *
+ * @param heap      a pointer to a struct of type heap_t
+ */
+void heap_destroy(heap_t *heap);
+
+/**
+ * @brief Check if an entry with KEY would be kept by the heap. Used to avoid
+ * building a value that would be thrown away directly
+ *
+ * @param heap      a pointer to a struct of type heap_t
+ * @param key       the key to check
+ * @return          true if heap_push() would keep the entry
+ */
+bool heap_accepts(const heap_t *heap, const long key);
+
+/**
+ * @brief Insert an entry. If the heap is full the smallest entry is evicted.
+ * The heap takes ownership of VAL, it is freed if it is not kept
+ *
+ * @param heap      a pointer to a struct of type heap_t
+ * @param key       the key to order by
+ * @param val       a heap allocated string
+ */
+void heap_push(heap_t *restrict heap, const long key, char *restrict val);
+
+/**
+ * @brief Move every entry from SRC into DST. SRC is empty afterwards
+ *
+ * @param dst       the heap to merge into
+ * @param src       the heap to merge from
+ */
+void heap_merge(heap_t *restrict dst, heap_t *restrict src);
+
+/**
+ * @brief Sort the entries of a heap from the largest to the smallest key. The
+ * returned array is owned by the heap and valid until the next call to any
+ * function changing the heap
+ *
+ * @param heap      a pointer to a struct of type heap_t
+ * @param len       set to the amount of entries in the array
+ * @return          an array of entries
+ */
+const heap_entry_t *heap_sorted(heap_t *restrict heap, int *restrict len);
+
+/**
+ * @brief Remove and free every entry in a heap
+ *
+ * @param heap      a pointer to a struct of type heap_t
+ */
+void heap_clear(heap_t *heap);
+
+#endif // !__HEAP_COMPETITION_H
@@ -0,0 +1,87 @@
+/**
+ * This module stores cost hints for a scan: the amount of entries below a
+ * directory, as counted by a previous run. Hints are kept in a hash table and
+ * saved as a text file with one "ENTRIES\tPATH" line per directory. Only
+ * directories with at least HINT_MIN_ENTRIES entries are kept, which keeps
+ * the file small while still covering every large subtree and its ancestors.
+ *
+ * A hints_t may be read by many threads at once as long as nobody writes to
+ * it.
+ *
+ * @file hints_competition.h
+ * @author Elias Svensson (c24esn@cs.umu.se)
+ * @date 2025-11-05
+ */
+
+#ifndef __HINTS_COMPETITION_H
+#define __HINTS_COMPETITION_H
+
+// --------------- Constants ------------------------------------------------ //
+
+#define HINT_MIN_ENTRIES 10000 /* Smaller subtrees are not worth a hint */
+
+// --------------- Structs -------------------------------------------------- //
+
+/**
+ * @typedef hints_t
+ * @brief a table from directory paths to the entries below them
+ *
+ */
+typedef struct hints_t hints_t;
+
+// --------------- Declaration of external functions ------------------------ //
+
+/**
+ * @brief Allocate an empty table. The memory allocated needs to be freed by
+ * calling hints_destroy()
+ *
+ * @return          a pointer to a struct of type hints_t
+ */
+hints_t *hints_create(void);
+
+/**
+ * @brief Read a table saved by hints_save()
+ *
+ * @param file      the file to read
+ * @return          a pointer to a struct of type hints_t. NULL if the file
+ * could not be read
+ */
+hints_t *hints_load(const char *file);
+
+/**
+ * @brief Write a table to FILE. The file is replaced atomically
+ *
+ * @param hints     a pointer to a struct of type hints_t
+ * @param file      the file to write
+ * @return          0 on success, -1 on error
+ */
+int hints_save(const hints_t *restrict hints, const char *restrict file);
+
+/**
+ * @brief Deallocate a table
+ *
+ * @param hints     a pointer to a struct of type hints_t
+ */
+void hints_destroy(hints_t *hints);
+
+/**
+ * @brief Set the amount of entries below PATH. Ignored if it is less than
+ * HINT_MIN_ENTRIES
+ *
+ * @param hints     a pointer to a struct of type hints_t
+ * @param path      the path of a directory
+ * @param entries   the amount of entries below it
+ */
+void hints_put(hints_t *restrict hints, const char *restrict path,
+               const long entries);
+
+/**
+ * @brief Get the amount of entries below PATH
+ *
+ * @param hints     a pointer to a struct of type hints_t
+ * @param path      the path of a directory
+ * @return          the amount of entries, 0 if there is no hint
+ */
+long hints_get(const hints_t *restrict hints, const char *restrict path);
+
+#endif // !__HINTS_COMPETITION_H
@@ -0,0 +1,406 @@
+/**
+ * This module is the scanner behind mdu, packaged as a library (libmdu). A
+ * scan counts the blocks used by a file tree on a thread pool. Scans do not
+ * share any state, so any amount of them may run at the same time, either on
+ * their own pool or on one pool shared between them.
+ *
+ * A minimal use is:
+ *
+ *   mdu_options_t opts;
+ *   mdu_options_init(&opts);
+ *   mdu_scan_t *scan = mdu_scan_start("/home", &opts);
+ *   mdu_scan_wait(scan);
+ *   printf("%ld\n", mdu_scan_blocks(scan));
+ *   mdu_scan_destroy(scan);
+ *
+ * @file mdu_scan_competition.h
+ * @author Elias Svensson (c24esn@cs.umu.se)
+ * @date 2025-10-30
+ */
+
+#ifndef __MDU_SCAN_COMPETITION_H
+#define __MDU_SCAN_COMPETITION_H
+
+#include "checkpoint_competition.h"
+#include "fs_competition.h"
+#include "group_competition.h"
+#include "heap_competition.h"
+#include "hints_competition.h"
+#include "ratelimit_competition.h"
+#include "shard_competition.h"
+#include "snapshot_competition.h"
+#include "stats_competition.h"
+#include "thread_pool_competition.h"
+#include "where_competition.h"
+#include <stdbool.h>
+#include <sys/stat.h>
+#include <time.h>
+
+// --------------- Constants ------------------------------------------------ //
+
+#define MDU_HIST_BUCKETS 64 /* log2 buckets, enough for any off_t */
+#define MDU_DEVICE_AUTO -1  /* mdu_options_t.device_jobs picked per device */
+
+// --------------- Structs -------------------------------------------------- //
+
+/**
+ * @typedef mdu_scan_t
+ * @brief a single scan of a file tree
+ *
+ */
+typedef struct mdu_scan_t mdu_scan_t;
+
+/**
+ * @typedef mdu_entry_t
+ * @brief a view of an entry given to mdu_options_t.on_entry. Every pointer
+ * points into memory owned by the scanner and is only valid during the call
+ *
+ */
+typedef struct mdu_entry_t {
+  const char *dir;       /* Path of the directory holding the entry */
+  const char *name;      /* Name of the entry inside DIR */
+  const struct stat *st; /* Result of lstat on the entry */
+} mdu_entry_t;
+
+/**
+ * @typedef mdu_summary_t
+ * @brief counters gathered with mdu_options_t.summary. Bucket 0 of the
+ * histogram holds empty files and bucket k holds files with a size in
+ * [2^(k-1), 2^k)
+ *
+ */
+typedef struct mdu_summary_t {
+  long files;                  /* Regular files */
+  long dirs;                   /* Directories */
+  long symlinks;               /* Symbolic links */
+  long others;                 /* Sockets, fifos and devices */
+  long hist[MDU_HIST_BUCKETS]; /* Regular files per log2 size bucket */
+} mdu_summary_t;
+
+/**
+ * @typedef mdu_progress_t
+ * @brief counters of a running scan read by mdu_scan_progress(). Workers
+ * update them once per directory, so they lag behind by the directories being
+ * counted
+ *
+ */
+typedef struct mdu_progress_t {
+  long entries;      /* Entries counted so far */
+  long blocks;       /* Blocks counted so far */
+  long pending;      /* Directories and batches waiting or being counted */
+  long peak_pending; /* Most PENDING seen when a directory was added */
+} mdu_progress_t;
+
+/**
+ * @typedef mdu_options_t
+ * @brief options of a scan. Initialize with mdu_options_init() and change the
+ * fields needed
+ *
+ */
+typedef struct mdu_options_t {
+  /* Threads of the pool created if POOL is NULL. A scan creating a pool of
+   * one thread walks the whole tree in a single job, without queueing any. A
+   * shared POOL always gets a job per directory, so scans on it interleave */
+  short nr_threads;
+  tpool_t *pool;    /* A pool from mdu_pool_create() to share, may be NULL */
+  /* Threads of a separate stat stage started for the scan. The pool then only
+   * enumerates directories, which pays off when stat has a high latency, e.g.
+   * on NFS. 0 to stat in the enumerating worker */
+  short stat_threads;
+  /* The most directories of one device (st_dev) read at a time. Directories
+   * over the limit wait while the workers move on to other devices, so a
+   * slow disk can not hold every worker. 0 for no limit, MDU_DEVICE_AUTO to
+   * limit rotational disks only */
+  short device_jobs;
+
+  int top_n;      /* Amount of entries to keep for TOP_FILES and TOP_DIRS */
+  bool top_files; /* Keep the TOP_N largest files */
+  bool top_dirs;  /* Keep the TOP_N largest directories */
+  bool summary;   /* Gather the counters in mdu_summary_t */
+  /* Stat the entries of a directory in inode order instead of getdents order.
+   * Faster on a cold cache of a disk where seeks are expensive */
+  bool inode_order;
+  /* Count inodes instead of blocks: every entry and the root count as 1, in
+   * the total and for every directory. Entries are typed by getdents and only
+   * stat'ed when it gives DT_UNKNOWN, or when TOP_FILES, SUMMARY or ON_ENTRY
+   * needs the stat. The largest files are still ranked by blocks */
+  bool inodes;
+  /* Break the blocks and entries down by every kind in this mask of
+   * (1 << group_kind_t) bits, see mdu_scan_groups(). Every entry and the root
+   * are grouped. 0 for none */
+  unsigned group_by;
+  /* Count only the entries matching this, from where_compile(). Other files
+   * are skipped, and other directories are walked but add no blocks of their
+   * own. Matched entries alone reach the summary, the groups, ON_ENTRY and
+   * the largest files. NULL to count every entry */
+  const where_t *where;
+  /* The most directory opens and stats per second, 0 for no limit. Shared by
+   * every thread of the scan */
+  long max_iops;
+  /* Lower the rate below MAX_IOPS while /proc/pressure/io shows I/O stalls */
+  bool iops_backoff;
+  /* Cancel the scan as soon as the blocks (or inodes) counted pass this, see
+   * mdu_scan_exceeded(). 0 for no limit */
+  long exceeds;
+  /* Allow mdu_scan_checkpoint(). Every directory is then a job of the pool,
+   * also with a single worker. Not with TOP_FILES, TOP_DIRS, GROUP_BY,
+   * STAT_THREADS, DEVICE_JOBS, HINTS_OUT, SNAPSHOT_OUT or ON_DIR, whose state
+   * a checkpoint does not hold */
+  bool checkpoints;
+  /* Carry on from a checkpoint of a scan of the same path with the same
+   * options: only the directories left in it are counted, on top of its
+   * totals. Has the limits of CHECKPOINTS. NULL to scan from the root */
+  const checkpoint_t *resume;
+  /* Hand directories to the other processes of a sharded scan while they wait
+   * for work, see mdu_du_procs(). Has the limits of CHECKPOINTS. NULL to
+   * count every directory in this scan */
+  shard_t *shard;
+  /* Serves the opens, reads and stats of the scan instead of the kernel, e.g.
+   * a simulated file system from fs_sim_create(). NULL for the kernel */
+  fs_t *fs;
+  /* Live counters published while the scan runs. Worker i adds what it counts
+   * to stats_thread(STATS, i) and stat thread k to the one after the workers,
+   * and the phase follows the scan. The pool is counted by passing
+   * stats_pool(STATS) to tpool_set_counters(). NULL for none */
+  stats_t *stats;
+
+  /* Entries below directories from a previous run. Large subtrees are
+   * scheduled first so that they do not end up running alone at the end */
+  const hints_t *hints;
+  /* Filled with the entries below every large directory when the scan is
+   * waited for, to be used as HINTS by the next run */
+  hints_t *hints_out;
+  /* Given the blocks of every directory when the scan is waited for */
+  snapshot_builder_t *snapshot_out;
+
+  /* Called for every entry below the root, from a worker or stat thread */
+  void (*on_entry)(const mdu_entry_t *entry, void *user);
+  /* Called for every directory when its subtree is counted, from any thread
+   * of the scan */
+  void (*on_dir)(const char *path, const long blocks, void *user);
+  /* Called once when the scan is done, from any thread of the scan. The scan
+   * must not be destroyed from inside the callback */
+  void (*on_done)(mdu_scan_t *scan, void *user);
+  void *user; /* Passed to every callback */
+} mdu_options_t;
+
+// --------------- Declaration of external functions ------------------------ //
+
+/**
+ * @brief Set every option to its default: one thread, an owned pool and no
+ * extra results or callbacks
+ *
+ * @param opts      the options to initialize
+ */
+void mdu_options_init(mdu_options_t *opts);
+
+/**
+ * @brief Create a thread pool which scans can share by setting
+ * mdu_options_t.pool. Needs to be freed by calling tpool_destroy() after all
+ * scans using it are destroyed
+ *
+ * @param nr_threads    the amount of threads to start
+ * @return              a pointer to a struct of type tpool_t
+ */
+tpool_t *mdu_pool_create(const short nr_threads);
+
+/**
+ * @brief Like mdu_pool_create(), but run the directories in the order of
+ * SCHEDULE. TPOOL_FIFO reaches many parallel jobs sooner on trees which are
+ * narrow at the top, at the cost of more directories queued at once
+ *
+ * @param nr_threads    the amount of threads to start
+ * @param schedule      the order to run directories in
+ * @return              a pointer to a struct of type tpool_t
+ */
+tpool_t *mdu_pool_create_schedule(const short nr_threads,
+                                  const tpool_schedule_t schedule);
+
+/**
+ * @brief Give the calling thread the idle CPU and I/O priority, so that it
+ * only runs and does I/O when nothing else wants to. Threads it creates later,
+ * such as the workers of mdu_pool_create(), inherit it
+ *
+ * @return              0 on success, -1 if a priority could not be set
+ */
+int mdu_background(void);
+
+/**
+ * @brief Start scanning PATH. The call returns directly, the work is done by
+ * the pool. The memory allocated needs to be freed by calling
+ * mdu_scan_destroy()
+ *
+ * @param path      the file or directory to scan
+ * @param opts      the options to use, copied by the call
+ * @return          a pointer to a struct of type mdu_scan_t. NULL if there was
+ * an error
+ */
+mdu_scan_t *mdu_scan_start(const char *restrict path,
+                           const mdu_options_t *restrict opts);
+
+/**
+ * @brief Wait for a scan to complete and merge the results of every worker
+ *
+ * @param scan      a pointer to a struct of type mdu_scan_t
+ */
+void mdu_scan_wait(mdu_scan_t *scan);
+
+/**
+ * @brief Wait for a scan like mdu_scan_wait(), but give up at ABSTIME
+ *
+ * @param scan      a pointer to a struct of type mdu_scan_t
+ * @param abstime   the time to give up at, on CLOCK_REALTIME
+ * @return          true if the scan is done, false on timeout or if a signal
+ * interrupted the wait
+ */
+bool mdu_scan_timedwait(mdu_scan_t *restrict scan,
+                        const struct timespec *restrict abstime);
+
+/**
+ * @brief Stop a scan early. Directories being read are left after the current
+ * getdents buffer and those not opened yet are skipped, which drains the pool
+ * quickly, and the scan still has to be waited for. The results are then
+ * partial, see mdu_scan_unscanned(). Safe to call from any thread, more than
+ * once
+ *
+ * @param scan      a pointer to a struct of type mdu_scan_t
+ */
+void mdu_scan_cancel(mdu_scan_t *scan);
+
+/**
+ * @brief Get the amount of directories a cancelled scan skipped or left
+ * before the end of their entries. Their own blocks are counted, but only the
+ * entries read before the cancel
+ *
+ * @param scan      a pointer to a struct of type mdu_scan_t
+ * @return          the amount of directories, 0 if the scan is complete
+ */
+long mdu_scan_unscanned(const mdu_scan_t *scan);
+
+/**
+ * @brief Wait for a scan with mdu_options_t.exceeds and find out if its total
+ * passed the limit. A scan cancelled for any other reason is only known to
+ * exceed it if it got past it before the cancel
+ *
+ * @param scan      a pointer to a struct of type mdu_scan_t
+ * @return          true if the total is over mdu_options_t.exceeds, false if
+ * not or if the scan has no limit
+ */
+bool mdu_scan_exceeded(mdu_scan_t *scan);
+
+/**
+ * @brief Read the counters of a running or finished scan. Cheap enough to
+ * call often, it only reads one cache line per worker
+ *
+ * @param scan      a pointer to a struct of type mdu_scan_t
+ * @param progress  set to the counters
+ */
+void mdu_scan_progress(const mdu_scan_t *restrict scan,
+                       mdu_progress_t *restrict progress);
+
+/**
+ * @brief Save a running scan to FILE, for mdu_options_t.resume. The workers
+ * finish the directories they are reading and hold the jobs they take next,
+ * until the directories left and the totals are copied. The file is written
+ * once they are back at work. The scan needs mdu_options_t.checkpoints, and
+ * only one thread may checkpoint it at a time
+ *
+ * @param scan      a pointer to a struct of type mdu_scan_t
+ * @param file      the file to write, replaced atomically
+ * @return          0 on success, -1 on error
+ */
+int mdu_scan_checkpoint(mdu_scan_t *restrict scan, const char *restrict file);
+
+/**
+ * @brief Deallocate a scan. Waits for the scan first if it is still running.
+ * An owned pool is destroyed as well
+ *
+ * @param scan      a pointer to a struct of type mdu_scan_t
+ */
+void mdu_scan_destroy(mdu_scan_t *scan);
+
+/**
+ * @brief Get the total amount of 512 byte blocks used by a finished scan, or
+ * the amount of inodes with mdu_options_t.inodes
+ *
+ * @param scan      a pointer to a struct of type mdu_scan_t
+ * @return          the total amount of blocks
+ */
+long mdu_scan_blocks(const mdu_scan_t *scan);
+
+/**
+ * @brief Get the largest files or directories of a finished scan, sorted from
+ * the largest. Keys are blocks and values are paths
+ *
+ * @param scan      a pointer to a struct of type mdu_scan_t
+ * @param files     true for files, false for directories
+ * @param len       set to the amount of entries
+ * @return          an array owned by the scan, NULL if not enabled
+ */
+const heap_entry_t *mdu_scan_top(mdu_scan_t *restrict scan, const bool files,
+                                 int *restrict len);
+
+/**
+ * @brief Get the summary of a finished scan
+ *
+ * @param scan      a pointer to a struct of type mdu_scan_t
+ * @return          the summary, NULL if not enabled
+ */
+const mdu_summary_t *mdu_scan_summary(const mdu_scan_t *scan);
+
+/**
+ * @brief Get the blocks and entries of a finished scan by one kind of
+ * mdu_options_t.group_by, sorted from the most blocks. They add up to the
+ * total of the scan
+ *
+ * @param scan      a pointer to a struct of type mdu_scan_t
+ * @param kind      the kind to get
+ * @param len       set to the amount of entries
+ * @return          an array owned by the scan, NULL if KIND was not asked for
+ */
+const group_entry_t *mdu_scan_groups(mdu_scan_t *restrict scan,
+                                     const group_kind_t kind,
+                                     long *restrict len);
+
+/**
+ * @brief Scan PATH and wait for the result
+ *
+ * @param path      the file or directory to scan
+ * @param opts      the options to use, NULL for the defaults
+ * @return          the total amount of blocks, -1 if there was an error
+ */
+long mdu_du(const char *restrict path, const mdu_options_t *restrict opts);
+
+/**
+ * @brief Scan PATH with NR_PROCS processes of their own pool of
+ * mdu_options_t.nr_threads threads each, and wait for the result. The
+ * processes share a queue of directories in shared memory and their totals
+ * are added up once they are done, so the result is that of mdu_du(). Has the
+ * limits of mdu_options_t.checkpoints, and POOL, STATS, MAX_IOPS, EXCEEDS and
+ * the callbacks are not used. Must be called before the calling process starts
+ * any thread
+ *
+ * @param path      the file or directory to scan
+ * @param opts      the options to use
+ * @param nr_procs  the amount of processes to fork, at least 1
+ * @param summary   set to the summary with mdu_options_t.summary, may be NULL
+ * @return          the total amount of blocks, -1 if there was an error
+ */
+long mdu_du_procs(const char *restrict path, const mdu_options_t *restrict opts,
+                  const int nr_procs, mdu_summary_t *restrict summary);
+
+/**
+ * @brief Find out if the tree at PATH uses more than LIMIT blocks, or inodes
+ * with mdu_options_t.inodes. The scan stops as soon as the blocks counted
+ * pass LIMIT, so a tree over it returns early
+ *
+ * @param path      the file or directory to scan
+ * @param limit     the most blocks allowed, more than 0
+ * @param opts      the options to use, NULL for the defaults
+ * @return          1 if the tree exceeds LIMIT, 0 if not and -1 if there was
+ * an error
+ */
+int mdu_exceeds(const char *restrict path, const long limit,
+                const mdu_options_t *restrict opts);
+
+#endif // !__MDU_SCAN_COMPETITION_H
@@ -0,0 +1,72 @@
+/**
+ * This module implements a bounded lock-free queue for any amount of
+ * producers and consumers. It is a ring of cells where every cell carries a
+ * sequence number telling if it is ready to be written or read, so a push and
+ * a pop only contend on a single counter each.
+ *
+ * @file queue_competition.h
+ * @author Elias Svensson (c24esn@cs.umu.se)
+ * @date 2025-11-07
+ */
+
+#ifndef __QUEUE_COMPETITION_H
+#define __QUEUE_COMPETITION_H
+
+#include <stdbool.h>
+
+// --------------- Structs -------------------------------------------------- //
+
+/**
+ * @typedef queue_t
+ * @brief a bounded FIFO queue of pointers
+ *
+ */
+typedef struct queue_t queue_t;
+
+// --------------- Declaration of external functions ------------------------ //
+
+/**
+ * @brief Allocate an empty queue. The memory allocated needs to be freed by
+ * calling queue_destroy()
+ *
+ * @param capacity  the most values the queue holds, rounded up to a power of 2
+ * @return          a pointer to a struct of type queue_t
+ */
+queue_t *queue_create(const long capacity);
+
+/**
+ * @brief Deallocate a queue. Values left in it are not freed
+ *
+ * @param queue     a pointer to a struct of type queue_t
+ */
+void queue_destroy(queue_t *queue);
+
+/**
+ * @brief Add VAL at the tail of a queue
+ *
+ * @param queue     a pointer to a struct of type queue_t
+ * @param val       the value to add, not NULL
+ * @return          true if it was added, false if the queue was full
+ */
+bool queue_push(queue_t *restrict queue, void *restrict val);
+
+/**
+ * @brief Take the value at the head of a queue. A push that has not returned
+ * yet may hide the values behind it, so NULL only means that the queue was
+ * empty if no push is running
+ *
+ * @param queue     a pointer to a struct of type queue_t
+ * @return          the value, NULL if there was none
+ */
+void *queue_pop(queue_t *queue);
+
+/**
+ * @brief Get the amount of values in a queue. Only a snapshot while other
+ * threads push and pop
+ *
+ * @param queue     a pointer to a struct of type queue_t
+ * @return          the amount of values, pushes in progress included
+ */
+long queue_size(const queue_t *queue);
+
+#endif // !__QUEUE_COMPETITION_H
@@ -0,0 +1,76 @@
+/**
+ * This module implements a token bucket shared by many threads, used to cap
+ * the metadata operations per second of a scan. Threads take tokens in
+ * batches and spend them on their own, so the shared state is touched once
+ * per batch and not once per operation.
+ *
+ * The bucket can also back off on its own when the pressure stall information
+ * of the kernel (/proc/pressure/io) shows that tasks are waiting for I/O. The
+ * rate is then lowered, down to a fraction of the cap, and raised again when
+ * the pressure is gone.
+ *
+ * @file ratelimit_competition.h
+ * @author Elias Svensson (c24esn@cs.umu.se)
+ * @date 2025-11-11
+ */
+
+#ifndef __RATELIMIT_COMPETITION_H
+#define __RATELIMIT_COMPETITION_H
+
+#include <stdbool.h>
+
+// --------------- Structs -------------------------------------------------- //
+
+/**
+ * @typedef ratelimit_t
+ * @brief a token bucket
+ *
+ */
+typedef struct ratelimit_t ratelimit_t;
+
+// --------------- Declaration of external functions ------------------------ //
+
+/**
+ * @brief Allocate a bucket. The memory allocated needs to be freed by calling
+ * ratelimit_destroy()
+ *
+ * @param rate      the most tokens to hand out per second
+ * @param backoff   lower the rate while there is I/O pressure
+ * @return          a pointer to a struct of type ratelimit_t
+ */
+ratelimit_t *ratelimit_create(const long rate, const bool backoff);
+
+/**
+ * @brief Deallocate a bucket
+ *
+ * @param rl        a pointer to a struct of type ratelimit_t
+ */
+void ratelimit_destroy(ratelimit_t *rl);
+
+/**
+ * @brief Get the amount of tokens a thread should take at a time. Large
+ * enough to keep the bucket cold, small enough that the threads holding
+ * tokens do not make a burst
+ *
+ * @param rl        a pointer to a struct of type ratelimit_t
+ * @return          the amount of tokens
+ */
+long ratelimit_batch(const ratelimit_t *rl);
+
+/**
+ * @brief Take N tokens, sleeping until the bucket has them
+ *
+ * @param rl        a pointer to a struct of type ratelimit_t
+ * @param n         the amount of tokens
+ */
+void ratelimit_take(ratelimit_t *rl, const long n);
+
+/**
+ * @brief Get the rate the bucket hands out tokens at right now
+ *
+ * @param rl        a pointer to a struct of type ratelimit_t
+ * @return          the tokens per second
+ */
+long ratelimit_rate(const ratelimit_t *rl);
+
+#endif // !__RATELIMIT_COMPETITION_H
@@ -0,0 +1,57 @@
+/**
+ * This module implements a local query server for mdu. Clients connect to a
+ * unix socket and write one path per line. For each line the server answers
+ * with "BLOCKS\tPATH\n", or "error\tPATH\n" if the path can not be scanned.
+ * Answers may come in another order than the questions.
+ *
+ * Scans run on one warm pool. Results are cached for a while, requests for a
+ * path which is already being scanned wait for that scan, and requests for a
+ * directory inside a running scan are answered by it as soon as that subtree
+ * is counted. Clients take turns to start new scans so that a client asking
+ * for a huge tree does not hold back the others.
+ *
+ * @file server_competition.h
+ * @author Elias Svensson (c24esn@cs.umu.se)
+ * @date 2025-11-03
+ */
+
+#ifndef __SERVER_COMPETITION_H
+#define __SERVER_COMPETITION_H
+
+#include "thread_pool_competition.h"
+
+// --------------- Structs -------------------------------------------------- //
+
+/**
+ * @typedef server_options_t
+ * @brief options of the server
+ *
+ */
+typedef struct server_options_t {
+  tpool_t *pool;      /* A pool from mdu_pool_create() to run scans on */
+  int ttl;            /* Seconds a result is served from the cache */
+  int max_active;     /* Max scans running at once */
+  int max_per_client; /* Max scans started for one client at once */
+} server_options_t;
+
+// --------------- Declaration of external functions ------------------------ //
+
+/**
+ * @brief Set every option to its default. POOL is left NULL and has to be set
+ *
+ * @param opts      the options to initialize
+ */
+void server_options_init(server_options_t *opts);
+
+/**
+ * @brief Serve queries on a unix socket at SOCKET_PATH until SIGINT or
+ * SIGTERM is received. An old socket file at the path is replaced
+ *
+ * @param socket_path   the path to bind the socket to
+ * @param opts          the options to use
+ * @return              0 on a clean shutdown, -1 if the server could not start
+ */
+int mdu_serve(const char *restrict socket_path,
+              const server_options_t *restrict opts);
+
+#endif // !__SERVER_COMPETITION_H
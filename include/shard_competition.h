@@ -0,0 +1,114 @@
+/**
+ * This module holds the state shared by the processes of a sharded scan, see
+ * mdu_du_procs(): a queue of directories any process may count and a slot of
+ * results per process. It lives in one shared anonymous mapping, created
+ * before the processes are forked, and is guarded by a process shared mutex.
+ *
+ * Directories only move through the queue while processes wait for work, so
+ * it stays short and a process keeps most of its subtree to itself. A scan is
+ * done when no directory is queued and no process is counting one it took,
+ * which PENDING tracks.
+ *
+ * @file shard_competition.h
+ * @author Elias Svensson (c24esn@cs.umu.se)
+ * @date 2025-11-18
+ */
+
+#ifndef __SHARD_COMPETITION_H
+#define __SHARD_COMPETITION_H
+
+#include "checkpoint_competition.h"
+#include <stdbool.h>
+
+// --------------- Constants ------------------------------------------------ //
+
+#define SHARD_MAX_COUNTERS 128 /* Longs of other results, an mdu_summary_t */
+
+// --------------- Structs -------------------------------------------------- //
+
+/**
+ * @typedef shard_result_t
+ * @brief what one process counted, written by it alone
+ *
+ */
+typedef struct shard_result_t {
+  _Alignas(64) long blocks; /* Blocks, or inodes */
+  long counters[SHARD_MAX_COUNTERS]; /* Other results, in an order picked by
+                                      * the scan */
+} shard_result_t;
+
+/**
+ * @typedef shard_t
+ * @brief the queue and results of a sharded scan
+ *
+ */
+typedef struct shard_t shard_t;
+
+// --------------- Declaration of external functions ------------------------ //
+
+/**
+ * @brief Map the shared state for NR_PROCS processes. The first directory is
+ * taken to be pending from the start, the process counting the root hands it
+ * back with shard_done(). Needs to be freed by calling shard_destroy() once
+ * every process is done
+ *
+ * @param nr_procs  the processes which will share it
+ * @return          a pointer to a struct of type shard_t, NULL on error
+ */
+shard_t *shard_create(const int nr_procs);
+
+/**
+ * @brief Unmap the shared state
+ *
+ * @param shard     a pointer to a struct of type shard_t, may be NULL
+ */
+void shard_destroy(shard_t *shard);
+
+/**
+ * @brief Find out if another process is waiting for a directory. Reads two
+ * counters without the lock, so it is cheap enough for every directory
+ *
+ * @param shard     a pointer to a struct of type shard_t
+ * @return          true if a directory queued now would be taken
+ */
+bool shard_hungry(const shard_t *shard);
+
+/**
+ * @brief Queue a directory for any process to count. The caller is done with
+ * it once this succeeds
+ *
+ * @param shard     a pointer to a struct of type shard_t
+ * @param path      the path of the directory
+ * @return          true if it was queued, false if the queue is full
+ */
+bool shard_push(shard_t *restrict shard, const char *restrict path);
+
+/**
+ * @brief Take a share of the directories queued, waiting until there are some
+ * or the scan is done
+ *
+ * @param shard     a pointer to a struct of type shard_t
+ * @param cp        the directories taken are added to it
+ * @return          the amount taken, 0 once the scan is done
+ */
+long shard_take(shard_t *restrict shard, checkpoint_t *restrict cp);
+
+/**
+ * @brief Hand back directories taken, once they and everything below them
+ * are counted or queued
+ *
+ * @param shard     a pointer to a struct of type shard_t
+ * @param n         the amount of directories
+ */
+void shard_done(shard_t *shard, const long n);
+
+/**
+ * @brief Get the results of a process
+ *
+ * @param shard     a pointer to a struct of type shard_t
+ * @param id        the process, in [0, NR_PROCS)
+ * @return          a pointer to a struct of type shard_result_t
+ */
+shard_result_t *shard_result(shard_t *shard, const int id);
+
+#endif // !__SHARD_COMPETITION_H
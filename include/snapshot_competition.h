@@ -0,0 +1,157 @@
+/**
+ * This module stores the per directory results of scans in a compact binary
+ * file, a snapshot, and compares two snapshots. A snapshot is used directly
+ * from a read-only mapping of the file, nothing is parsed when it is opened.
+ *
+ * The file starts with a header followed by the columns of a directory table.
+ * Directories are sorted in depth first order (a path sorts before every path
+ * below it) and the columns are the blocks of each subtree, the index of each
+ * parent and the paths. Paths are front coded: every path is stored as the
+ * length of the prefix it shares with the path before it and the rest of it.
+ * Every SNAPSHOT_RESTART paths are stored whole, which makes it possible to
+ * start decoding, or binary search, at those points. Numbers use the byte
+ * order of the machine which wrote the file.
+ *
+ * @file snapshot_competition.h
+ * @author Elias Svensson (c24esn@cs.umu.se)
+ * @date 2025-11-09
+ */
+
+#ifndef __SNAPSHOT_COMPETITION_H
+#define __SNAPSHOT_COMPETITION_H
+
+#include "heap_competition.h"
+#include <stddef.h>
+
+// --------------- Constants ------------------------------------------------ //
+
+#define SNAPSHOT_RESTART 64 /* Paths between two whole paths */
+#define SNAPSHOT_NO_PARENT -1
+
+// --------------- Structs -------------------------------------------------- //
+
+/**
+ * @typedef snapshot_builder_t
+ * @brief directories gathered in any order, to be written as a snapshot
+ *
+ */
+typedef struct snapshot_builder_t snapshot_builder_t;
+
+/**
+ * @typedef snapshot_t
+ * @brief an open snapshot file
+ *
+ */
+typedef struct snapshot_t snapshot_t;
+
+// --------------- Declaration of external functions ------------------------ //
+
+/**
+ * @brief Allocate an empty builder. The memory allocated needs to be freed by
+ * calling snapshot_builder_destroy()
+ *
+ * @return          a pointer to a struct of type snapshot_builder_t
+ */
+snapshot_builder_t *snapshot_builder_create(void);
+
+/**
+ * @brief Add a directory to a builder. The builder takes ownership of PATH
+ *
+ * @param builder   a pointer to a struct of type snapshot_builder_t
+ * @param path      a heap allocated path of a directory
+ * @param blocks    the blocks used by the subtree of the directory
+ */
+void snapshot_builder_add(snapshot_builder_t *restrict builder,
+                          char *restrict path, const long blocks);
+
+/**
+ * @brief Write every directory added to a builder as a snapshot. The file is
+ * replaced atomically
+ *
+ * @param builder   a pointer to a struct of type snapshot_builder_t
+ * @param file      the file to write
+ * @return          0 on success, -1 on error
+ */
+int snapshot_builder_write(snapshot_builder_t *restrict builder,
+                           const char *restrict file);
+
+/**
+ * @brief Deallocate a builder and the paths added to it
+ *
+ * @param builder   a pointer to a struct of type snapshot_builder_t
+ */
+void snapshot_builder_destroy(snapshot_builder_t *builder);
+
+/**
+ * @brief Map a snapshot file. Needs to be closed by calling snapshot_close()
+ *
+ * @param file      the file to open
+ * @return          a pointer to a struct of type snapshot_t. NULL if the file
+ * could not be read, is not a snapshot or is damaged
+ */
+snapshot_t *snapshot_open(const char *file);
+
+/**
+ * @brief Unmap a snapshot
+ *
+ * @param snap      a pointer to a struct of type snapshot_t
+ */
+void snapshot_close(snapshot_t *snap);
+
+/**
+ * @brief Get the amount of directories in a snapshot
+ *
+ * @param snap      a pointer to a struct of type snapshot_t
+ * @return          the amount of directories
+ */
+long snapshot_len(const snapshot_t *snap);
+
+/**
+ * @brief Get the blocks used by the subtree of directory I
+ *
+ * @param snap      a pointer to a struct of type snapshot_t
+ * @param i         the index of the directory
+ * @return          the amount of blocks
+ */
+long snapshot_blocks(const snapshot_t *snap, const long i);
+
+/**
+ * @brief Get the parent of directory I
+ *
+ * @param snap      a pointer to a struct of type snapshot_t
+ * @param i         the index of the directory
+ * @return          the index of the parent, SNAPSHOT_NO_PARENT for a root
+ */
+long snapshot_parent(const snapshot_t *snap, const long i);
+
+/**
+ * @brief Decode the path of directory I. Costs at most SNAPSHOT_RESTART steps
+ *
+ * @param snap      a pointer to a struct of type snapshot_t
+ * @param i         the index of the directory
+ * @param buf       a heap allocated buffer or NULL, grown when needed
+ * @param cap       the size of BUF, updated when it is grown
+ * @return          the length of the path written to BUF (null-terminated)
+ */
+size_t snapshot_path(const snapshot_t *restrict snap, const long i,
+                     char **restrict buf, size_t *restrict cap);
+
+/**
+ * @brief Compare two snapshots. Every directory found in either is compared
+ * by its blocks, a directory missing from one snapshot counts as 0 blocks
+ * there. The work is split over NR_THREADS threads
+ *
+ * @param a             the older snapshot
+ * @param b             the newer snapshot
+ * @param nr_threads    the amount of threads to use
+ * @param top_n         the capacity of GREW and SHRANK
+ * @param grew          filled with the directories which grew the most, keys
+ * are the blocks added
+ * @param shrank        filled with the directories which shrank the most,
+ * keys are the blocks removed
+ */
+void snapshot_diff(const snapshot_t *a, const snapshot_t *b,
+                   const short nr_threads, const int top_n, heap_t *grew,
+                   heap_t *shrank);
+
+#endif // !__SNAPSHOT_COMPETITION_H
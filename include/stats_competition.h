@@ -0,0 +1,142 @@
+/**
+ * This module publishes the live counters of a process running scans in a
+ * POSIX shared memory segment (/dev/shm/NAME), so that other processes can
+ * watch it without attaching to it. The segment is laid out as:
+ *
+ *   stats_t                           the header, padded to 64 bytes
+ *   tpool_counters_t[nr_workers + 1]  the pool, see tpool_set_counters()
+ *   stats_thread_t[nr_threads]        the counting threads of the scans
+ *
+ * Every counter is a single 64 bit word written by one thread, and readers
+ * load them without any lock. A reader sees each counter at some moment, not
+ * all of them at the same one. The layout changes with STATS_VERSION.
+ *
+ * @file stats_competition.h
+ * @author Elias Svensson (c24esn@cs.umu.se)
+ * @date 2025-11-14
+ */
+
+#ifndef __STATS_COMPETITION_H
+#define __STATS_COMPETITION_H
+
+#include "thread_pool_competition.h"
+#include <stdatomic.h>
+#include <stdint.h>
+
+// --------------- Constants ------------------------------------------------ //
+
+#define STATS_MAGIC 0x74617473756d64ULL /* "mdustat" */
+#define STATS_VERSION 1
+#define STATS_NAME_MAX 256 /* Longest name of a segment, including '\0' */
+
+// --------------- Structs -------------------------------------------------- //
+
+/**
+ * @typedef stats_phase_t
+ * @brief what the writer of a segment is doing
+ *
+ */
+typedef enum stats_phase_t {
+  STATS_STARTING, /* No scan started yet */
+  STATS_SCANNING, /* A scan is running */
+  STATS_MERGING,  /* A scan is done and its results are merged */
+  STATS_IDLE,     /* Every scan started is done */
+  STATS_EXITED    /* The writer destroyed the segment */
+} stats_phase_t;
+
+/**
+ * @typedef stats_thread_t
+ * @brief counters of a thread counting entries: a worker of the pool or a
+ * stat thread. Added to once per directory, or per batch with stat threads
+ *
+ */
+typedef struct stats_thread_t {
+  _Alignas(64) atomic_long entries; /* Entries counted */
+  atomic_long blocks; /* Blocks counted, see stats_t.block_size */
+} stats_thread_t;
+
+/**
+ * @typedef stats_t
+ * @brief the header of a segment
+ *
+ */
+typedef struct stats_t {
+  atomic_ullong magic;     /* STATS_MAGIC once the segment is ready */
+  uint32_t version;        /* STATS_VERSION of the writer */
+  uint32_t size;           /* Bytes of the segment */
+  int32_t pid;             /* Process of the writer */
+  int16_t nr_workers;      /* Workers of the pool */
+  int16_t nr_threads;      /* Counting threads: workers, then stat threads */
+  int64_t started;         /* CLOCK_MONOTONIC in ns at stats_create() */
+  atomic_int phase;        /* A stats_phase_t */
+  atomic_int block_size;   /* Bytes per block, 0 while inodes are counted */
+  atomic_long scans;       /* Scans started */
+  atomic_long scans_done;  /* Scans waited for */
+  char name[STATS_NAME_MAX];
+} stats_t;
+
+// --------------- Declaration of external functions ------------------------ //
+
+/**
+ * @brief Create the segment NAME, replacing any old one. The memory allocated
+ * needs to be freed by calling stats_destroy(), which also removes it
+ *
+ * @param name          the name of the segment, with or without a leading '/'
+ * @param nr_workers    the workers of the pool
+ * @param nr_threads    the counting threads, at least NR_WORKERS
+ * @return              a pointer to the header, NULL on error with errno set
+ */
+stats_t *stats_create(const char *name, const short nr_workers,
+                      const short nr_threads);
+
+/**
+ * @brief Map the segment NAME of another process to read it. Needs to be
+ * unmapped by calling stats_close()
+ *
+ * @param name      the name of the segment, with or without a leading '/'
+ * @return          a pointer to the header, NULL on error with errno set.
+ * errno is EPROTO for a segment which is not ready or of another version
+ */
+const stats_t *stats_open(const char *name);
+
+/**
+ * @brief Mark a segment from stats_create() as exited, remove it and unmap it.
+ * Readers which have it mapped keep their mapping
+ *
+ * @param stats     a pointer to the header, may be NULL
+ */
+void stats_destroy(stats_t *stats);
+
+/**
+ * @brief Unmap a segment from stats_open()
+ *
+ * @param stats     a pointer to the header, may be NULL
+ */
+void stats_close(const stats_t *stats);
+
+/**
+ * @brief Get the counters of the pool, for tpool_set_counters()
+ *
+ * @param stats     a pointer to the header
+ * @return          nr_workers + 1 counters
+ */
+tpool_counters_t *stats_pool(const stats_t *stats);
+
+/**
+ * @brief Get the counters of a counting thread
+ *
+ * @param stats     a pointer to the header
+ * @param i         the thread, in [0, nr_threads)
+ * @return          a pointer to a struct of type stats_thread_t
+ */
+stats_thread_t *stats_thread(const stats_t *stats, const short i);
+
+/**
+ * @brief Get the name of a phase
+ *
+ * @param phase     a stats_phase_t
+ * @return          a static string
+ */
+const char *stats_phase_name(const int phase);
+
+#endif // !__STATS_COMPETITION_H
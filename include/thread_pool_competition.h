@@ -13,9 +13,42 @@
 #define __THREAD_POOL_H
 
 #include <pthread.h>
+#include <stdatomic.h>
+
+// --------------- Constants ------------------------------------------------ //
+
+#define TPOOL_PRIO_LEVELS 4 /* Priorities in [0, TPOOL_PRIO_LEVELS) */
 
 // --------------- Structs -------------------------------------------------- //
 
+/**
+ * @typedef tpool_schedule_t
+ * @brief the order jobs added by workers are run in
+ *
+ */
+typedef enum tpool_schedule_t {
+  TPOOL_LIFO,  /* Own stack of each worker, depth first. Few jobs queued */
+  TPOOL_FIFO,  /* One shared ring, breadth first. Many jobs soon */
+  TPOOL_HYBRID /* The ring until every worker has jobs, then the stacks */
+} tpool_schedule_t;
+
+/**
+ * @typedef tpool_counters_t
+ * @brief counters of a worker, see tpool_set_counters(). Only written by the
+ * worker itself and readable at any time. The jobs queued in a pool are the
+ * jobs added minus the jobs taken, over every worker and the outside
+ *
+ */
+typedef struct tpool_counters_t {
+  _Alignas(64) atomic_long jobs; /* Jobs taken and run */
+  atomic_long added;             /* Jobs added */
+  atomic_long steals;            /* Jobs taken from another worker */
+  atomic_long idle_ns;           /* Time spent waiting for a job */
+  /* CLOCK_MONOTONIC in ns when the current wait for a job began, 0 while the
+   * worker runs a job */
+  atomic_long idle_since;
+} tpool_counters_t;
+
 /**
  * @typedef tpool_t
  * @brief a pool of threads. Will complete all work added though
@@ -36,6 +69,20 @@ typedef struct tpool_t tpool_t;
  */
 tpool_t *tpool_create(const short nr_threads, void *(*func)(void *));
 
+/**
+ * @brief Like tpool_create(), but with a schedule other than TPOOL_LIFO. The
+ * ring of TPOOL_FIFO and TPOOL_HYBRID is bounded, jobs which do not fit in it
+ * go to the stacks
+ *
+ * @param nr_threads      the amount of threads to start
+ * @param func            the function to call for every job
+ * @param schedule        the order to run jobs in
+ * @return                a pointer to a struct of type tpool_t. Null if there
+ * was an error
+ */
+tpool_t *tpool_create_schedule(const short nr_threads, void *(*func)(void *),
+                               const tpool_schedule_t schedule);
+
 /**
  * @brief Deallocate all memory for a thread pool.
  *
@@ -53,6 +100,18 @@ void tpool_destroy(tpool_t *pool);
  */
 void tpool_add_work(tpool_t *restrict pool, void *restrict arg);
 
+/**
+ * @brief Add work with a priority. Jobs with a higher priority are run before
+ * jobs with a lower one, and idle threads steal them first. Priority 0 is the
+ * same as tpool_add_work(), larger values are clamped to the highest level
+ *
+ * @param pool      a pointer to a struct of type tpool_t
+ * @param arg       a pointer to a argument
+ * @param prio      the priority, in [0, TPOOL_PRIO_LEVELS)
+ */
+void tpool_add_work_prio(tpool_t *restrict pool, void *restrict arg,
+                         const short prio);
+
 /**
  * @brief Wait for all work inside a thread pool to complete
  *
@@ -60,4 +119,34 @@ void tpool_add_work(tpool_t *restrict pool, void *restrict arg);
  */
 void tpool_wait(tpool_t *pool);
 
+/**
+ * @brief Get the amount of worker threads in a pool
+ *
+ * @param pool       a pointer to a struct of type tpool_t
+ * @return           the amount of threads started by tpool_create()
+ */
+short tpool_nr_threads(const tpool_t *pool);
+
+/**
+ * @brief Move the counters of a pool to COUNTERS, e.g. memory shared with
+ * another process. Entry i is written by worker i, and entry
+ * tpool_nr_threads() counts the jobs added from outside the pool. The counts
+ * so far are carried over. Must be called while no jobs are added, and
+ * COUNTERS has to outlive the pool or a later call
+ *
+ * @param pool       a pointer to a struct of type tpool_t
+ * @param counters   tpool_nr_threads() + 1 counters
+ */
+void tpool_set_counters(tpool_t *restrict pool,
+                        tpool_counters_t *restrict counters);
+
+/**
+ * @brief Get the id of the calling worker thread. Ids are in the range
+ * [0, tpool_nr_threads()) and can be used to index per thread data
+ *
+ * @return           the id of the calling worker. -1 if the caller is not a
+ * worker thread
+ */
+short tpool_worker_id(void);
+
 #endif // !__THREAD_POOL_H
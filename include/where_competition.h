@@ -0,0 +1,89 @@
+/**
+ * This module compiles find-style predicates on the stat of an entry, for
+ * mdu_options_t.where. An expression is a list of terms, separated by spaces
+ * or commas, which all have to hold. "or" between two lists matches an entry
+ * which matches either. A term is FIELD OP VALUE without spaces, optionally
+ * negated with a leading '!':
+ *
+ *   size   <, <=, =, !=, >=, >   bytes, with a K, M, G or T suffix
+ *   mtime  <, <=, =, !=, >=, >   age with s, m, h, d, w or y, days if none
+ *   atime  <, <=, =, !=, >=, >   like mtime
+ *   uid    =, !=                 a number or a user name
+ *   gid    =, !=                 a number or a group name
+ *   type   =, !=                 f, d, l, p, s, c or b as for find -type
+ *
+ * so "type=f size>1G mtime>90d" matches the files over a gigabyte which
+ * were not modified in 90 days. The expression is compiled once into a flat
+ * array of tests, and an entry runs through them without any call.
+ *
+ * A where_t is never changed after where_compile(), so any amount of threads
+ * may match entries with it at once.
+ *
+ * @file where_competition.h
+ * @author Elias Svensson (c24esn@cs.umu.se)
+ * @date 2025-11-16
+ */
+
+#ifndef __WHERE_COMPETITION_H
+#define __WHERE_COMPETITION_H
+
+#include <stdbool.h>
+#include <sys/stat.h>
+#include <time.h>
+
+// --------------- Structs -------------------------------------------------- //
+
+/**
+ * @typedef where_t
+ * @brief a compiled expression
+ *
+ */
+typedef struct where_t where_t;
+
+// --------------- Declaration of external functions ------------------------ //
+
+/**
+ * @brief Compile an expression. The memory allocated needs to be freed by
+ * calling where_destroy()
+ *
+ * @param expr      the expression
+ * @param now       the time ages are taken at
+ * @return          a pointer to a struct of type where_t, NULL if EXPR is not
+ * valid
+ */
+where_t *where_compile(const char *expr, const time_t now);
+
+/**
+ * @brief Deallocate a compiled expression
+ *
+ * @param where     a pointer to a struct of type where_t, may be NULL
+ */
+void where_destroy(where_t *where);
+
+/**
+ * @brief Match the stat of an entry against an expression
+ *
+ * @param where     a pointer to a struct of type where_t
+ * @param st        the result of lstat on the entry
+ * @return          true if the entry matches
+ */
+bool where_match(const where_t *restrict where,
+                 const struct stat *restrict st);
+
+/**
+ * @brief Get the expression a where_t was compiled from
+ *
+ * @param where     a pointer to a struct of type where_t
+ * @return          the expression, owned by WHERE
+ */
+const char *where_expr(const where_t *where);
+
+/**
+ * @brief Get the time the ages of a where_t are taken at
+ *
+ * @param where     a pointer to a struct of type where_t
+ * @return          NOW of where_compile()
+ */
+time_t where_now(const where_t *where);
+
+#endif // !__WHERE_COMPETITION_H
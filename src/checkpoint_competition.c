@@ -0,0 +1,288 @@
+/**
+ * This module implements the checkpoints of a scan, see
+ * checkpoint_competition.h. A file looks like
+ *
+ *   mdu-checkpoint 1
+ *   now 1763337600
+ *   flags 2
+ *   blocks 8031008
+ *   entries 83955
+ *   counters 68 C0 C1 ...
+ *   root LEN
+ *   ROOT
+ *   where LEN
+ *   WHERE
+ *   dirs NR_DIRS DIRS_LEN
+ *   DIRS
+ *
+ * where LEN is the length of the string on the next line, 0 for none.
+ *
+ * @file checkpoint_competition.c
+ * @author Elias Svensson (c24esn@cs.umu.se)
+ * @date 2025-11-17
+ */
+
+// --------------- Headers -------------------------------------------------- //
+
+#include "checkpoint_competition.h"
+#include <fcntl.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// --------------- Constants ------------------------------------------------ //
+
+#define MAGIC "mdu-checkpoint"
+#define DEFAULT_DIRS_CAP 4096
+#define MAX_COUNTERS 1024 /* More in a file means it is not a checkpoint */
+
+// --------------- Declaration of internal functions ------------------------ //
+
+/**
+ * @brief Read a "NAME VALUE" line
+ *
+ * @param fp        the file
+ * @param name      the name the line must have
+ * @param val       set to the value
+ * @return          0 on success, -1 if the line is not there
+ */
+static int read_field(FILE *restrict fp, const char *restrict name,
+                      long *restrict val);
+
+/**
+ * @brief Read a string written by write_string()
+ *
+ * @param fp        the file
+ * @param name      the name of the field
+ * @param str       set to the string, NULL for none. Needs to be freed
+ * @return          0 on success, -1 if the string is not there
+ */
+static int read_string(FILE *restrict fp, const char *restrict name,
+                       char **restrict str);
+
+/**
+ * @brief Write a "NAME LEN" line followed by the string and a newline
+ *
+ * @param fp        the file
+ * @param name      the name of the field
+ * @param str       the string, NULL for none
+ */
+static void write_string(FILE *restrict fp, const char *restrict name,
+                         const char *restrict str);
+
+/**
+ * @brief Sync the directory holding FILE, so that a rename into it is on disk
+ *
+ * @param file      a file in the directory
+ * @return          0 on success, -1 on error
+ */
+static int sync_parent(const char *file);
+
+// --------------- Definition of external functions ------------------------- //
+
+checkpoint_t *checkpoint_create(const char *root, const int nr_counters) {
+  checkpoint_t *cp = calloc(1, sizeof(checkpoint_t));
+
+  cp->root = strdup(root);
+  cp->nr_counters = nr_counters;
+  cp->counters = calloc(nr_counters + 1, sizeof(long));
+  cp->dirs_cap = DEFAULT_DIRS_CAP;
+  cp->dirs = malloc(cp->dirs_cap);
+
+  return cp;
+}
+
+checkpoint_t *checkpoint_load(const char *file) {
+  FILE *fp = fopen(file, "r");
+  if (!fp) {
+    return NULL;
+  }
+
+  checkpoint_t *cp = NULL;
+  char *root = NULL;
+  long version, now, flags, blocks, entries, nr_counters, nr_dirs, dirs_len;
+
+  if (read_field(fp, MAGIC, &version) || version != CHECKPOINT_VERSION ||
+      read_field(fp, "now", &now) || read_field(fp, "flags", &flags) ||
+      read_field(fp, "blocks", &blocks) ||
+      read_field(fp, "entries", &entries) ||
+      read_field(fp, "counters", &nr_counters) || nr_counters < 0 ||
+      nr_counters > MAX_COUNTERS) {
+    fclose(fp);
+    return NULL;
+  }
+
+  long counters[MAX_COUNTERS];
+  for (long i = 0; i < nr_counters; i++) {
+    if (fscanf(fp, "%ld", &counters[i]) != 1) {
+      fclose(fp);
+      return NULL;
+    }
+  }
+
+  if (read_string(fp, "root", &root) || !root) {
+    free(root);
+    fclose(fp);
+    return NULL;
+  }
+
+  cp = checkpoint_create(root, nr_counters);
+  free(root);
+  cp->now = now;
+  cp->flags = flags;
+  cp->blocks = blocks;
+  cp->entries = entries;
+  memcpy(cp->counters, counters, nr_counters * sizeof(long));
+
+  if (read_string(fp, "where", &cp->where) ||
+      fscanf(fp, " dirs %ld %ld", &nr_dirs, &dirs_len) != 2 ||
+      nr_dirs < 0 || dirs_len < 0 || fgetc(fp) != '\n') {
+    checkpoint_destroy(cp);
+    fclose(fp);
+    return NULL;
+  }
+
+  free(cp->dirs);
+  cp->dirs_cap = dirs_len + 1;
+  cp->dirs = malloc(cp->dirs_cap);
+  cp->dirs_len = fread(cp->dirs, 1, dirs_len, fp);
+  cp->nr_dirs = nr_dirs;
+  fclose(fp);
+
+  // a file cut short would lose directories, and their blocks with them
+  long found = 0;
+  for (size_t i = 0; i < cp->dirs_len; i++) {
+    found += cp->dirs[i] == '\0';
+  }
+  if (cp->dirs_len != (size_t)dirs_len || found != nr_dirs) {
+    checkpoint_destroy(cp);
+    return NULL;
+  }
+
+  return cp;
+}
+
+int checkpoint_save(const checkpoint_t *restrict cp,
+                    const char *restrict file) {
+  const size_t len = strlen(file);
+  char *tmp = malloc(len + 5);
+  memcpy(tmp, file, len);
+  memcpy(tmp + len, ".tmp", 5);
+
+  FILE *fp = fopen(tmp, "w");
+  if (!fp) {
+    free(tmp);
+    return -1;
+  }
+
+  fprintf(fp, "%s %d\nnow %ld\nflags %u\nblocks %ld\nentries %ld\n", MAGIC,
+          CHECKPOINT_VERSION, (long)cp->now, cp->flags, cp->blocks,
+          cp->entries);
+  fprintf(fp, "counters %d", cp->nr_counters);
+  for (int i = 0; i < cp->nr_counters; i++) {
+    fprintf(fp, " %ld", cp->counters[i]);
+  }
+  fputc('\n', fp);
+
+  write_string(fp, "root", cp->root);
+  write_string(fp, "where", cp->where);
+  fprintf(fp, "dirs %ld %zu\n", cp->nr_dirs, cp->dirs_len);
+  fwrite(cp->dirs, 1, cp->dirs_len, fp);
+
+  // on disk before the rename, or a crash could leave an empty file
+  int ret = fflush(fp) || fsync(fileno(fp)) ? -1 : 0;
+  ret = fclose(fp) || ret ? -1 : rename(tmp, file);
+  if (!ret) {
+    ret = sync_parent(file);
+  }
+  free(tmp);
+
+  return ret;
+}
+
+void checkpoint_destroy(checkpoint_t *cp) {
+  if (!cp) {
+    return;
+  }
+
+  free(cp->root);
+  free(cp->where);
+  free(cp->counters);
+  free(cp->dirs);
+  free(cp);
+}
+
+void checkpoint_add_dir(checkpoint_t *restrict cp, const char *restrict path) {
+  const size_t len = strlen(path) + 1;
+
+  if (cp->dirs_len + len > cp->dirs_cap) {
+    while (cp->dirs_len + len > cp->dirs_cap) {
+      cp->dirs_cap *= 2;
+    }
+    cp->dirs = realloc(cp->dirs, cp->dirs_cap);
+  }
+
+  memcpy(cp->dirs + cp->dirs_len, path, len);
+  cp->dirs_len += len;
+  cp->nr_dirs++;
+}
+
+// --------------- Definition of internal functions ------------------------- //
+
+static int read_field(FILE *restrict fp, const char *restrict name,
+                      long *restrict val) {
+  char key[32];
+
+  return fscanf(fp, " %31s %ld", key, val) == 2 && !strcmp(key, name) ? 0
+                                                                      : -1;
+}
+
+static int read_string(FILE *restrict fp, const char *restrict name,
+                       char **restrict str) {
+  long len;
+  *str = NULL;
+
+  if (read_field(fp, name, &len) || len < 0 || fgetc(fp) != '\n') {
+    return -1;
+  }
+  if (len == 0) {
+    return 0;
+  }
+
+  *str = malloc(len + 1);
+  if (fread(*str, 1, len, fp) != (size_t)len || fgetc(fp) != '\n') {
+    free(*str);
+    *str = NULL;
+    return -1;
+  }
+  (*str)[len] = '\0';
+
+  return 0;
+}
+
+static void write_string(FILE *restrict fp, const char *restrict name,
+                         const char *restrict str) {
+  const size_t len = str ? strlen(str) : 0;
+
+  fprintf(fp, "%s %zu\n", name, len);
+  if (len) {
+    fwrite(str, 1, len, fp);
+    fputc('\n', fp);
+  }
+}
+
+static int sync_parent(const char *file) {
+  char *copy = strdup(file);
+  const int fd = open(dirname(copy), O_RDONLY | O_DIRECTORY);
+  free(copy);
+  if (fd < 0) {
+    return -1;
+  }
+
+  const int ret = fsync(fd);
+  close(fd);
+
+  return ret;
+}
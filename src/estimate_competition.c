@@ -0,0 +1,545 @@
+/**
+ * This module implements the estimator, see estimate_competition.h. Every
+ * thread probes on its own and merges the mean and variance of a batch of
+ * probes into the shared result, which is also where it is decided if the
+ * estimate is good enough.
+ *
+ * All probes start at the root, so the directories close to it are read over
+ * and over. Each thread therefore keeps the directories it has read in a tree
+ * of node_t, up to CACHE_NODES of them. Past that a directory is read while
+ * picking its random subdirectory, without storing anything.
+ *
+ * A cached directory whose subdirectories have all been read to the bottom is
+ * complete and its exact total is known. Probes only pick among the open
+ * subdirectories and add the complete ones exactly, which keeps the estimate
+ * unbiased while its variance falls as the tree is explored. Once the root is
+ * complete every probe gives the exact total.
+ *
+ * @file estimate_competition.c
+ * @author Elias Svensson (c24esn@cs.umu.se)
+ * @date 2025-11-10
+ */
+
+// --------------- Headers -------------------------------------------------- //
+
+#include "estimate_competition.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+// --------------- Constants ------------------------------------------------ //
+
+#define DIR_BUF_SIZE 4096
+#define CACHE_NODES (1 << 18) /* Directories kept by each thread */
+#define MAX_DEPTH (PATH_MAX / 2)
+#define PROBE_BATCH 8        /* Probes between two merges of the results */
+#define Z_95 1.959964        /* Normal quantile of a 95% interval */
+#define DEFAULT_ERROR 0.02
+#define DEFAULT_MIN_PROBES 64
+#define DEFAULT_MAX_PROBES 1000000
+
+// --------------- Structs -------------------------------------------------- //
+
+typedef struct linux_dirent64 {
+  int64_t d_ino;  /* 64-bit inode number */
+  int64_t d_off;  /* Not an offset; see getdents() */
+  short d_reclen; /* Size of this dirent */
+  char d_type;    /* File type */
+  char d_name[];  /* Filename (null-terminated) */
+} linux_dirent64;
+
+/**
+ * @typedef node_t
+ * @brief a directory close to the root, read once by a thread
+ *
+ */
+typedef struct node_t {
+  long blocks;               /* Blocks of the entries directly inside */
+  double done_blocks;        /* Blocks below the complete subdirectories */
+  int nr_subdirs;
+  int nr_open;               /* Subdirectories not complete, kept first */
+  int names_cap;
+  char **names;              /* Names of the subdirectories */
+  struct node_t **children;  /* Read when a probe first goes there */
+} node_t;
+
+/**
+ * @typedef moments_t
+ * @brief count, mean and sum of squared deviations of a set of probes
+ *
+ */
+typedef struct moments_t {
+  long n;
+  double mean;
+  double m2;
+} moments_t;
+
+/**
+ * @typedef estimator_t
+ * @brief state shared by the threads of estimate_blocks()
+ *
+ */
+typedef struct estimator_t {
+  const char *root;
+  estimate_options_t opts;
+  long root_blocks; /* Blocks of the root itself */
+  struct timespec start;
+
+  pthread_mutex_t lock; /* Protects everything below */
+  moments_t total;
+  long reads;
+  long next_check; /* Probes when the error is tested next */
+  double last_mean; /* Estimate at the last test */
+  bool last_met;    /* The error was met at the last test */
+  bool stop;
+} estimator_t;
+
+/**
+ * @typedef prober_t
+ * @brief state of a single probing thread
+ *
+ */
+typedef struct prober_t {
+  estimator_t *e;
+  node_t *root;
+  uint64_t rng; /* xorshift state */
+  long reads;
+  long nr_nodes;
+  bool complete; /* The root is complete, the total is exact */
+  char path[PATH_MAX];
+  node_t *trail[MAX_DEPTH]; /* Cached nodes of the current probe */
+  int picks[MAX_DEPTH];     /* Subdirectory taken at each of them */
+} prober_t;
+
+// --------------- Declaration of internal functions ------------------------ //
+
+/**
+ * @brief Main function of a probing thread
+ *
+ * @param arg       a pointer to a struct of type prober_t
+ */
+static void *prober(void *arg);
+
+/**
+ * @brief Walk from the root to a leaf once
+ *
+ * @param p         the calling thread
+ * @return          the estimate of the total blocks given by the walk
+ */
+static double probe(prober_t *p);
+
+/**
+ * @brief Read the directory at prober_t.path. Every subdirectory is either
+ * added to NODE or, if NODE is NULL, a random one is picked into CHOSEN
+ *
+ * @param p         the calling thread
+ * @param blocks    set to the blocks of the entries directly inside
+ * @param node      the node to add the names of subdirectories to, or NULL
+ * @param chosen    set to the name of a random subdirectory if NODE is NULL
+ * @return          the amount of subdirectories, 0 if it could not be read
+ */
+static int read_dir(prober_t *restrict p, long *restrict blocks,
+                    node_t *restrict node, char *restrict chosen);
+
+/**
+ * @brief Mark the last node of a probe complete and move it behind the open
+ * subdirectories of its parent. Repeated upwards while parents complete
+ *
+ * @param p         the calling thread
+ * @param depth     the amount of nodes in prober_t.trail
+ */
+static void complete(prober_t *p, int depth);
+
+/**
+ * @brief Read the directory at prober_t.path into a new node
+ *
+ * @param p         the calling thread
+ * @return          a pointer to a struct of type node_t
+ */
+static node_t *node_read(prober_t *p);
+
+/**
+ * @brief Deallocate a node and every node below it
+ *
+ * @param node      a pointer to a struct of type node_t
+ */
+static void node_destroy(node_t *node);
+
+/**
+ * @brief Append "/NAME" to prober_t.path
+ *
+ * @param p         the calling thread
+ * @param len       the length of the path, updated
+ * @param name      the name to append
+ * @return          false if the path would be too long
+ */
+static inline bool path_append(prober_t *restrict p, size_t *restrict len,
+                               const char *restrict name);
+
+/**
+ * @brief Get a random number in [0, n)
+ *
+ * @param p         the calling thread
+ * @param n         the upper bound
+ */
+static inline uint64_t rand_below(prober_t *p, const uint64_t n);
+
+/**
+ * @brief Add the probes described by B to A (Chan et al.)
+ */
+static void moments_merge(moments_t *restrict a, const moments_t *restrict b);
+
+/**
+ * @brief Get the half width of the 95% confidence interval of the mean
+ */
+static double moments_error(const moments_t *m);
+
+/**
+ * @brief Check if the estimate is good enough or the budget is spent. The
+ * caller holds estimator_t.lock
+ *
+ * @param e         the shared state
+ * @return          true if the threads should stop
+ */
+static bool estimate_done(estimator_t *e);
+
+// --------------- Definition of external functions ------------------------- //
+
+void estimate_options_init(estimate_options_t *opts) {
+  opts->nr_threads = 1;
+  opts->max_error = DEFAULT_ERROR;
+  opts->budget = 0;
+  opts->min_probes = DEFAULT_MIN_PROBES;
+  opts->max_probes = DEFAULT_MAX_PROBES;
+}
+
+int estimate_blocks(const char *restrict path,
+                    const estimate_options_t *restrict opts,
+                    estimate_t *restrict result) {
+  struct stat filestat;
+  if (lstat(path, &filestat) || strlen(path) >= PATH_MAX) {
+    return -1;
+  }
+
+  memset(result, 0, sizeof(estimate_t));
+  if (!S_ISDIR(filestat.st_mode)) {
+    result->blocks = filestat.st_blocks; // nothing to estimate
+    return 0;
+  }
+
+  estimator_t e;
+  memset(&e, 0, sizeof(e));
+  e.root = path;
+  e.root_blocks = filestat.st_blocks;
+  if (opts) {
+    e.opts = *opts;
+  } else {
+    estimate_options_init(&e.opts);
+  }
+  e.next_check = e.opts.min_probes > 0 ? e.opts.min_probes : 1;
+  pthread_mutex_init(&e.lock, NULL);
+  clock_gettime(CLOCK_MONOTONIC, &e.start);
+
+  const short n = e.opts.nr_threads;
+  prober_t *probers = calloc(n, sizeof(prober_t));
+  pthread_t *threads = calloc(n, sizeof(pthread_t));
+
+  for (short i = 0; i < n; i++) {
+    probers[i].e = &e;
+    probers[i].rng = (uint64_t)e.start.tv_nsec * 2654435761u + i + 1;
+    pthread_create(&threads[i], NULL, prober, &probers[i]);
+  }
+
+  result->blocks = -1;
+  for (short i = 0; i < n; i++) {
+    pthread_join(threads[i], NULL);
+    node_t *root = probers[i].root;
+    if (probers[i].complete) {
+      result->blocks = e.root_blocks + root->blocks + root->done_blocks;
+    }
+    node_destroy(root);
+  }
+
+  // a complete tree needs no estimate, the earlier probes only add noise
+  if (result->blocks < 0) {
+    result->blocks = e.total.mean;
+    result->error = moments_error(&e.total);
+  }
+  result->probes = e.total.n;
+  result->reads = e.reads;
+
+  pthread_mutex_destroy(&e.lock);
+  free(probers);
+  free(threads);
+
+  return 0;
+}
+
+// --------------- Definition of internal functions ------------------------- //
+
+static void *prober(void *arg) {
+  prober_t *p = (prober_t *)arg;
+  estimator_t *e = p->e;
+
+  strcpy(p->path, e->root);
+  p->root = node_read(p);
+
+  for (bool stop = false; !stop;) {
+    // Welford over a batch, merged into the total under the lock
+    moments_t batch = {0, 0, 0};
+    for (int i = 0; i < PROBE_BATCH; i++) {
+      const double x = probe(p);
+      const double delta = x - batch.mean;
+      batch.n++;
+      batch.mean += delta / batch.n;
+      batch.m2 += delta * (x - batch.mean);
+    }
+
+    pthread_mutex_lock(&e->lock);
+    moments_merge(&e->total, &batch);
+    e->reads += p->reads;
+    p->reads = 0;
+    if (!e->stop) {
+      e->stop = estimate_done(e);
+    }
+    stop = e->stop || p->complete;
+    pthread_mutex_unlock(&e->lock);
+  }
+
+  return NULL;
+}
+
+static double probe(prober_t *p) {
+  size_t len = strlen(p->e->root);
+  p->path[len] = '\0';
+
+  double weight = 1; // subdirectories like this one, as far as the walk knows
+  double est = p->e->root_blocks;
+  node_t *node = p->root;
+  int depth = 0;
+
+  for (;;) {
+    est += weight * (node->blocks + node->done_blocks);
+    p->trail[depth] = node;
+    if (!node->nr_open) {
+      complete(p, depth);
+      return est;
+    }
+
+    const int r = rand_below(p, node->nr_open);
+    p->picks[depth++] = r;
+    weight *= node->nr_open;
+    if (depth == MAX_DEPTH || !path_append(p, &len, node->names[r])) {
+      return est;
+    }
+
+    if (!node->children[r]) {
+      if (p->nr_nodes == CACHE_NODES) {
+        break;
+      }
+      node->children[r] = node_read(p);
+    }
+    node = node->children[r];
+  }
+
+  // past the cache, read and pick in one pass
+  char chosen[NAME_MAX + 1];
+  for (;;) {
+    long blocks;
+    const int nr_subdirs = read_dir(p, &blocks, NULL, chosen);
+
+    est += weight * blocks;
+    if (!nr_subdirs || !path_append(p, &len, chosen)) {
+      return est;
+    }
+    weight *= nr_subdirs;
+  }
+}
+
+static void complete(prober_t *p, int depth) {
+  for (; depth > 0; depth--) {
+    node_t *child = p->trail[depth];
+    node_t *parent = p->trail[depth - 1];
+    const int r = p->picks[depth - 1];
+    const int last = --parent->nr_open;
+
+    // swap the child behind the open subdirectories
+    char *name = parent->names[r];
+    parent->names[r] = parent->names[last];
+    parent->names[last] = name;
+    parent->children[r] = parent->children[last];
+    parent->children[last] = child;
+    parent->done_blocks += child->blocks + child->done_blocks;
+
+    if (parent->nr_open) {
+      return;
+    }
+  }
+
+  p->complete = true;
+}
+
+static int read_dir(prober_t *restrict p, long *restrict blocks,
+                    node_t *restrict node, char *restrict chosen) {
+  *blocks = 0;
+  p->reads++;
+
+  const int fd = open(p->path, O_RDONLY | O_DIRECTORY | O_NONBLOCK);
+  if (fd < 0) {
+    return 0;
+  }
+
+  int nr_subdirs = 0;
+  char buf[DIR_BUF_SIZE];
+  int nread;
+
+  while ((nread = syscall(SYS_getdents64, fd, buf, sizeof(buf))) > 0) {
+    for (int bpos = 0; bpos < nread;) {
+      struct linux_dirent64 *d = (struct linux_dirent64 *)(buf + bpos);
+      bpos += d->d_reclen;
+
+      if (strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0) {
+        continue; // skip current and parent directory
+      }
+
+      struct stat filestat;
+      if (fstatat(fd, d->d_name, &filestat, AT_SYMLINK_NOFOLLOW)) {
+        continue;
+      }
+
+      *blocks += filestat.st_blocks;
+      if (!S_ISDIR(filestat.st_mode)) {
+        continue;
+      }
+
+      nr_subdirs++;
+      if (node) {
+        if (node->nr_subdirs == node->names_cap) {
+          node->names_cap = node->names_cap ? 2 * node->names_cap : 8;
+          node->names =
+              realloc(node->names, node->names_cap * sizeof(char *));
+        }
+        node->names[node->nr_subdirs++] = strdup(d->d_name);
+      } else if (rand_below(p, nr_subdirs) == 0) {
+        strcpy(chosen, d->d_name); // reservoir of one
+      }
+    }
+  }
+
+  close(fd);
+  return nr_subdirs;
+}
+
+static node_t *node_read(prober_t *p) {
+  node_t *node = calloc(1, sizeof(node_t));
+
+  read_dir(p, &node->blocks, node, NULL);
+  node->nr_open = node->nr_subdirs;
+  p->nr_nodes++;
+  node->children = calloc(node->nr_subdirs ? node->nr_subdirs : 1,
+                          sizeof(node_t *));
+
+  return node;
+}
+
+static void node_destroy(node_t *node) {
+  if (!node) {
+    return;
+  }
+
+  for (int i = 0; i < node->nr_subdirs; i++) {
+    node_destroy(node->children[i]);
+    free(node->names[i]);
+  }
+
+  free(node->children);
+  free(node->names);
+  free(node);
+}
+
+static inline bool path_append(prober_t *restrict p, size_t *restrict len,
+                               const char *restrict name) {
+  const size_t name_len = strlen(name);
+  if (*len + name_len + 2 > PATH_MAX) {
+    return false;
+  }
+
+  if (p->path[*len - 1] != '/') {
+    p->path[(*len)++] = '/';
+  }
+  memcpy(p->path + *len, name, name_len + 1);
+  *len += name_len;
+
+  return true;
+}
+
+static inline uint64_t rand_below(prober_t *p, const uint64_t n) {
+  p->rng ^= p->rng << 13;
+  p->rng ^= p->rng >> 7;
+  p->rng ^= p->rng << 17;
+
+  return p->rng % n;
+}
+
+static void moments_merge(moments_t *restrict a, const moments_t *restrict b) {
+  const long n = a->n + b->n;
+  const double delta = b->mean - a->mean;
+
+  a->m2 += b->m2 + delta * delta * ((double)a->n * b->n / n);
+  a->mean += delta * b->n / n;
+  a->n = n;
+}
+
+static double moments_error(const moments_t *m) {
+  if (m->n < 2) {
+    return 0;
+  }
+
+  return Z_95 * sqrt(m->m2 / (m->n - 1) / m->n);
+}
+
+static bool estimate_done(estimator_t *e) {
+  if (e->total.n >= e->opts.max_probes) {
+    return true;
+  }
+
+  if (e->opts.budget > 0) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const double elapsed = (now.tv_sec - e->start.tv_sec) +
+                           (now.tv_nsec - e->start.tv_nsec) / 1e9;
+    if (elapsed >= e->opts.budget) {
+      return true;
+    }
+  }
+
+  // tested at doubling counts only, as a test after every batch stops as
+  // soon as the variance happens to look small
+  if (e->total.n < e->next_check) {
+    return false;
+  }
+  while (e->next_check <= e->total.n) {
+    e->next_check *= 2;
+  }
+
+  // a rare large subtree not yet probed keeps the variance low, but moves
+  // the mean once it is. So the error has to be met twice in a row, by
+  // estimates which agree within half of it
+  const double error = moments_error(&e->total);
+  const bool met = error <= e->opts.max_error * e->total.mean;
+  const bool done =
+      met && e->last_met && fabs(e->total.mean - e->last_mean) <= error / 2;
+  e->last_mean = e->total.mean;
+  e->last_met = met;
+
+  return done;
+}
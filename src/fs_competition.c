@@ -0,0 +1,454 @@
+/**
+ * This module implements the simulated file system, see fs_competition.h.
+ * The tree is generated breadth first into one array of nodes, so the
+ * children of a directory are a range of it, subdirectories first. A name is
+ * the index of the entry in that range, which makes a lookup a parse and a
+ * bounds check. The amount of children is drawn uniformly from 0 to twice
+ * the mean, and file sizes from powers of two, with a small PRNG seeded from
+ * the options.
+ *
+ * Open directories are slots of a fixed table, handed out from a free list
+ * under a lock. Every call sleeps for its latency before it returns, so the
+ * calling thread is blocked like on a slow file system.
+ *
+ * @file fs_competition.c
+ * @author Elias Svensson (c24esn@cs.umu.se)
+ * @date 2025-11-13
+ */
+
+// --------------- Preprocessor directives ---------------------------------- //
+
+#define _GNU_SOURCE // DT_DIR, AT_FDCWD
+
+// --------------- Headers -------------------------------------------------- //
+
+#include "fs_competition.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// --------------- Constants ------------------------------------------------ //
+
+#define NS_PER_SEC 1000000000L
+#define MAX_HANDLES 65536 /* Directories open at a time */
+#define NO_NODE UINT32_MAX
+#define SIM_DEV 0x5101    /* st_dev of every entry */
+#define DIR_BLOCKS 8      /* Blocks of a directory */
+#define NAME_LEN 16       /* A name is a letter and a 32 bit index */
+
+// --------------- Structs -------------------------------------------------- //
+
+typedef struct linux_dirent64 {
+  int64_t d_ino;  /* 64-bit inode number */
+  int64_t d_off;  /* Not an offset; see getdents() */
+  short d_reclen; /* Size of this dirent */
+  char d_type;    /* File type */
+  char d_name[];  /* Filename (null-terminated) */
+} linux_dirent64;
+
+/**
+ * @typedef node_t
+ * @brief an entry of the tree
+ *
+ */
+typedef struct node_t {
+  uint32_t first;    /* Index of the first child */
+  uint32_t nr_dirs;  /* Subdirectories, the children before the files */
+  uint32_t nr_files; /* Files, the children after the subdirectories */
+  uint32_t blocks;   /* Blocks of the entry itself */
+  bool dir;
+} node_t;
+
+/**
+ * @typedef handle_t
+ * @brief an open directory
+ *
+ */
+typedef struct handle_t {
+  uint32_t node; /* NO_NODE if the slot is free */
+  uint32_t pos;  /* Next record to read: ".", "..", then the children */
+} handle_t;
+
+typedef struct sim_t {
+  fs_t fs; /* Must be first, the backend is passed as a pointer to it */
+  fs_sim_options_t opts;
+  node_t *nodes;
+  long nr_nodes;
+  long blocks; /* Blocks of every node */
+
+  handle_t *handles;    /* MAX_HANDLES */
+  int *free;            /* Free slots of HANDLES */
+  int nr_free;
+  pthread_mutex_t lock; /* Protects FREE and NR_FREE */
+} sim_t;
+
+// --------------- Declaration of internal functions ------------------------ //
+
+/**
+ * @brief The calls of fs_t, see fs_competition.h
+ */
+static int sim_openat(fs_t *fs, const int dirfd, const char *path);
+static int sim_getdents(fs_t *fs, const int fd, void *buf, const size_t size);
+static int sim_fstatat(fs_t *fs, const int dirfd, const char *name,
+                       struct stat *st);
+static int sim_close(fs_t *fs, const int fd);
+static void sim_destroy(fs_t *fs);
+
+/**
+ * @brief Generate the tree of a simulated file system
+ *
+ * @param sim       a simulated file system with its options set
+ */
+static void sim_generate(sim_t *sim);
+
+/**
+ * @brief Find the node of PATH relative to DIRFD
+ *
+ * @param sim       a simulated file system
+ * @param dirfd     an open directory or AT_FDCWD for the root
+ * @param path      the path, "" and "." for DIRFD itself
+ * @return          the index of the node, NO_NODE with errno set if there is
+ * none
+ */
+static uint32_t sim_resolve(const sim_t *restrict sim, const int dirfd,
+                            const char *restrict path);
+
+/**
+ * @brief Block the calling thread for the latency of a call
+ *
+ * @param ns        the latency in ns, nothing is done for 0
+ */
+static void sim_wait(const long ns);
+
+/**
+ * @brief Get the next number of a PRNG (splitmix64)
+ *
+ * @param state     the state of the PRNG
+ */
+static uint64_t sim_rand(uint64_t *state);
+
+// --------------- Definition of external functions ------------------------- //
+
+void fs_sim_options_init(fs_sim_options_t *opts) {
+  memset(opts, 0, sizeof(fs_sim_options_t));
+  opts->seed = 1;
+  opts->max_nodes = 1 << 20;
+  opts->depth = 8;
+  opts->fanout = 4;
+  opts->files = 8;
+}
+
+fs_t *fs_sim_create(const fs_sim_options_t *opts) {
+  sim_t *sim = calloc(1, sizeof(sim_t));
+
+  if (opts) {
+    sim->opts = *opts;
+  } else {
+    fs_sim_options_init(&sim->opts);
+  }
+  if (sim->opts.max_nodes < 1 || sim->opts.max_nodes >= NO_NODE) {
+    sim->opts.max_nodes = NO_NODE - 1;
+  }
+
+  sim->fs.openat = sim_openat;
+  sim->fs.getdents = sim_getdents;
+  sim->fs.fstatat = sim_fstatat;
+  sim->fs.close = sim_close;
+  sim->fs.destroy = sim_destroy;
+
+  sim_generate(sim);
+
+  sim->handles = malloc(MAX_HANDLES * sizeof(handle_t));
+  sim->free = malloc(MAX_HANDLES * sizeof(int));
+  for (int i = 0; i < MAX_HANDLES; i++) {
+    sim->handles[i].node = NO_NODE;
+    sim->free[i] = MAX_HANDLES - 1 - i; // low descriptors first
+  }
+  sim->nr_free = MAX_HANDLES;
+  pthread_mutex_init(&sim->lock, NULL);
+
+  return &sim->fs;
+}
+
+long fs_sim_blocks(const fs_t *fs) {
+  return ((const sim_t *)fs)->blocks;
+}
+
+long fs_sim_nodes(const fs_t *fs) {
+  return ((const sim_t *)fs)->nr_nodes;
+}
+
+void fs_destroy(fs_t *fs) {
+  if (fs) {
+    fs->destroy(fs);
+  }
+}
+
+// --------------- Definition of internal functions ------------------------- //
+
+static int sim_openat(fs_t *fs, const int dirfd, const char *path) {
+  sim_t *sim = (sim_t *)fs;
+  sim_wait(sim->opts.open_ns);
+
+  const uint32_t node = sim_resolve(sim, dirfd, path);
+  if (node == NO_NODE) {
+    return -1;
+  }
+  if (!sim->nodes[node].dir) {
+    errno = ENOTDIR;
+    return -1;
+  }
+
+  pthread_mutex_lock(&sim->lock);
+  const int fd = sim->nr_free ? sim->free[--sim->nr_free] : -1;
+  pthread_mutex_unlock(&sim->lock);
+
+  if (fd < 0) {
+    errno = EMFILE;
+    return -1;
+  }
+
+  sim->handles[fd].node = node;
+  sim->handles[fd].pos = 0;
+  return fd;
+}
+
+static int sim_getdents(fs_t *fs, const int fd, void *buf, const size_t size) {
+  sim_t *sim = (sim_t *)fs;
+  sim_wait(sim->opts.getdents_ns);
+
+  if (fd < 0 || fd >= MAX_HANDLES || sim->handles[fd].node == NO_NODE) {
+    errno = EBADF;
+    return -1;
+  }
+
+  handle_t *h = &sim->handles[fd];
+  const node_t *dir = &sim->nodes[h->node];
+  const uint32_t end = dir->nr_dirs + dir->nr_files + 2;
+  size_t len = 0;
+
+  for (; h->pos < end; h->pos++) {
+    char name[NAME_LEN];
+    uint32_t node;
+
+    if (h->pos < 2) {
+      strcpy(name, h->pos ? ".." : ".");
+      node = h->node; // the parent is not known, it is not stat'ed anyway
+    } else if (h->pos - 2 < dir->nr_dirs) {
+      snprintf(name, sizeof(name), "d%u", h->pos - 2);
+      node = dir->first + h->pos - 2;
+    } else {
+      snprintf(name, sizeof(name), "f%u", h->pos - 2 - dir->nr_dirs);
+      node = dir->first + h->pos - 2;
+    }
+
+    // records are aligned to 8 bytes, as from the kernel
+    const size_t name_len = strlen(name) + 1;
+    const size_t reclen =
+        (offsetof(linux_dirent64, d_name) + name_len + 7) & ~(size_t)7;
+    if (len + reclen > size) {
+      break;
+    }
+
+    linux_dirent64 *d = (linux_dirent64 *)((char *)buf + len);
+    d->d_ino = node + 1;
+    d->d_off = h->pos + 1;
+    d->d_reclen = reclen;
+    d->d_type = sim->nodes[node].dir ? DT_DIR : DT_REG;
+    memcpy(d->d_name, name, name_len);
+    len += reclen;
+  }
+
+  if (len == 0 && h->pos < end) {
+    errno = EINVAL; // the buffer is too small for a single record
+    return -1;
+  }
+
+  return len;
+}
+
+static int sim_fstatat(fs_t *fs, const int dirfd, const char *name,
+                       struct stat *st) {
+  sim_t *sim = (sim_t *)fs;
+  sim_wait(sim->opts.stat_ns);
+
+  const uint32_t node = sim_resolve(sim, dirfd, name);
+  if (node == NO_NODE) {
+    return -1;
+  }
+
+  const node_t *n = &sim->nodes[node];
+  memset(st, 0, sizeof(struct stat));
+  st->st_dev = SIM_DEV;
+  st->st_ino = node + 1;
+  st->st_mode = n->dir ? S_IFDIR | 0755 : S_IFREG | 0644;
+  st->st_nlink = n->dir ? 2 + n->nr_dirs : 1;
+  st->st_size = n->dir ? 4096 : n->blocks * 512L;
+  st->st_blksize = 4096;
+  st->st_blocks = n->blocks;
+
+  return 0;
+}
+
+static int sim_close(fs_t *fs, const int fd) {
+  sim_t *sim = (sim_t *)fs;
+
+  if (fd < 0 || fd >= MAX_HANDLES || sim->handles[fd].node == NO_NODE) {
+    errno = EBADF;
+    return -1;
+  }
+
+  sim->handles[fd].node = NO_NODE;
+
+  pthread_mutex_lock(&sim->lock);
+  sim->free[sim->nr_free++] = fd;
+  pthread_mutex_unlock(&sim->lock);
+
+  return 0;
+}
+
+static void sim_destroy(fs_t *fs) {
+  sim_t *sim = (sim_t *)fs;
+
+  pthread_mutex_destroy(&sim->lock);
+  free(sim->handles);
+  free(sim->free);
+  free(sim->nodes);
+  free(sim);
+}
+
+static void sim_generate(sim_t *sim) {
+  const fs_sim_options_t *o = &sim->opts;
+  uint64_t state = o->seed;
+
+  // the tree may stop short of MAX_NODES, so the array is shrunk at the end
+  long cap = o->max_nodes < 4096 ? o->max_nodes : 4096;
+  sim->nodes = malloc(cap * sizeof(node_t));
+  sim->nodes[0] = (node_t){0, 0, 0, DIR_BLOCKS, true};
+  sim->nr_nodes = 1;
+  sim->blocks = DIR_BLOCKS;
+
+  // nodes are added level by level, the level ends where the next began
+  long level_end = 1;
+  short depth = 0;
+
+  for (long i = 0; i < sim->nr_nodes; i++) {
+    if (i == level_end) {
+      level_end = sim->nr_nodes;
+      depth++;
+    }
+    if (!sim->nodes[i].dir) {
+      continue;
+    }
+
+    long nr_dirs =
+        depth < o->depth ? sim_rand(&state) % (2 * o->fanout + 1) : 0;
+    long nr_files = sim_rand(&state) % (2 * o->files + 1);
+    const long left = o->max_nodes - sim->nr_nodes;
+    if (nr_dirs > left) {
+      nr_dirs = left;
+    }
+    if (nr_files > left - nr_dirs) {
+      nr_files = left - nr_dirs;
+    }
+
+    if (sim->nr_nodes + nr_dirs + nr_files > cap) {
+      while (sim->nr_nodes + nr_dirs + nr_files > cap) {
+        cap *= 2;
+      }
+      sim->nodes = realloc(sim->nodes, cap * sizeof(node_t));
+    }
+
+    node_t *dir = &sim->nodes[i];
+    dir->first = sim->nr_nodes;
+    dir->nr_dirs = nr_dirs;
+    dir->nr_files = nr_files;
+
+    for (long k = 0; k < nr_dirs; k++) {
+      sim->nodes[sim->nr_nodes++] = (node_t){0, 0, 0, DIR_BLOCKS, true};
+      sim->blocks += DIR_BLOCKS;
+    }
+
+    // a sixteenth of the files are empty, the rest 4K to 512K
+    for (long k = 0; k < nr_files; k++) {
+      const uint64_t r = sim_rand(&state);
+      const uint32_t blocks = r % 16 ? 8U << (r >> 8) % 8 : 0;
+      sim->nodes[sim->nr_nodes++] = (node_t){0, 0, 0, blocks, false};
+      sim->blocks += blocks;
+    }
+  }
+
+  sim->nodes = realloc(sim->nodes, sim->nr_nodes * sizeof(node_t));
+}
+
+static uint32_t sim_resolve(const sim_t *restrict sim, const int dirfd,
+                            const char *restrict path) {
+  uint32_t node;
+  if (dirfd == AT_FDCWD) {
+    node = 0;
+  } else if (dirfd >= 0 && dirfd < MAX_HANDLES &&
+             sim->handles[dirfd].node != NO_NODE) {
+    node = sim->handles[dirfd].node;
+  } else {
+    errno = EBADF;
+    return NO_NODE;
+  }
+
+  for (const char *p = path; *p;) {
+    if (*p == '/') {
+      p++;
+      continue;
+    }
+    if (p[0] == '.' && (p[1] == '/' || p[1] == '\0')) {
+      p++;
+      continue;
+    }
+
+    const node_t *dir = &sim->nodes[node];
+    if (!dir->dir) {
+      errno = ENOTDIR;
+      return NO_NODE;
+    }
+
+    // "dN" is the Nth subdirectory and "fN" the Nth file
+    char *end;
+    const unsigned long k = strtoul(p + 1, &end, 10);
+    if ((*p != 'd' && *p != 'f') || end == p + 1 ||
+        (*end != '/' && *end != '\0') ||
+        k >= (*p == 'd' ? dir->nr_dirs : dir->nr_files)) {
+      errno = ENOENT;
+      return NO_NODE;
+    }
+
+    node = dir->first + (*p == 'd' ? 0 : dir->nr_dirs) + k;
+    p = end;
+  }
+
+  return node;
+}
+
+static void sim_wait(const long ns) {
+  if (ns <= 0) {
+    return;
+  }
+
+  struct timespec ts = {ns / NS_PER_SEC, ns % NS_PER_SEC};
+  while (nanosleep(&ts, &ts)) {
+    // interrupted, sleep for the rest
+  }
+}
+
+static uint64_t sim_rand(uint64_t *state) {
+  uint64_t z = (*state += 0x9e3779b97f4a7c15);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+
+  return z ^ (z >> 31);
+}
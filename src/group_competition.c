@@ -0,0 +1,381 @@
+/**
+ * This module implements the grouped usage, see group_competition.h. Every
+ * table is an open addressing hash table with linear probing, keyed by the
+ * two words of group_entry_t, so a key is hashed and compared without looking
+ * at its kind. Kinds not asked for have no table.
+ *
+ * Merging walks the slots of every table into the first groups_t. The kinds
+ * touch different tables, so each gets a thread of its own once the tables
+ * hold GROUP_PARALLEL_MIN entries.
+ *
+ * @file group_competition.c
+ * @author Elias Svensson (c24esn@cs.umu.se)
+ * @date 2025-11-15
+ */
+
+// --------------- Headers -------------------------------------------------- //
+
+#include "group_competition.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// --------------- Constants ------------------------------------------------ //
+
+#define DEFAULT_CAPACITY 64      /* Must be a power of 2 */
+#define GROUP_PARALLEL_MIN 65536 /* Entries to merge before kinds get threads */
+#define DAY (24 * 60 * 60)
+
+// --------------- Structs -------------------------------------------------- //
+
+typedef struct table_t {
+  group_entry_t *slots; /* NULL if the kind was not asked for */
+  long len;
+  long capacity;
+  group_entry_t *sorted; /* From the last groups_get() */
+} table_t;
+
+struct groups_t {
+  unsigned kinds;
+  time_t now;
+  table_t tables[GROUP_KINDS];
+};
+
+/**
+ * @typedef merge_t
+ * @brief a kind to merge, the argument of merge_kind()
+ *
+ */
+typedef struct merge_t {
+  groups_t *const *all;
+  int n;
+  group_kind_t kind;
+} merge_t;
+
+// --------------- Global vars ---------------------------------------------- //
+
+/* Upper bounds of the age buckets in seconds, the last bucket is open */
+static const long age_bounds[] = {DAY, 7 * DAY, 30 * DAY, 90 * DAY, 365 * DAY,
+                                  3 * 365 * DAY};
+static const char *const age_names[] = {"<1d", "<7d", "<30d", "<90d",
+                                        "<1y", "<3y", ">=3y"};
+static const char *const kind_names[] = {"uid", "gid", "ext", "age"};
+
+// --------------- Declaration of internal functions ------------------------ //
+
+/**
+ * @brief Add entries and blocks to KEY in a table
+ *
+ * @param table     a table of groups_t
+ * @param key       the key, its counters are ignored
+ * @param entries   the entries to add
+ * @param blocks    the blocks to add
+ */
+static inline void table_add(table_t *restrict table,
+                             const group_entry_t *restrict key,
+                             const long entries, const long blocks);
+
+/**
+ * @brief Find the slot holding KEY, or the empty slot where it belongs
+ *
+ * @param table     a table of groups_t
+ * @param key       the key to look for
+ * @return          a pointer to the slot
+ */
+static inline group_entry_t *table_find(const table_t *restrict table,
+                                        const group_entry_t *restrict key);
+
+/**
+ * @brief Double the capacity of a table
+ *
+ * @param table     a table of groups_t
+ */
+static void table_grow(table_t *table);
+
+/**
+ * @brief Hash the key of an entry
+ */
+static inline uint64_t hash_key(const group_entry_t *key);
+
+/**
+ * @brief Set KEY to the extension of NAME, or to none
+ *
+ * @param key       the key to set
+ * @param name      the name of a regular file, NULL for other entries
+ */
+static inline void key_ext(group_entry_t *restrict key,
+                           const char *restrict name);
+
+/**
+ * @brief Get the bucket of an age
+ *
+ * @param age       seconds since the last modification
+ * @return          an index into age_names
+ */
+static inline uint64_t age_bucket(const long age);
+
+/**
+ * @brief Merge one kind of every groups_t into the first, run by a thread
+ *
+ * @param arg       a pointer to a struct of type merge_t
+ */
+static void *merge_kind(void *arg);
+
+/**
+ * @brief Compare two entries for qsort, most blocks first
+ */
+static int entry_cmp_desc(const void *a, const void *b);
+
+// --------------- Definition of external functions ------------------------- //
+
+groups_t *groups_create(const unsigned kinds, const time_t now) {
+  groups_t *g = calloc(1, sizeof(groups_t));
+  g->kinds = kinds;
+  g->now = now;
+
+  for (int k = 0; k < GROUP_KINDS; k++) {
+    if (kinds & (1U << k)) {
+      g->tables[k].capacity = DEFAULT_CAPACITY;
+      g->tables[k].slots = calloc(DEFAULT_CAPACITY, sizeof(group_entry_t));
+    }
+  }
+
+  return g;
+}
+
+void groups_destroy(groups_t *g) {
+  if (!g) {
+    return;
+  }
+
+  for (int k = 0; k < GROUP_KINDS; k++) {
+    free(g->tables[k].slots);
+    free(g->tables[k].sorted);
+  }
+  free(g);
+}
+
+void groups_add(groups_t *restrict g, const struct stat *restrict st,
+                const char *restrict name, const long blocks) {
+  group_entry_t key;
+
+  if (g->kinds & (1U << GROUP_UID)) {
+    key.words[0] = st->st_uid;
+    key.words[1] = 0;
+    table_add(&g->tables[GROUP_UID], &key, 1, blocks);
+  }
+  if (g->kinds & (1U << GROUP_GID)) {
+    key.words[0] = st->st_gid;
+    key.words[1] = 0;
+    table_add(&g->tables[GROUP_GID], &key, 1, blocks);
+  }
+  if (g->kinds & (1U << GROUP_EXT)) {
+    key_ext(&key, S_ISREG(st->st_mode) ? name : NULL);
+    table_add(&g->tables[GROUP_EXT], &key, 1, blocks);
+  }
+  if (g->kinds & (1U << GROUP_AGE)) {
+    key.words[0] = age_bucket(g->now - st->st_mtime);
+    key.words[1] = 0;
+    table_add(&g->tables[GROUP_AGE], &key, 1, blocks);
+  }
+}
+
+void groups_merge(groups_t *const *all, const int n) {
+  merge_t merges[GROUP_KINDS];
+  pthread_t threads[GROUP_KINDS];
+  bool started[GROUP_KINDS] = {false};
+
+  long total = 0;
+  for (int i = 1; i < n; i++) {
+    for (int k = 0; k < GROUP_KINDS; k++) {
+      total += all[i]->tables[k].len;
+    }
+  }
+
+  for (int k = 0; k < GROUP_KINDS; k++) {
+    if (!all[0]->tables[k].slots) {
+      continue;
+    }
+
+    merges[k] = (merge_t){all, n, k};
+    if (total >= GROUP_PARALLEL_MIN) {
+      started[k] =
+          !pthread_create(&threads[k], NULL, merge_kind, &merges[k]);
+    }
+    if (!started[k]) {
+      merge_kind(&merges[k]);
+    }
+  }
+
+  for (int k = 0; k < GROUP_KINDS; k++) {
+    if (started[k]) {
+      pthread_join(threads[k], NULL);
+    }
+  }
+}
+
+const group_entry_t *groups_get(groups_t *restrict g, const group_kind_t kind,
+                                long *restrict len) {
+  table_t *t = &g->tables[kind];
+  if (!t->slots) {
+    *len = 0;
+    return NULL;
+  }
+
+  free(t->sorted);
+  t->sorted = malloc((t->len + 1) * sizeof(group_entry_t));
+
+  long n = 0;
+  for (long i = 0; i < t->capacity; i++) {
+    if (t->slots[i].entries) {
+      t->sorted[n++] = t->slots[i];
+    }
+  }
+  qsort(t->sorted, n, sizeof(group_entry_t), entry_cmp_desc);
+
+  *len = n;
+  return t->sorted;
+}
+
+unsigned groups_parse(const char *list) {
+  unsigned kinds = 0;
+
+  for (const char *p = list;; p++) {
+    const size_t len = strcspn(p, ",");
+
+    int k = 0;
+    while (k < GROUP_KINDS && (strlen(kind_names[k]) != len ||
+                               strncmp(p, kind_names[k], len) != 0)) {
+      k++;
+    }
+    if (k == GROUP_KINDS) {
+      return 0;
+    }
+    kinds |= 1U << k;
+
+    p += len;
+    if (*p == '\0') {
+      return kinds;
+    }
+  }
+}
+
+const char *group_kind_name(const group_kind_t kind) {
+  return kind_names[kind];
+}
+
+const char *group_age_name(const uint64_t bucket) {
+  return age_names[bucket];
+}
+
+// --------------- Definition of internal functions ------------------------- //
+
+static inline void table_add(table_t *restrict t,
+                             const group_entry_t *restrict key,
+                             const long entries, const long blocks) {
+  group_entry_t *slot = table_find(t, key);
+
+  if (!slot->entries) {
+    if (2 * (t->len + 1) > t->capacity) {
+      table_grow(t);
+      slot = table_find(t, key);
+    }
+    slot->words[0] = key->words[0];
+    slot->words[1] = key->words[1];
+    t->len++;
+  }
+
+  slot->entries += entries;
+  slot->blocks += blocks;
+}
+
+static inline group_entry_t *table_find(const table_t *restrict t,
+                                        const group_entry_t *restrict key) {
+  const long mask = t->capacity - 1;
+
+  for (long i = hash_key(key) & mask;; i = (i + 1) & mask) {
+    group_entry_t *slot = &t->slots[i];
+    if (!slot->entries || (slot->words[0] == key->words[0] &&
+                           slot->words[1] == key->words[1])) {
+      return slot;
+    }
+  }
+}
+
+static void table_grow(table_t *t) {
+  group_entry_t *old = t->slots;
+  const long old_capacity = t->capacity;
+
+  t->capacity *= 2;
+  t->slots = calloc(t->capacity, sizeof(group_entry_t));
+
+  for (long i = 0; i < old_capacity; i++) {
+    if (old[i].entries) {
+      *table_find(t, &old[i]) = old[i];
+    }
+  }
+
+  free(old);
+}
+
+static inline uint64_t hash_key(const group_entry_t *key) {
+  uint64_t h = key->words[0] * 0x9e3779b97f4a7c15ULL;
+  h ^= key->words[1] * 0xc2b2ae3d27d4eb4fULL;
+
+  return h ^ (h >> 29);
+}
+
+static inline void key_ext(group_entry_t *restrict key,
+                           const char *restrict name) {
+  key->words[0] = 0;
+  key->words[1] = 0;
+  if (!name || !name[0]) {
+    return;
+  }
+
+  // a leading dot hides a file, it does not start an extension
+  const char *dot = strrchr(name + 1, '.');
+  if (!dot || !dot[1]) {
+    return;
+  }
+
+  const size_t len = strlen(dot + 1);
+  if (len < GROUP_EXT_MAX) {
+    memcpy(key->ext, dot + 1, len);
+  }
+}
+
+static inline uint64_t age_bucket(const long age) {
+  uint64_t b = 0;
+  while (b < sizeof(age_bounds) / sizeof(age_bounds[0]) &&
+         age >= age_bounds[b]) {
+    b++;
+  }
+
+  return b;
+}
+
+static void *merge_kind(void *arg) {
+  const merge_t *m = arg;
+  table_t *into = &m->all[0]->tables[m->kind];
+
+  for (int i = 1; i < m->n; i++) {
+    const table_t *t = &m->all[i]->tables[m->kind];
+    for (long s = 0; s < t->capacity; s++) {
+      if (t->slots[s].entries) {
+        table_add(into, &t->slots[s], t->slots[s].entries,
+                  t->slots[s].blocks);
+      }
+    }
+  }
+
+  return NULL;
+}
+
+static int entry_cmp_desc(const void *a, const void *b) {
+  const long ba = ((const group_entry_t *)a)->blocks;
+  const long bb = ((const group_entry_t *)b)->blocks;
+
+  return (ba < bb) - (ba > bb);
+}
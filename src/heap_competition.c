@@ -0,0 +1,198 @@
+/**
+ * This module implements a bounded min-heap, see heap_competition.h.
+ *
+ * @file heap_competition.c
+ * @author Elias Svensson (c24esn@cs.umu.se)
+ * @date 2025-10-27
+ */
+
+// --------------- Headers -------------------------------------------------- //
+
+#include "heap_competition.h"
+#include <stdlib.h>
+
+// --------------- Structs -------------------------------------------------- //
+
+struct heap_t {
+  heap_entry_t *entries;
+  int len;
+  int capacity;
+  bool sorted; /* entries are sorted descending, not a valid heap */
+};
+
+// --------------- Declaration of internal functions ------------------------ //
+
+/**
+ * @brief Move the entry at IDX down until the heap property holds
+ *
+ * @param heap      a pointer to a struct of type heap_t
+ * @param idx       the index to start at
+ */
+static void heap_sift_down(heap_t *heap, int idx);
+
+/**
+ * @brief Move the entry at IDX up until the heap property holds
+ *
+ * @param heap      a pointer to a struct of type heap_t
+ * @param idx       the index to start at
+ */
+static void heap_sift_up(heap_t *heap, int idx);
+
+/**
+ * @brief Restore the heap property after heap_sorted() was called
+ *
+ * @param heap      a pointer to a struct of type heap_t
+ */
+static void heap_restore(heap_t *heap);
+
+/**
+ * @brief Compare two entries for qsort, largest key first
+ */
+static int entry_cmp_desc(const void *a, const void *b);
+
+// --------------- Definition of external functions ------------------------- //
+
+heap_t *heap_create(const int capacity) {
+  heap_t *h = malloc(sizeof(heap_t));
+
+  h->capacity = capacity > 0 ? capacity : 1;
+  h->entries = calloc(h->capacity, sizeof(heap_entry_t));
+  h->len = 0;
+  h->sorted = false;
+
+  return h;
+}
+
+void heap_destroy(heap_t *h) {
+  if (!h) {
+    return;
+  }
+
+  heap_clear(h);
+  free(h->entries);
+  free(h);
+}
+
+bool heap_accepts(const heap_t *h, const long key) {
+  if (h->len < h->capacity) {
+    return true;
+  }
+
+  // a sorted heap has its smallest entry last
+  return key > h->entries[h->sorted ? h->len - 1 : 0].key;
+}
+
+void heap_push(heap_t *restrict h, const long key, char *restrict val) {
+  heap_restore(h);
+
+  if (h->len < h->capacity) {
+    h->entries[h->len].key = key;
+    h->entries[h->len].val = val;
+    heap_sift_up(h, h->len++);
+    return;
+  }
+
+  if (key <= h->entries[0].key) {
+    free(val);
+    return;
+  }
+
+  // replace the smallest entry
+  free(h->entries[0].val);
+  h->entries[0].key = key;
+  h->entries[0].val = val;
+  heap_sift_down(h, 0);
+}
+
+void heap_merge(heap_t *restrict dst, heap_t *restrict src) {
+  for (int i = 0; i < src->len; i++) {
+    heap_push(dst, src->entries[i].key, src->entries[i].val);
+  }
+
+  src->len = 0;
+  src->sorted = false;
+}
+
+const heap_entry_t *heap_sorted(heap_t *restrict h, int *restrict len) {
+  if (!h->sorted) {
+    qsort(h->entries, h->len, sizeof(heap_entry_t), entry_cmp_desc);
+    h->sorted = true;
+  }
+
+  *len = h->len;
+  return h->entries;
+}
+
+void heap_clear(heap_t *h) {
+  for (int i = 0; i < h->len; i++) {
+    free(h->entries[i].val);
+  }
+
+  h->len = 0;
+  h->sorted = false;
+}
+
+// --------------- Definition of internal functions ------------------------- //
+
+static void heap_sift_down(heap_t *h, int idx) {
+  heap_entry_t *e = h->entries;
+
+  for (;;) {
+    int smallest = idx;
+    int left = 2 * idx + 1;
+    int right = left + 1;
+
+    if (left < h->len && e[left].key < e[smallest].key) {
+      smallest = left;
+    }
+    if (right < h->len && e[right].key < e[smallest].key) {
+      smallest = right;
+    }
+    if (smallest == idx) {
+      return;
+    }
+
+    heap_entry_t tmp = e[idx];
+    e[idx] = e[smallest];
+    e[smallest] = tmp;
+    idx = smallest;
+  }
+}
+
+static void heap_sift_up(heap_t *h, int idx) {
+  heap_entry_t *e = h->entries;
+
+  while (idx > 0) {
+    int parent = (idx - 1) / 2;
+    if (e[parent].key <= e[idx].key) {
+      return;
+    }
+
+    heap_entry_t tmp = e[idx];
+    e[idx] = e[parent];
+    e[parent] = tmp;
+    idx = parent;
+  }
+}
+
+static void heap_restore(heap_t *h) {
+  if (!h->sorted) {
+    return;
+  }
+
+  // a descending array is a max-heap, reverse it to get a valid min-heap
+  for (int i = 0, j = h->len - 1; i < j; i++, j--) {
+    heap_entry_t tmp = h->entries[i];
+    h->entries[i] = h->entries[j];
+    h->entries[j] = tmp;
+  }
+
+  h->sorted = false;
+}
+
+static int entry_cmp_desc(const void *a, const void *b) {
+  const long ka = ((const heap_entry_t *)a)->key;
+  const long kb = ((const heap_entry_t *)b)->key;
+
+  return (ka < kb) - (ka > kb);
+}
@@ -0,0 +1,222 @@
+/**
+ * This module implements the cost hints table, see hints_competition.h. It is
+ * an open addressing hash table with linear probing.
+ *
+ * @file hints_competition.c
+ * @author Elias Svensson (c24esn@cs.umu.se)
+ * @date 2025-11-05
+ */
+
+// --------------- Headers -------------------------------------------------- //
+
+#include "hints_competition.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// --------------- Constants ------------------------------------------------ //
+
+#define DEFAULT_CAPACITY 256 /* Must be a power of 2 */
+#define LINE_LEN 4352        /* PATH_MAX and room for the count */
+
+// --------------- Structs -------------------------------------------------- //
+
+typedef struct slot_t {
+  uint64_t hash;
+  char *path; /* NULL for an empty slot */
+  long entries;
+} slot_t;
+
+struct hints_t {
+  slot_t *slots;
+  long len;
+  long capacity;
+};
+
+// --------------- Declaration of internal functions ------------------------ //
+
+/**
+ * @brief Hash a path (FNV-1a)
+ */
+static uint64_t hash_path(const char *path);
+
+/**
+ * @brief Find the slot holding PATH, or the empty slot where it belongs
+ *
+ * @param hints     a pointer to a struct of type hints_t
+ * @param path      the path to look for
+ * @param hash      the hash of PATH
+ * @return          a pointer to the slot
+ */
+static slot_t *hints_find(const hints_t *restrict hints,
+                          const char *restrict path, const uint64_t hash);
+
+/**
+ * @brief Double the capacity of a table
+ *
+ * @param hints     a pointer to a struct of type hints_t
+ */
+static void hints_grow(hints_t *hints);
+
+/**
+ * @brief Compare two slots for qsort, most entries first
+ */
+static int slot_cmp_desc(const void *a, const void *b);
+
+// --------------- Definition of external functions ------------------------- //
+
+hints_t *hints_create(void) {
+  hints_t *h = malloc(sizeof(hints_t));
+
+  h->capacity = DEFAULT_CAPACITY;
+  h->slots = calloc(h->capacity, sizeof(slot_t));
+  h->len = 0;
+
+  return h;
+}
+
+hints_t *hints_load(const char *file) {
+  FILE *fp = fopen(file, "r");
+  if (!fp) {
+    return NULL;
+  }
+
+  hints_t *h = hints_create();
+  char line[LINE_LEN];
+
+  while (fgets(line, sizeof(line), fp)) {
+    char *path;
+    const long entries = strtol(line, &path, 10);
+    if (*path != '\t') {
+      continue; // not a hint
+    }
+
+    path[strcspn(path, "\n")] = '\0';
+    hints_put(h, path + 1, entries);
+  }
+
+  fclose(fp);
+  return h;
+}
+
+int hints_save(const hints_t *restrict h, const char *restrict file) {
+  const size_t len = strlen(file);
+  char *tmp = malloc(len + 5);
+  memcpy(tmp, file, len);
+  memcpy(tmp + len, ".tmp", 5);
+
+  FILE *fp = fopen(tmp, "w");
+  if (!fp) {
+    free(tmp);
+    return -1;
+  }
+
+  // largest first, so the file is readable as a report as well
+  slot_t *sorted = malloc((h->len + 1) * sizeof(slot_t));
+  long n = 0;
+  for (long i = 0; i < h->capacity; i++) {
+    if (h->slots[i].path) {
+      sorted[n++] = h->slots[i];
+    }
+  }
+  qsort(sorted, n, sizeof(slot_t), slot_cmp_desc);
+
+  for (long i = 0; i < n; i++) {
+    fprintf(fp, "%ld\t%s\n", sorted[i].entries, sorted[i].path);
+  }
+  free(sorted);
+
+  int ret = fclose(fp) ? -1 : rename(tmp, file);
+  free(tmp);
+
+  return ret;
+}
+
+void hints_destroy(hints_t *h) {
+  if (!h) {
+    return;
+  }
+
+  for (long i = 0; i < h->capacity; i++) {
+    free(h->slots[i].path);
+  }
+
+  free(h->slots);
+  free(h);
+}
+
+void hints_put(hints_t *restrict h, const char *restrict path,
+               const long entries) {
+  if (entries < HINT_MIN_ENTRIES) {
+    return;
+  }
+
+  if (2 * (h->len + 1) > h->capacity) {
+    hints_grow(h);
+  }
+
+  const uint64_t hash = hash_path(path);
+  slot_t *slot = hints_find(h, path, hash);
+
+  if (!slot->path) {
+    slot->hash = hash;
+    slot->path = strdup(path);
+    h->len++;
+  }
+
+  slot->entries = entries;
+}
+
+long hints_get(const hints_t *restrict h, const char *restrict path) {
+  const slot_t *slot = hints_find(h, path, hash_path(path));
+
+  return slot->path ? slot->entries : 0;
+}
+
+// --------------- Definition of internal functions ------------------------- //
+
+static uint64_t hash_path(const char *path) {
+  uint64_t h = 14695981039346656037ULL;
+  for (; *path; path++) {
+    h = (h ^ (unsigned char)*path) * 1099511628211ULL;
+  }
+
+  return h;
+}
+
+static slot_t *hints_find(const hints_t *restrict h, const char *restrict path,
+                          const uint64_t hash) {
+  const long mask = h->capacity - 1;
+
+  for (long i = hash & mask;; i = (i + 1) & mask) {
+    slot_t *slot = &h->slots[i];
+    if (!slot->path ||
+        (slot->hash == hash && strcmp(slot->path, path) == 0)) {
+      return slot;
+    }
+  }
+}
+
+static void hints_grow(hints_t *h) {
+  slot_t *old = h->slots;
+  const long old_capacity = h->capacity;
+
+  h->capacity *= 2;
+  h->slots = calloc(h->capacity, sizeof(slot_t));
+
+  for (long i = 0; i < old_capacity; i++) {
+    if (old[i].path) {
+      *hints_find(h, old[i].path, old[i].hash) = old[i];
+    }
+  }
+
+  free(old);
+}
+
+static int slot_cmp_desc(const void *a, const void *b) {
+  const long ea = ((const slot_t *)a)->entries;
+  const long eb = ((const slot_t *)b)->entries;
+
+  return (ea < eb) - (ea > eb);
+}
@@ -8,65 +8,190 @@
  * @date 2025-10-20
  */
 
-// --------------- Preprocessor directives ---------------------------------- //
-
-// #define DEBUG
-
 // --------------- Headers -------------------------------------------------- //
 
-#include "thread_pool_competition.h"
-#include <dirent.h>
-#include <fcntl.h>
-#include <stdatomic.h>
+#include "estimate_competition.h"
+#include "mdu_scan_competition.h"
+#include "server_competition.h"
+#include <errno.h>
+#include <getopt.h>
+#include <grp.h>
+#include <pwd.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/stat.h>
-#include <sys/syscall.h>
+#include <time.h>
 #include <unistd.h>
 
 // --------------- Constants ------------------------------------------------ //
 
 #define NR_DEFAULT_THREADS 1
-#define MAX_NAME_LEN 350
-#define DIR_BUF_SIZE 1024
+#define DIFF_DEFAULT_TOP 10
+#define PROGRESS_INTERVAL 1.0 /* Seconds between two lines of --progress */
+#define POLL_INTERVAL 0.1     /* Seconds between checks for SIGINT */
+#define CHECKPOINT_INTERVAL 60.0 /* Seconds between two checkpoints */
 
 // --------------- Structs -------------------------------------------------- //
 
-typedef struct linux_dirent64 {
-  int64_t d_ino;  /* 64-bit inode number */
-  int64_t d_off;  /* Not an offset; see getdents() */
-  short d_reclen; /* Size of this dirent */
-  char d_type;    /* File type */
-  char d_name[];  /* Filename (null-terminated) */
-} linux_dirent64;
-
 /**
  * @typedef settings
  * @brief stores each cmdline option
  *
  */
 typedef struct settings {
-  short nr_threads; /* Amount of threads to use */
-  char **targets;   /* A list of files to count blocksize of */
+  short nr_threads;   /* Amount of threads to use, per process with --procs */
+  short stat_threads; /* Threads of a separate stat stage, 0 if disabled */
+  short device_jobs;  /* Directories of a device read at a time, 0 for all */
+  /* Order to run directories in */
+  tpool_schedule_t schedule;
+  int top_n;          /* Amount of entries to list with --top, 0 if disabled */
+  bool top_files;     /* List the largest files */
+  bool top_dirs;      /* List the largest directories */
+  bool summary;       /* Print counts and a size histogram */
+  bool inode_order;   /* Stat entries in inode order */
+  bool inodes;        /* Count inodes instead of blocks */
+  unsigned group_by;  /* Kinds to break the usage down by, 0 for none */
+  where_t *where;     /* Count only the entries matching, NULL for all */
+  bool progress;      /* Print progress to stderr while scanning */
+  double deadline;    /* Seconds before the scans stop, 0 for no limit */
+  long max_iops;      /* Opens and stats per second, 0 for no limit */
+  bool psi_backoff;   /* Lower the rate while there is I/O pressure */
+  long exceeds;       /* Stop once a total passes this, 0 for no limit */
+  bool background;    /* Run with idle CPU and I/O priority */
+  bool estimate;      /* Estimate the blocks by sampling */
+  double max_error;   /* Relative error the estimate has to reach */
+  double budget;      /* Seconds the estimate may take, 0 for no limit */
+  char *hints;        /* Cost hints file, read before and written after */
+  char *snapshot;     /* Write the blocks of every directory to this file */
+  char *checkpoint;   /* Save the scan to this file now and then, or NULL */
+  double checkpoint_interval; /* Seconds between two checkpoints */
+  checkpoint_t *resume; /* Checkpoint to carry on from, NULL for none */
+  char *stats_shm;    /* Publish live counters in this shared memory */
+  char *socket;       /* Serve queries on this socket instead of scanning */
+  int ttl;            /* Seconds the server caches a result */
+  int procs;          /* Processes of a sharded scan, 0 for one */
+  char **targets;     /* A list of files to count blocksize of */
 } settings;
 
+// --------------- Global vars ---------------------------------------------- //
+
+static volatile sig_atomic_t interrupted = 0; /* SIGINT was received */
+static stats_t *stats = NULL; /* Segment of --stats-shm, NULL if none */
+
 // --------------- Declaration of internal functions ------------------------ //
 
-void *count_dir(void *arg);
+/**
+ * @brief Wait for a scan while printing its progress. The scan is cancelled
+ * at DEADLINE or on SIGINT, which leaves partial results
+ *
+ * @param scan      A pointer to a struct of type mdu_scan_t
+ * @param opts      A pointer to a struct of settings
+ * @param deadline  The time to stop at on CLOCK_REALTIME, NULL for none
+ */
+static void wait_scan(mdu_scan_t *restrict scan,
+                      const settings *restrict opts,
+                      const struct timespec *restrict deadline);
+
+/**
+ * @brief Print a line of progress to stderr
+ *
+ * @param now       The counters now
+ * @param last      The counters of the last line
+ * @param seconds   The time between NOW and LAST
+ */
+static void print_progress(const mdu_progress_t *restrict now,
+                           const mdu_progress_t *restrict last,
+                           const double seconds);
 
 /**
- * @brief Appends two filenames into the aboslute path for f2. The memory
- * allocated needs to be freed by the caller
+ * @brief Add SECONDS to a time
  *
- * @param f1      The base name of the file
- * @param f2      The file to be appended
+ * @param ts        The time to change
+ * @param seconds   The seconds to add
+ */
+static void timespec_add(struct timespec *ts, const double seconds);
+
+/**
+ * @brief Compare two times
+ *
+ * @return          <0, 0 or >0 if A is before, equal to or after B
+ */
+static int timespec_cmp(const struct timespec *restrict a,
+                        const struct timespec *restrict b);
+
+/**
+ * @brief Signal handler for SIGINT, stops the scans like a deadline
+ *
+ * @param sig       The signal
+ */
+static void handle_interrupt(const int sig);
+
+/**
+ * @brief Parse a size such as "10G", in bytes with an optional binary suffix
+ * K, M, G or T
  *
- * @return        A pointer to the full name
+ * @param arg       The string to parse
+ * @return          The size, -1 if ARG is not a size
  */
-static inline char *append_filename(const char *restrict f1,
-                                    const char *restrict f2);
+static long parse_size(const char *arg);
+
+/**
+ * @brief Print the largest files or directories of a finished scan
+ *
+ * @param scan      A pointer to a struct of type mdu_scan_t
+ * @param title     A title to print before the entries
+ * @param files     True to print the files, else the directories
+ */
+static void print_top(mdu_scan_t *restrict scan, const char *restrict title,
+                      const bool files);
+
+/**
+ * @brief Print the summary of a finished scan
+ *
+ * @param total     The summary of the scan
+ */
+static void print_summary(const mdu_summary_t *total);
+
+/**
+ * @brief Print the usage of a finished scan by one kind of --group-by
+ *
+ * @param scan      A pointer to a struct of type mdu_scan_t
+ * @param kind      The kind to print
+ */
+static void print_groups(mdu_scan_t *scan, const group_kind_t kind);
+
+/**
+ * @brief Estimate and print the blocks of every target
+ *
+ * @param opts      A pointer to a struct of settings
+ * @param prog      The name of the program
+ * @return          The exit code
+ */
+static short run_estimate(const settings *restrict opts,
+                          const char *restrict prog);
+
+/**
+ * @brief Scan every target with --procs processes and print the blocks
+ *
+ * @param opts      A pointer to a struct of settings
+ * @param prog      The name of the program
+ * @return          The exit code
+ */
+static short run_procs(const settings *restrict opts,
+                       const char *restrict prog);
+
+/**
+ * @brief Run "mdu diff": compare two snapshots and print the directories
+ * which grew and shrank the most
+ *
+ * @param argc    nr of args, starting at "diff"
+ * @param argv    an array of args as strings, starting at "diff"
+ *
+ * @return        the exit code
+ */
+static int run_diff(const short argc, char *argv[]);
 
 /**
  * @brief Parses the cmd line args and sores them in a struct. If targets were
@@ -100,134 +225,746 @@ static void cleanup_and_exit(settings *restrict opts, tpool_t *restrict pool,
 
 // --------------- Definitions of internal functions ------------------------ //
 
-#ifdef DEBUG
-atomic_int max_name_len;
-char *max_name;
-#endif /* ifdef DEBUG */
-
-tpool_t *pool;
-atomic_int sum;
-
 int main(int argc, char *argv[]) {
+  if (argc > 1 && strcmp(argv[1], "diff") == 0) {
+    return run_diff(argc - 1, argv + 1);
+  }
+
   settings *opts = set_settings(argc, argv);
-  pool = tpool_create(opts->nr_threads, count_dir);
+  if (!opts) {
+    return EXIT_FAILURE;
+  }
+
+  // before any thread is started, so that every thread inherits it
+  if (opts->background && mdu_background()) {
+    fprintf(stderr, "%s: could not lower the priority\n", argv[0]);
+  }
+
+  if (opts->estimate) {
+    cleanup_and_exit(opts, NULL, run_estimate(opts, argv[0]));
+  }
+
+  // forked before any thread is started, every process starts its own
+  if (opts->procs) {
+    cleanup_and_exit(opts, NULL, run_procs(opts, argv[0]));
+  }
+
+  // a single thread not shared with a server or a monitor is left to every
+  // scan to create, so that it walks the tree sequentially
+  const bool shared = opts->nr_threads > 1 || opts->socket || opts->stats_shm;
+  tpool_t *pool = shared
+                      ? mdu_pool_create_schedule(opts->nr_threads,
+                                                 opts->schedule)
+                      : NULL;
+  short exit_code = EXIT_SUCCESS;
+
+  // a monitor is optional, the scans run without it
+  if (opts->stats_shm) {
+    stats = stats_create(opts->stats_shm, opts->nr_threads,
+                         opts->nr_threads + opts->stat_threads);
+    if (stats) {
+      tpool_set_counters(pool, stats_pool(stats));
+    } else {
+      fprintf(stderr, "%s: cannot create '%s': %s\n", argv[0],
+              opts->stats_shm, strerror(errno));
+    }
+  }
+
+  if (opts->socket) {
+    server_options_t server_opts;
+    server_options_init(&server_opts);
+    server_opts.pool = pool;
+    if (opts->ttl >= 0) {
+      server_opts.ttl = opts->ttl;
+    }
+
+    if (mdu_serve(opts->socket, &server_opts)) {
+      exit_code = EXIT_FAILURE;
+    }
+    cleanup_and_exit(opts, pool, exit_code);
+  }
+
+  mdu_options_t scan_opts;
+  mdu_options_init(&scan_opts);
+  scan_opts.nr_threads = opts->nr_threads;
+  scan_opts.pool = pool;
+  scan_opts.top_n = opts->top_n;
+  scan_opts.top_files = opts->top_files;
+  scan_opts.top_dirs = opts->top_dirs;
+  scan_opts.summary = opts->summary;
+  scan_opts.stat_threads = opts->stat_threads;
+  scan_opts.device_jobs = opts->device_jobs;
+  scan_opts.inode_order = opts->inode_order;
+  scan_opts.inodes = opts->inodes;
+  scan_opts.group_by = opts->group_by;
+  scan_opts.where = opts->where;
+  scan_opts.max_iops = opts->max_iops;
+  scan_opts.iops_backoff = opts->psi_backoff;
+  scan_opts.exceeds = opts->exceeds;
+  scan_opts.stats = stats;
+  scan_opts.checkpoints = opts->checkpoint != NULL;
+  scan_opts.resume = opts->resume;
+
+  if (opts->hints) {
+    // a missing file is fine, it is created after the first run
+    scan_opts.hints = hints_load(opts->hints);
+    scan_opts.hints_out = hints_create();
+  }
+  if (opts->snapshot) {
+    scan_opts.snapshot_out = snapshot_builder_create();
+  }
+
+  // no SA_RESTART, so a SIGINT to this thread ends the wait in wait_scan()
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = handle_interrupt;
+  sigaction(SIGINT, &sa, NULL);
 
-#ifdef DEBUG
-  atomic_init(&max_name_len, 0);
-#endif /* ifdef DEBUG */
+  // one deadline for every target
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  timespec_add(&deadline, opts->deadline);
 
+  bool partial = false;
   for (short i = 0; opts->targets[i] != NULL; i++) {
-    atomic_init(&sum, 0);
+    mdu_scan_t *scan = mdu_scan_start(opts->targets[i], &scan_opts);
+    if (!scan) {
+      fprintf(stderr, "%s: cannot access '%s'\n", argv[0], opts->targets[i]);
+      exit_code = EXIT_FAILURE;
+      continue;
+    }
 
-    struct stat filestat;
-    lstat(opts->targets[i], &filestat);
-    atomic_fetch_add(&sum, filestat.st_blocks);
+    wait_scan(scan, opts, opts->deadline > 0 ? &deadline : NULL);
+
+    const long unscanned = mdu_scan_unscanned(scan);
+    if (mdu_scan_exceeded(scan)) {
+      partial = partial || unscanned;
+      printf("%ld\t%s\texceeds %ld\n", mdu_scan_blocks(scan),
+             opts->targets[i], opts->exceeds);
+    } else if (unscanned) {
+      partial = true;
+      printf("%ld\t%s\tpartial, %ld directories unscanned\n",
+             mdu_scan_blocks(scan), opts->targets[i], unscanned);
+    } else {
+      printf("%ld\t%s\n", mdu_scan_blocks(scan), opts->targets[i]);
+    }
 
-    tpool_add_work(pool, strdup(opts->targets[i]));
+    // a finished scan has nothing left to resume
+    if (opts->checkpoint && !unscanned) {
+      unlink(opts->checkpoint);
+    }
 
-    tpool_wait(pool);
+    if (opts->top_files) {
+      print_top(scan, "files", true);
+    }
+    if (opts->top_dirs) {
+      print_top(scan, "directories", false);
+    }
+    if (opts->summary) {
+      print_summary(mdu_scan_summary(scan));
+    }
+    for (int k = 0; k < GROUP_KINDS; k++) {
+      if (opts->group_by & (1U << k)) {
+        print_groups(scan, k);
+      }
+    }
 
-    printf("%d\t%s\n", atomic_load(&sum), opts->targets[i]);
+    mdu_scan_destroy(scan);
   }
 
-#ifdef DEBUG
-  printf("\n\n----- STATS -----\n");
-  printf("Max name len: %d\n", atomic_load(&max_name_len));
-  printf("Max name: %s\n", max_name);
-#endif /* ifdef DEBUG */
+  // partial results would mislead the next run and "mdu diff"
+  if (partial && (opts->hints || opts->snapshot)) {
+    fprintf(stderr, "%s: the scan was stopped, %s not written\n", argv[0],
+            opts->hints && opts->snapshot ? "hints and snapshot"
+            : opts->hints                  ? "hints"
+                                           : "snapshot");
+  }
 
-  // TODO: remove cleanup? use -
-  // _exit(EXIT_SUCCESS);
-  cleanup_and_exit(opts, pool, EXIT_SUCCESS);
-}
+  if (opts->hints) {
+    if (!partial && hints_save(scan_opts.hints_out, opts->hints)) {
+      perror(opts->hints);
+      exit_code = EXIT_FAILURE;
+    }
 
-void *count_dir(void *arg) {
-  char *filename = (char *)arg;
-  const short fd = open(filename, O_RDONLY | O_DIRECTORY | O_NONBLOCK);
-  if (fd < 0) {
-    free(filename);
-    return NULL;
+    hints_destroy((hints_t *)scan_opts.hints);
+    hints_destroy(scan_opts.hints_out);
   }
 
-  char buf[DIR_BUF_SIZE];
-  short nread;
+  if (opts->snapshot) {
+    if (!partial &&
+        snapshot_builder_write(scan_opts.snapshot_out, opts->snapshot)) {
+      perror(opts->snapshot);
+      exit_code = EXIT_FAILURE;
+    }
 
-  while ((nread = syscall(SYS_getdents64, fd, buf, sizeof(buf))) > 0) {
-    for (register short bpos = 0; bpos < nread;) {
-      struct linux_dirent64 *d = (struct linux_dirent64 *)(buf + bpos);
-      bpos += d->d_reclen;
+    snapshot_builder_destroy(scan_opts.snapshot_out);
+  }
 
-      if (strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0) {
-        continue; // skip current and parent directory
-      }
+  cleanup_and_exit(opts, pool, exit_code);
+}
 
-      struct stat filestat;
-      fstatat(fd, d->d_name, &filestat, AT_SYMLINK_NOFOLLOW);
-      atomic_fetch_add(&sum, filestat.st_blocks);
+static void wait_scan(mdu_scan_t *restrict scan,
+                      const settings *restrict opts,
+                      const struct timespec *restrict deadline) {
+  const double interval = opts->progress ? PROGRESS_INTERVAL : POLL_INTERVAL;
+  mdu_progress_t last = {0, 0, 0, 0};
+
+  struct timespec tick;
+  clock_gettime(CLOCK_REALTIME, &tick);
+  struct timespec checkpoint = tick;
+  timespec_add(&tick, interval);
+  timespec_add(&checkpoint, opts->checkpoint_interval);
+
+  for (;;) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    if (interrupted || (deadline && timespec_cmp(&now, deadline) >= 0)) {
+      // saved before the cancel, which leaves directories half counted
+      if (opts->checkpoint && mdu_scan_checkpoint(scan, opts->checkpoint)) {
+        perror(opts->checkpoint);
+      }
+      mdu_scan_cancel(scan);
+      mdu_scan_wait(scan);
+      return;
+    }
 
-#ifdef DEBUG
-      fprintf(stderr, "sum file: %s\n", d->d_name);
-#endif /* ifdef DEBUG */
+    if (timespec_cmp(&now, &tick) >= 0) {
+      if (opts->progress) {
+        mdu_progress_t progress;
+        mdu_scan_progress(scan, &progress);
+        print_progress(&progress, &last, interval);
+        last = progress;
+      }
+      timespec_add(&tick, interval);
+    }
 
-      if (d->d_type != DT_DIR) {
-        continue; // dont add files to jobs
+    if (opts->checkpoint && timespec_cmp(&now, &checkpoint) >= 0) {
+      if (mdu_scan_checkpoint(scan, opts->checkpoint)) {
+        perror(opts->checkpoint);
       }
+      timespec_add(&checkpoint, opts->checkpoint_interval);
+    }
 
-      tpool_add_work(pool, append_filename(filename, d->d_name));
+    const bool at_deadline = deadline && timespec_cmp(deadline, &tick) < 0;
+    if (mdu_scan_timedwait(scan, at_deadline ? deadline : &tick)) {
+      return;
     }
   }
+}
+
+static void print_progress(const mdu_progress_t *restrict now,
+                           const mdu_progress_t *restrict last,
+                           const double seconds) {
+  static const char units[] = "BKMGTPE";
+
+  double size = now->blocks * 512.0;
+  short unit = 0;
+  for (; size >= 1024 && units[unit + 1]; unit++) {
+    size /= 1024;
+  }
 
-  free(filename);
-  close(fd);
-  return NULL;
+  fprintf(stderr,
+          "%ld entries\t%.0f entries/s\t%.1f%c\t%ld pending\t%ld peak\n",
+          now->entries, (now->entries - last->entries) / seconds, size,
+          units[unit], now->pending, now->peak_pending);
 }
 
-static inline char *append_filename(const char *restrict f1,
-                                    const char *restrict f2) {
-  short base_len = strlen(f1);
-  short name_len = strlen(f2);
-  short tot_len = name_len + base_len + 2;
-  char *new_file = malloc(tot_len * sizeof(char));
+static void timespec_add(struct timespec *ts, const double seconds) {
+  const long ns = ts->tv_nsec + (long)((seconds - (long)seconds) * 1e9);
 
-  memcpy(new_file, f1, base_len);
+  ts->tv_sec += (long)seconds + ns / 1000000000;
+  ts->tv_nsec = ns % 1000000000;
+}
 
-  if (f1[base_len - 1] != '/')
-    new_file[base_len++] = '/';
+static int timespec_cmp(const struct timespec *restrict a,
+                        const struct timespec *restrict b) {
+  if (a->tv_sec != b->tv_sec) {
+    return a->tv_sec < b->tv_sec ? -1 : 1;
+  }
 
-  memcpy(new_file + base_len, f2, name_len);
-  new_file[base_len + name_len] = '\0';
+  return (a->tv_nsec > b->tv_nsec) - (a->tv_nsec < b->tv_nsec);
+}
 
-#ifdef DEBUG
-  if (name_len > atomic_load(&max_name_len)) {
-    atomic_store(&max_name_len, name_len);
-    max_name = strdup(f2);
+static void handle_interrupt(const int sig) {
+  (void)sig;
+  interrupted = 1;
+}
+
+static long parse_size(const char *arg) {
+  char *end;
+  long size = strtol(arg, &end, 10);
+  if (end == arg || size < 0) {
+    return -1;
+  }
+
+  const char *suffix = strchr("KMGT", *end);
+  if (*end != '\0' && (!suffix || end[1] != '\0')) {
+    return -1;
+  }
+  for (short shift = *end ? suffix - "KMGT" + 1 : 0; shift > 0; shift--) {
+    size *= 1024;
   }
-#endif /* ifdef DEBUG */
 
-  return new_file;
+  return size;
+}
+
+static void print_top(mdu_scan_t *restrict scan, const char *restrict title,
+                      const bool files) {
+  int len;
+  const heap_entry_t *top = mdu_scan_top(scan, files, &len);
+
+  printf("\n# largest %s\n", title);
+  for (int i = 0; i < len; i++) {
+    printf("%ld\t%s\n", top[i].key, top[i].val);
+  }
+}
+
+static void print_summary(const mdu_summary_t *total) {
+  static const char units[] = "BKMGTPE";
+
+  printf("\n# summary\n");
+  printf("files\t%ld\n", total->files);
+  printf("directories\t%ld\n", total->dirs);
+  printf("symlinks\t%ld\n", total->symlinks);
+  printf("other\t%ld\n", total->others);
+  printf("inodes\t%ld\n",
+         total->files + total->dirs + total->symlinks + total->others);
+
+  printf("\n# file size histogram\n");
+  for (short k = 0; k < MDU_HIST_BUCKETS; k++) {
+    if (!total->hist[k]) {
+      continue;
+    }
+
+    // lower bound of the bucket, printed with a binary unit
+    const short shift = k ? k - 1 : 0;
+    printf("%s%lu%c\t%ld\n", k ? ">=" : "==", k ? 1UL << (shift % 10) : 0,
+           units[shift / 10], total->hist[k]);
+  }
+}
+
+static void print_groups(mdu_scan_t *scan, const group_kind_t kind) {
+  long len;
+  const group_entry_t *groups = mdu_scan_groups(scan, kind, &len);
+
+  printf("\n# by %s\n", group_kind_name(kind));
+  for (long i = 0; i < len; i++) {
+    const group_entry_t *g = &groups[i];
+    printf("%ld\t%ld\t", g->blocks, g->entries);
+
+    // owners and groups by name when they have one
+    const struct passwd *pw = kind == GROUP_UID ? getpwuid(g->id) : NULL;
+    const struct group *gr = kind == GROUP_GID ? getgrgid(g->id) : NULL;
+    if (pw) {
+      printf("%s\n", pw->pw_name);
+    } else if (gr) {
+      printf("%s\n", gr->gr_name);
+    } else if (kind == GROUP_EXT) {
+      printf("%s\n", g->ext[0] ? g->ext : "(none)");
+    } else if (kind == GROUP_AGE) {
+      printf("%s\n", group_age_name(g->id));
+    } else {
+      printf("%lu\n", (unsigned long)g->id);
+    }
+  }
+}
+
+static short run_estimate(const settings *restrict opts,
+                          const char *restrict prog) {
+  estimate_options_t est_opts;
+  estimate_options_init(&est_opts);
+  est_opts.nr_threads = opts->nr_threads;
+  est_opts.max_error = opts->max_error;
+  est_opts.budget = opts->budget;
+
+  short exit_code = EXIT_SUCCESS;
+  for (short i = 0; opts->targets[i] != NULL; i++) {
+    estimate_t est;
+    if (estimate_blocks(opts->targets[i], &est_opts, &est)) {
+      fprintf(stderr, "%s: cannot access '%s'\n", prog, opts->targets[i]);
+      exit_code = EXIT_FAILURE;
+      continue;
+    }
+
+    printf("%.0f\t%s\t+-%.1f%%\t(%ld probes, %ld directories read)\n",
+           est.blocks, opts->targets[i],
+           est.blocks > 0 ? 100 * est.error / est.blocks : 0.0, est.probes,
+           est.reads);
+  }
+
+  return exit_code;
+}
+
+static short run_procs(const settings *restrict opts,
+                       const char *restrict prog) {
+  mdu_options_t scan_opts;
+  mdu_options_init(&scan_opts);
+  scan_opts.nr_threads = opts->nr_threads;
+  scan_opts.summary = opts->summary;
+  scan_opts.inode_order = opts->inode_order;
+  scan_opts.inodes = opts->inodes;
+  scan_opts.where = opts->where;
+
+  short exit_code = EXIT_SUCCESS;
+  for (short i = 0; opts->targets[i] != NULL; i++) {
+    mdu_summary_t summary;
+    const long blocks =
+        mdu_du_procs(opts->targets[i], &scan_opts, opts->procs, &summary);
+    if (blocks < 0) {
+      fprintf(stderr, "%s: cannot access '%s'\n", prog, opts->targets[i]);
+      exit_code = EXIT_FAILURE;
+      continue;
+    }
+
+    printf("%ld\t%s\n", blocks, opts->targets[i]);
+    if (opts->summary) {
+      print_summary(&summary);
+    }
+  }
+
+  return exit_code;
+}
+
+static int run_diff(const short argc, char *argv[]) {
+  short nr_threads = NR_DEFAULT_THREADS;
+  int top_n = DIFF_DEFAULT_TOP;
+
+  static const struct option long_opts[] = {
+      {"top", required_argument, NULL, 't'},
+      {NULL, 0, NULL, 0},
+  };
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "j:", long_opts, NULL)) != -1) {
+    if (opt == 'j') {
+      nr_threads = atoi(optarg);
+    } else if (opt == 't') {
+      top_n = atoi(optarg);
+    } else {
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (argc - optind != 2 || nr_threads < 1 || top_n < 1) {
+    fprintf(stderr, "usage: mdu diff [-j THREADS] [--top N] OLD NEW\n");
+    return EXIT_FAILURE;
+  }
+
+  snapshot_t *old = snapshot_open(argv[optind]);
+  snapshot_t *new = snapshot_open(argv[optind + 1]);
+  if (!old || !new) {
+    fprintf(stderr, "mdu diff: cannot read snapshot '%s'\n",
+            argv[old ? optind + 1 : optind]);
+    snapshot_close(old);
+    snapshot_close(new);
+    return EXIT_FAILURE;
+  }
+
+  heap_t *grew = heap_create(top_n);
+  heap_t *shrank = heap_create(top_n);
+  snapshot_diff(old, new, nr_threads, top_n, grew, shrank);
+
+  int len;
+  const heap_entry_t *top = heap_sorted(grew, &len);
+  printf("# grew\n");
+  for (int i = 0; i < len; i++) {
+    printf("+%ld\t%s\n", top[i].key, top[i].val);
+  }
+
+  top = heap_sorted(shrank, &len);
+  printf("\n# shrank\n");
+  for (int i = 0; i < len; i++) {
+    printf("-%ld\t%s\n", top[i].key, top[i].val);
+  }
+
+  heap_destroy(grew);
+  heap_destroy(shrank);
+  snapshot_close(old);
+  snapshot_close(new);
+
+  return EXIT_SUCCESS;
 }
 
 static settings *set_settings(short argc, char *argv[]) {
   settings *opts = malloc(sizeof(settings));
 
   opts->nr_threads = NR_DEFAULT_THREADS;
+  opts->stat_threads = 0;
+  opts->device_jobs = 0;
+  opts->schedule = TPOOL_LIFO;
+  opts->top_n = 0;
+  opts->top_files = false;
+  opts->top_dirs = false;
+  opts->summary = false;
+  opts->inode_order = false;
+  opts->inodes = false;
+  opts->group_by = 0;
+  opts->where = NULL;
+  opts->hints = NULL;
+  opts->snapshot = NULL;
+  opts->checkpoint = NULL;
+  opts->checkpoint_interval = CHECKPOINT_INTERVAL;
+  opts->resume = NULL;
+  opts->stats_shm = NULL;
+  opts->progress = false;
+  opts->deadline = 0;
+  opts->max_iops = 0;
+  opts->psi_backoff = false;
+  opts->exceeds = 0;
+  opts->background = false;
+  opts->estimate = false;
+  opts->max_error = 0.02;
+  opts->budget = 0;
+  opts->socket = NULL;
+  opts->ttl = -1;
+  opts->procs = 0;
+  opts->targets = NULL;
+
+  static const struct option long_opts[] = {
+      {"top", required_argument, NULL, 't'},
+      {"summary", no_argument, NULL, 's'},
+      {"inode-order", no_argument, NULL, 'i'},
+      {"inodes", no_argument, NULL, 'n'},
+      {"count", no_argument, NULL, 'n'},
+      {"group-by", required_argument, NULL, 'g'},
+      {"where", required_argument, NULL, 'w'},
+      {"stat-threads", required_argument, NULL, 'P'},
+      {"hints", required_argument, NULL, 'H'},
+      {"snapshot", required_argument, NULL, 'o'},
+      {"checkpoint", required_argument, NULL, 'K'},
+      {"checkpoint-interval", required_argument, NULL, 'k'},
+      {"resume", required_argument, NULL, 'r'},
+      {"deadline", required_argument, NULL, 'D'},
+      {"progress", no_argument, NULL, 'p'},
+      {"stats-shm", required_argument, NULL, 'M'},
+      {"max-iops", required_argument, NULL, 'I'},
+      {"psi-backoff", no_argument, NULL, 'R'},
+      {"exceeds", required_argument, NULL, 'x'},
+      {"background", no_argument, NULL, 'b'},
+      {"device-jobs", required_argument, NULL, 'd'},
+      {"schedule", required_argument, NULL, 'C'},
+      {"estimate", no_argument, NULL, 'e'},
+      {"error", required_argument, NULL, 'E'},
+      {"budget", required_argument, NULL, 'B'},
+      {"serve", required_argument, NULL, 'S'},
+      {"ttl", required_argument, NULL, 'T'},
+      {"procs", required_argument, NULL, 'N'},
+      {NULL, 0, NULL, 0},
+  };
 
   // set flags
-  short opt;
-  while ((opt = getopt(argc, argv, "j:")) != -1) {
+  const char *where = NULL;
+  const char *resume = NULL;
+  int opt;
+  while ((opt = getopt_long(argc, argv, "j:", long_opts, NULL)) != -1) {
     if (opt == 'j') {
       opts->nr_threads = atoi(optarg);
+    } else if (opt == 't') {
+      // --top N files|dirs, given twice with the same N to list both. The
+      // kind is required, so a target is never taken for one
+      const int top_n = atoi(optarg);
+      const char *kind = optind < argc ? argv[optind] : "";
+      const bool files = strcmp(kind, "files") == 0;
+      if ((!files && strcmp(kind, "dirs")) ||
+          (opts->top_n && opts->top_n != top_n)) {
+        fprintf(stderr, "%s: --top takes a count and files or dirs\n",
+                argv[0]);
+        free_settings(opts);
+        return NULL;
+      }
+      opts->top_n = top_n;
+      opts->top_files |= files;
+      opts->top_dirs |= !files;
+      optind++;
+    } else if (opt == 's') {
+      opts->summary = true;
+    } else if (opt == 'P') {
+      opts->stat_threads = atoi(optarg);
+    } else if (opt == 'i') {
+      opts->inode_order = true;
+    } else if (opt == 'n') {
+      opts->inodes = true;
+    } else if (opt == 'g') {
+      // a repeated --group-by adds its kinds to the earlier ones
+      const unsigned kinds = groups_parse(optarg);
+      if (!kinds) {
+        fprintf(stderr, "%s: unknown grouping '%s'\n", argv[0], optarg);
+        free_settings(opts);
+        return NULL;
+      }
+      opts->group_by |= kinds;
+    } else if (opt == 'w') {
+      where = optarg;
+    } else if (opt == 'e') {
+      opts->estimate = true;
+    } else if (opt == 'E') {
+      opts->max_error = atof(optarg) / 100;
+    } else if (opt == 'B') {
+      opts->budget = atof(optarg);
+    } else if (opt == 'D') {
+      opts->deadline = atof(optarg);
+    } else if (opt == 'p') {
+      opts->progress = true;
+    } else if (opt == 'M') {
+      opts->stats_shm = optarg;
+    } else if (opt == 'I') {
+      opts->max_iops = atol(optarg);
+    } else if (opt == 'R') {
+      opts->psi_backoff = true;
+    } else if (opt == 'x') {
+      opts->exceeds = parse_size(optarg);
+    } else if (opt == 'b') {
+      opts->background = true;
+    } else if (opt == 'C') {
+      if (strcmp(optarg, "lifo") == 0) {
+        opts->schedule = TPOOL_LIFO;
+      } else if (strcmp(optarg, "fifo") == 0) {
+        opts->schedule = TPOOL_FIFO;
+      } else if (strcmp(optarg, "hybrid") == 0) {
+        opts->schedule = TPOOL_HYBRID;
+      } else {
+        fprintf(stderr, "%s: unknown schedule '%s'\n", argv[0], optarg);
+        free_settings(opts);
+        return NULL;
+      }
+    } else if (opt == 'd') {
+      opts->device_jobs =
+          strcmp(optarg, "auto") == 0 ? MDU_DEVICE_AUTO : atoi(optarg);
+    } else if (opt == 'o') {
+      opts->snapshot = optarg;
+    } else if (opt == 'K') {
+      opts->checkpoint = optarg;
+    } else if (opt == 'k') {
+      opts->checkpoint_interval = atof(optarg);
+    } else if (opt == 'r') {
+      resume = optarg;
+    } else if (opt == 'H') {
+      opts->hints = optarg;
+    } else if (opt == 'S') {
+      opts->socket = optarg;
+    } else if (opt == 'T') {
+      opts->ttl = atoi(optarg);
+    } else if (opt == 'N') {
+      opts->procs = atoi(optarg);
     } else {
-      free(opts);
+      free_settings(opts);
       return NULL;
     }
   }
 
+  const bool bad_value =
+      opts->nr_threads < 1 || opts->stat_threads < 0 ||
+      (opts->device_jobs < 0 && opts->device_jobs != MDU_DEVICE_AUTO) ||
+      opts->max_error <= 0 || opts->budget < 0 || opts->deadline < 0 ||
+      opts->max_iops < 0 || opts->exceeds < 0 ||
+      (!opts->inodes && opts->exceeds && opts->exceeds < 512) ||
+      ((opts->top_files || opts->top_dirs) && opts->top_n < 1) ||
+      opts->checkpoint_interval <= 0 || opts->procs < 0;
+
+  // options a mode would ignore are rejected rather than silently dropped
+  const bool bad_estimate =
+      opts->estimate && (opts->inodes || opts->group_by || where ||
+                         opts->top_n || opts->summary || opts->snapshot);
+  const bool bad_serve =
+      opts->socket &&
+      (where || opts->top_n || opts->summary || opts->inodes ||
+       opts->group_by || opts->stat_threads || opts->device_jobs ||
+       opts->inode_order || opts->hints || opts->snapshot || opts->estimate ||
+       opts->deadline || opts->exceeds || opts->max_iops ||
+       opts->psi_backoff || opts->progress || opts->background);
+  const bool bad_checkpoint =
+      (opts->checkpoint || resume) &&
+      (opts->estimate || opts->socket || opts->top_n || opts->group_by ||
+       opts->stat_threads || opts->device_jobs || opts->hints ||
+       opts->snapshot);
+  const bool bad_procs =
+      opts->procs &&
+      (opts->estimate || opts->socket || opts->stats_shm || opts->top_n ||
+       opts->group_by || opts->stat_threads || opts->device_jobs ||
+       opts->hints || opts->snapshot || opts->checkpoint || resume ||
+       opts->deadline || opts->exceeds || opts->max_iops || opts->progress ||
+       opts->schedule != TPOOL_LIFO);
+
+  if (bad_value || bad_estimate || bad_serve || bad_checkpoint || bad_procs) {
+    fprintf(stderr, "%s: invalid argument\n", argv[0]);
+    free_settings(opts);
+    return NULL;
+  }
+
+  // given in bytes, but the scan counts 512 byte blocks
+  if (!opts->inodes) {
+    opts->exceeds /= 512;
+  }
+
+  if (resume && !(opts->resume = checkpoint_load(resume))) {
+    fprintf(stderr, "%s: cannot read checkpoint '%s'\n", argv[0], resume);
+    free_settings(opts);
+    return NULL;
+  }
+
+  // compiled once, every age is taken from the start of the first run
+  const time_t now = opts->resume ? opts->resume->now : time(NULL);
+  if (where && !(opts->where = where_compile(where, now))) {
+    fprintf(stderr, "%s: invalid predicate '%s'\n", argv[0], where);
+    free_settings(opts);
+    return NULL;
+  }
+
+  // resumed totals only add up with what they were counted with
+  const unsigned flags = (opts->inodes ? CHECKPOINT_INODES : 0) |
+                         (opts->summary ? CHECKPOINT_SUMMARY : 0);
+  if (opts->resume &&
+      (opts->resume->flags != flags || !opts->resume->where != !where ||
+       (where && strcmp(opts->resume->where, where)))) {
+    fprintf(stderr, "%s: '%s' was saved with other options\n", argv[0],
+            resume);
+    free_settings(opts);
+    return NULL;
+  }
+
   // set targets
   const short len = argc - optind;
+  if (opts->resume && len == 0) {
+    opts->targets = calloc(2, sizeof(char *));
+    opts->targets[0] = opts->resume->root;
+    return opts;
+  }
+  const bool one_target =
+      len == 1 && (!opts->resume || !strcmp(argv[optind], opts->resume->root));
+  if ((opts->checkpoint || opts->resume) && !one_target) {
+    fprintf(stderr, "%s: a checkpoint covers one target%s%s\n", argv[0],
+            opts->resume ? ", " : "", opts->resume ? opts->resume->root : "");
+    free_settings(opts);
+    return NULL;
+  }
+  if (opts->socket && len > 0) {
+    fprintf(stderr, "%s: --serve takes its targets from the clients\n",
+            argv[0]);
+    free_settings(opts);
+    return NULL;
+  }
+  if (opts->socket) {
+    return opts;
+  }
   if (len == 0) { // no targets given
-    fprintf(stderr, "usage: %s [FILE]...\n", argv[0]);
-    free(opts);
+    fprintf(stderr,
+            "usage: %s [-j THREADS] [--stat-threads N] [--top N files|dirs]... "
+            "[--summary] [--group-by uid,gid,ext,age] [--where EXPR] "
+            "[--inode-order] [--inodes] [--hints FILE] "
+            "[--checkpoint FILE [--checkpoint-interval SECONDS]] "
+            "[--resume FILE] [--procs N] "
+            "[--snapshot FILE] [--deadline SECONDS] [--progress] "
+            "[--stats-shm NAME] [--exceeds SIZE] "
+            "[--max-iops N [--psi-backoff]] [--background] "
+            "[--device-jobs N|auto] [--schedule lifo|fifo|hybrid] [FILE]...\n"
+            "       %s [-j THREADS] --estimate [--error PERCENT] "
+            "[--budget SECONDS] [FILE]...\n"
+            "       %s [-j THREADS] --serve SOCKET [--ttl SECONDS] "
+            "[--stats-shm NAME]\n"
+            "       %s diff [-j THREADS] [--top N] OLD NEW\n",
+            argv[0], argv[0], argv[0], argv[0]);
+    free_settings(opts);
     return NULL;
   }
 
@@ -253,6 +990,8 @@ static void free_settings(settings *s) {
     free(s->targets);
   }
 
+  where_destroy(s->where);
+  checkpoint_destroy(s->resume);
   free(s);
 }
 
@@ -260,6 +999,7 @@ static void cleanup_and_exit(settings *restrict s, tpool_t *restrict p,
                              const short exit_code) {
   free_settings(s);
   tpool_destroy(p);
+  stats_destroy(stats); // after the pool, its workers write to it
 
   exit(exit_code);
 }
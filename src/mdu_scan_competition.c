@@ -0,0 +1,2471 @@
+/**
+ * This module implements the scanner used by mdu, see mdu_scan_competition.h.
+ * Every job carries the scan it belongs to, so a pool can run jobs from many
+ * scans at once. Workers gather results in per scan and per worker local_t
+ * structs, which are merged when the scan is waited for.
+ *
+ * With mdu_options_t.stat_threads the scan is pipelined: workers of the pool
+ * only enumerate directories and queue every getdents buffer as a batch_t,
+ * which the stat threads of the scan count. A batch holds a reference to the
+ * file descriptor and to the pending count of its directory.
+ *
+ * The loop over the entries of a directory is compiled once per combination of
+ * the features which cost a branch per entry, see FEATURE_SETS. A scan picks
+ * its kernel when it starts, so a plain scan runs a loop without any of them.
+ * Build with -DMDU_GENERIC_KERNEL to test every feature at run time instead.
+ *
+ * With mdu_options_t.device_jobs every directory belongs to a device_t of its
+ * st_dev, which hands out a limited amount of slots. A job taken from the pool
+ * when its device is full is parked on the device, and the job releasing a
+ * slot hands it directly to a parked job and puts that back in the pool.
+ *
+ * With mdu_options_t.fs every open, getdents, stat and close goes through the
+ * backend. Those scans use a kernel which tests the features at run time, the
+ * cost of a call of the backend hides a branch per entry anyway. So do scans
+ * with mdu_options_t.group_by, for the cost of the hash tables, and with
+ * mdu_options_t.where, which already branches per term.
+ *
+ * A scan on a pool of one worker it created itself is sequential: the root job
+ * walks the whole tree itself with count_tree(), depth first on an explicit
+ * stack. The path of the current directory is kept in one buffer and the
+ * names of the subdirectories left to visit in another, so no job is
+ * allocated or queued and nothing is shared with another thread but the
+ * progress counters. A shared pool is left free to interleave other scans.
+ *
+ * mdu_scan_checkpoint() cuts a scan between jobs. Workers taking a job of the
+ * scan while HOLDING is set put it on a list instead of counting it, and the
+ * cut is consistent once every pending job is on that list: each directory is
+ * then either counted in full or held. The list is the frontier to save, and
+ * the jobs go back to the pool as soon as it is copied.
+ *
+ * mdu_du_procs() runs a scan per process. The scan of the root and every scan
+ * after it hand a subdirectory to the shard_t instead of the pool while
+ * another process waits for work, and a process takes its share of the queue
+ * as a checkpoint to resume from, so the directories handed over are counted
+ * like the frontier of a cut.
+ *
+ * @file mdu_scan_competition.c
+ * @author Elias Svensson (c24esn@cs.umu.se)
+ * @date 2025-10-30
+ */
+
+// --------------- Preprocessor directives ---------------------------------- //
+
+#define _GNU_SOURCE // SCHED_IDLE
+
+// #define DEBUG
+
+// --------------- Headers -------------------------------------------------- //
+
+#include "mdu_scan_competition.h"
+#include "queue_competition.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sysmacros.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <threads.h>
+#include <unistd.h>
+
+// --------------- Constants ------------------------------------------------ //
+
+#define IOPRIO_WHO_PROCESS 1  /* From linux/ioprio.h */
+#define IOPRIO_IDLE (3 << 13) /* IOPRIO_PRIO_VALUE(IOPRIO_CLASS_IDLE, 0) */
+
+#define DIR_BUF_SIZE 1024
+#define BATCH_BUF_SIZE 32768            /* getdents buffer in inode order */
+#define BATCH_MAX (BATCH_BUF_SIZE / 24) /* 24 is the smallest d_reclen */
+#define STAGE_BUF_SIZE 4096             /* getdents buffer of a batch_t */
+#define STAGE_QUEUE_LEN 1024            /* Batches queued for stat threads */
+#define MAX_DEVICES 64     /* Devices limited by a scan, others are not */
+#define DEVICE_HDD_JOBS 4  /* Slots of a rotational disk with MDU_DEVICE_AUTO */
+#define TREE_BUF_SIZE 32768 /* getdents buffer of a sequential scan */
+#define TREE_MIN_CAP 4096   /* Initial bytes of the buffers of a tree_t */
+#define TREE_MAX_FDS 64     /* Directories a sequential scan keeps open */
+#define HOLD_POLL_NS 100000 /* Between two looks at the jobs held for a cut */
+#define SUMMARY_COUNTERS (sizeof(mdu_summary_t) / sizeof(long))
+
+// features tested for every entry, each combination gets its own kernel
+#define F_TRACK_DIRS (1 << 0) /* Directory totals propagate to parents */
+#define F_TOP_FILES (1 << 1)  /* mdu_options_t.top_files */
+#define F_SUMMARY (1 << 2)    /* mdu_options_t.summary */
+#define F_ON_ENTRY (1 << 3)   /* mdu_options_t.on_entry */
+#define F_LIMIT (1 << 4)      /* mdu_options_t.max_iops */
+#define F_INODES (1 << 5)     /* mdu_options_t.inodes */
+#define NR_KERNELS (1 << 6)
+// features kept out of the table, scans with any of them test all at run time
+#define F_FS (1 << 6)    /* mdu_options_t.fs */
+#define F_GROUP (1 << 7) /* mdu_options_t.group_by */
+#define F_WHERE (1 << 8) /* mdu_options_t.where */
+#define F_RUNTIME (F_FS | F_GROUP | F_WHERE)
+#define F_NEEDS_STAT                                                           \
+  (F_TOP_FILES | F_SUMMARY | F_ON_ENTRY | F_GROUP | F_WHERE) /* Use the stat */
+
+#define FEATURE_SETS(X)                                                        \
+  X(0) X(1) X(2) X(3) X(4) X(5) X(6) X(7) X(8) X(9) X(10) X(11) X(12) X(13)   \
+  X(14) X(15) X(16) X(17) X(18) X(19) X(20) X(21) X(22) X(23) X(24) X(25)     \
+  X(26) X(27) X(28) X(29) X(30) X(31) X(32) X(33) X(34) X(35) X(36) X(37)     \
+  X(38) X(39) X(40) X(41) X(42) X(43) X(44) X(45) X(46) X(47) X(48) X(49)     \
+  X(50) X(51) X(52) X(53) X(54) X(55) X(56) X(57) X(58) X(59) X(60) X(61)     \
+  X(62) X(63)
+
+// --------------- Structs -------------------------------------------------- //
+
+typedef struct linux_dirent64 {
+  int64_t d_ino;  /* 64-bit inode number */
+  int64_t d_off;  /* Not an offset; see getdents() */
+  short d_reclen; /* Size of this dirent */
+  char d_type;    /* File type */
+  char d_name[];  /* Filename (null-terminated) */
+} linux_dirent64;
+
+/**
+ * @typedef dent_t
+ * @brief an entry of a getdents buffer, decoded so that a batch of entries can
+ * be sorted by inode
+ *
+ */
+typedef struct dent_t {
+  uint64_t ino;       /* Inode number */
+  uint32_t name;      /* Offset of the name in the getdents buffer */
+  unsigned char type; /* d_type of the entry */
+} dent_t;
+
+/**
+ * @typedef device_t
+ * @brief the slots of a device shared by the directories on it
+ *
+ */
+typedef struct device_t {
+  _Alignas(64) pthread_mutex_t lock; /* Protects everything below */
+  dev_t dev;
+  int limit;             /* Directories read at a time */
+  int active;            /* Slots taken */
+  struct dir_t *waiting; /* Jobs parked for a slot, linked by dir_t.next */
+} device_t;
+
+/**
+ * @typedef dir_t
+ * @brief a job for count_dir(). When directory sizes are tracked each
+ * directory keeps a reference to its parent and adds its total to it when the
+ * whole subtree is counted
+ *
+ */
+typedef struct dir_t {
+  mdu_scan_t *scan;     /* The scan this job belongs to */
+  struct dir_t *parent; /* Parent directory, NULL if sizes are not tracked */
+  atomic_long blocks;   /* Blocks counted in this subtree so far */
+  atomic_long entries;  /* Entries counted in this subtree so far */
+  atomic_int pending;   /* Unfinished subdirectories + 1 for this directory */
+  int fd;               /* Open while batches of a pipelined scan need it */
+  atomic_int fd_refs;   /* Batches using FD + 1 for the enumerating worker */
+  device_t *device;     /* Device of the directory, NULL if not limited */
+  bool slot;            /* A slot of DEVICE is held for this job */
+  struct dir_t *next;   /* Next job parked on DEVICE, or held for a cut */
+  char path[];          /* Path to the directory (null-terminated) */
+} dir_t;
+
+/**
+ * @typedef batch_t
+ * @brief entries of a directory read by an enumerating worker, to be counted
+ * by a stat thread of a pipelined scan
+ *
+ */
+typedef struct batch_t {
+  dir_t *dir;                           /* The directory holding the entries */
+  int len;                              /* Bytes used in BUF */
+  _Alignas(8) char buf[STAGE_BUF_SIZE]; /* linux_dirent64 records */
+} batch_t;
+
+/**
+ * @typedef record_t
+ * @brief a result for a directory found by a worker, handed on to
+ * mdu_options_t.hints_out or mdu_options_t.snapshot_out when the scan is
+ * merged
+ *
+ */
+typedef struct record_t {
+  char *path;
+  long val;
+} record_t;
+
+typedef struct records_t {
+  record_t *v;
+  long len;
+  long cap;
+} records_t;
+
+/**
+ * @typedef local_t
+ * @brief data only touched by a single worker. Aligned to a cache line so that
+ * workers never share one
+ *
+ */
+typedef struct local_t {
+  _Alignas(64) heap_t *top_files; /* Largest files seen by this worker */
+  heap_t *top_dirs;               /* Largest directories finished here */
+  mdu_summary_t summary;          /* Counters for mdu_options_t.summary */
+  groups_t *groups;               /* Tables of mdu_options_t.group_by */
+  records_t hints;                /* Entries below large directories */
+  records_t dirs;                 /* Blocks of every directory, to snapshot */
+  atomic_long done_entries; /* Progress, only written by the owner */
+  atomic_long done_blocks;
+  atomic_long peak_pending; /* Most mdu_scan_t.pending seen by the owner */
+  long tokens; /* Left of the last batch taken from mdu_scan_t.limit */
+  stats_thread_t *stats; /* Counters in mdu_options_t.stats, or NULL */
+} local_t;
+
+/**
+ * @typedef frame_t
+ * @brief a directory on the stack of a sequential scan. Its subdirectories
+ * are the names from NEXT to the end of tree_t.names
+ *
+ */
+typedef struct frame_t {
+  size_t path_len; /* Length of the path of the directory */
+  size_t name;     /* Offset of the name of the directory in the path */
+  int fd;          /* Open while its subdirectories are visited, or -1 */
+  size_t first;    /* Offset of the names of its subdirectories */
+  size_t next;     /* Offset of the next subdirectory to visit */
+  long blocks;     /* Blocks counted in this subtree so far */
+  long entries;    /* Entries counted in this subtree so far */
+} frame_t;
+
+/**
+ * @typedef tree_t
+ * @brief the state of a sequential scan, see count_tree()
+ *
+ */
+typedef struct tree_t {
+  char *path;       /* Path of the directory on top of the stack */
+  size_t path_cap;
+  char *names;      /* Blocks of a subdirectory followed by its name */
+  size_t names_len;
+  size_t names_cap;
+  frame_t *frames;  /* Directories from the root to the current one */
+  int depth;
+  int frames_cap;
+} tree_t;
+
+/**
+ * @typedef kernel_t
+ * @brief a function counting every entry of a getdents buffer, see
+ * count_buffer()
+ *
+ */
+typedef void (*kernel_t)(dir_t *restrict dir, local_t *restrict local,
+                         const int fd, char *restrict buf, const int len,
+                         long *restrict blocks, long *restrict entries);
+
+struct mdu_scan_t {
+  mdu_options_t opts;
+  tpool_t *pool;
+  bool own_pool;    /* The pool was created for this scan */
+  bool track_dirs;  /* Propagate directory totals to their parents */
+  bool pipelined;   /* Entries are counted by the stat threads */
+  bool merged;      /* Local results are merged into the scan */
+  bool done;        /* The scan has been waited for */
+  bool sequential;  /* The root job walks the whole tree, see count_tree() */
+  ratelimit_t *limit; /* Bucket of mdu_options_t.max_iops, NULL if none */
+  unsigned features;  /* F_* flags of the options */
+  kernel_t kernel;    /* Counts a getdents buffer with those features */
+
+  device_t *devices;            /* MAX_DEVICES, NULL without a limit */
+  atomic_int nr_devices;        /* Devices in use, only grows */
+  pthread_mutex_t devices_lock; /* Taken to add a device */
+
+  atomic_bool cancelled; /* Skip every directory not opened yet */
+  atomic_long unscanned; /* Directories skipped after a cancel */
+  atomic_long counted;   /* Blocks counted so far, with mdu_options_t.exceeds */
+
+  atomic_long blocks;  /* Total blocks */
+  atomic_long pending; /* Jobs not finished yet */
+  sem_t finished;      /* Posted when PENDING reaches 0 */
+
+  char *root;                /* Path the scan was started at */
+  time_t now;                /* Time the ages of the scan are taken at */
+  atomic_bool holding;       /* Jobs taken are held, see scan_hold() */
+  pthread_mutex_t hold_lock; /* Protects HELD and NR_HELD */
+  dir_t *held;               /* Jobs held, linked by dir_t.next */
+  long nr_held;
+
+  short nr_workers;
+  short nr_locals;
+  local_t *locals;       /* One per worker and then one per stat thread */
+  mdu_summary_t summary; /* Merged summary, includes the root */
+
+  queue_t *batches;       /* Batches waiting for a stat thread */
+  sem_t batch_ready;      /* Posted for every queued batch and on stop */
+  atomic_bool stage_stop; /* The stat threads should exit */
+  atomic_short stage_ids; /* Next id to give to a starting stat thread */
+  pthread_t *stat_thrds;
+};
+
+// --------------- Declaration of internal functions ------------------------ //
+
+/**
+ * @brief Count the blocks used by every entry in a directory and add work for
+ * each subdirectory. Used as the function of every pool from
+ * mdu_pool_create()
+ *
+ * @param arg       a pointer to a struct of type dir_t
+ */
+void *count_dir(void *arg);
+
+/**
+ * @brief Stat the entry NAME of a directory and count it: files are added to
+ * BLOCKS and subdirectories become new jobs
+ *
+ * @param dir       The job of the directory holding NAME
+ * @param local     The local data of the calling worker
+ * @param fd        An open file descriptor of the directory
+ * @param name      The name of the entry
+ * @param type      The d_type of the entry
+ * @param blocks    The blocks counted directly inside DIR so far
+ * @param entries   The entries counted directly inside DIR so far
+ * @param features  The F_* flags of the scan. A constant in every kernel, so
+ * that the code of the features not used is left out
+ */
+static inline __attribute__((always_inline)) void
+count_entry(dir_t *restrict dir, local_t *restrict local, const int fd,
+            const char *restrict name, const unsigned char type,
+            long *restrict blocks, long *restrict entries,
+            const unsigned features);
+
+/**
+ * @brief Find out if an entry is a directory and what it adds to the total:
+ * its blocks, or 1 when counting inodes. Then the entry is only stat'ed if
+ * getdents did not give its type or a feature needs the stat
+ *
+ * @param fs        The backend of the scan, used with F_FS
+ * @param fd        An open file descriptor of the directory holding NAME
+ * @param name      The name of the entry
+ * @param type      The d_type of the entry
+ * @param filestat  Set to the stat of the entry, if it was stat'ed
+ * @param size      Set to what the entry adds to the total
+ * @param features  The F_* flags of the scan
+ *
+ * @return          1 for a directory, 0 for anything else and -1 if the stat
+ * failed
+ */
+static inline __attribute__((always_inline)) int
+entry_size(fs_t *restrict fs, const int fd, const char *restrict name,
+           const unsigned char type, struct stat *restrict filestat,
+           long *restrict size, const unsigned features);
+
+/**
+ * @brief Count every entry of a getdents buffer with count_entry(), using
+ * the kernel the scan picked
+ *
+ * @param dir       The job of the directory
+ * @param local     The local data of the calling thread
+ * @param fd        An open file descriptor of the directory
+ * @param buf       The linux_dirent64 records read from FD
+ * @param len       The bytes used in BUF
+ * @param blocks    The blocks counted directly inside DIR so far
+ * @param entries   The entries counted directly inside DIR so far
+ */
+static inline void count_buffer(dir_t *restrict dir,
+                                local_t *restrict local, const int fd,
+                                char *restrict buf, const int len,
+                                long *restrict blocks,
+                                long *restrict entries);
+
+/**
+ * @brief The loop of every kernel: count the entries of a getdents buffer in
+ * the order they were returned
+ *
+ * @param dir       The job of the directory
+ * @param local     The local data of the calling thread
+ * @param fd        An open file descriptor of the directory
+ * @param buf       The linux_dirent64 records read from FD
+ * @param len       The bytes used in BUF
+ * @param blocks    The blocks counted directly inside DIR so far
+ * @param entries   The entries counted directly inside DIR so far
+ * @param features  The F_* flags to compile the loop for
+ */
+static inline __attribute__((always_inline)) void
+count_buffer_kernel(dir_t *restrict dir, local_t *restrict local, const int fd,
+                    char *restrict buf, const int len, long *restrict blocks,
+                    long *restrict entries, const unsigned features);
+
+/**
+ * @brief Count a getdents buffer of a scan with a feature in F_RUNTIME,
+ * testing the features at run time
+ */
+static void count_buffer_runtime(dir_t *restrict dir, local_t *restrict local,
+                                 const int fd, char *restrict buf,
+                                 const int len, long *restrict blocks,
+                                 long *restrict entries);
+
+#ifdef MDU_GENERIC_KERNEL
+/**
+ * @brief Count a getdents buffer like the kernels, but test the features at
+ * run time
+ */
+static void count_buffer_generic(dir_t *restrict dir, local_t *restrict local,
+                                 const int fd, char *restrict buf,
+                                 const int len, long *restrict blocks,
+                                 long *restrict entries);
+#endif /* ifdef MDU_GENERIC_KERNEL */
+
+/**
+ * @brief Count every entry of a getdents buffer like count_buffer(), but stat
+ * them in inode order. Together with a large buffer this turns the random
+ * seeks between inode tables of a cold cache into a forward sweep. The sort
+ * costs more than a few branches, so the features are tested at run time
+ *
+ * @param dir       The job of the directory
+ * @param local     The local data of the calling thread
+ * @param fd        An open file descriptor of the directory
+ * @param buf       The linux_dirent64 records read from FD
+ * @param len       The bytes used in BUF
+ * @param blocks    The blocks counted directly inside DIR so far
+ * @param entries   The entries counted directly inside DIR so far
+ */
+static void count_buffer_sorted(dir_t *restrict dir, local_t *restrict local,
+                                const int fd, char *restrict buf,
+                                const int len, long *restrict blocks,
+                                long *restrict entries);
+
+/**
+ * @brief Compare two entries for qsort, lowest inode first
+ */
+static int dent_cmp_ino(const void *a, const void *b);
+
+/**
+ * @brief Check if NAME is "." or ".."
+ *
+ * @param name      The name of an entry
+ * @return          true if it is
+ */
+static inline bool is_dot(const char *name);
+
+/**
+ * @brief Allocate a job for the directory NAME inside BASE. The memory
+ * allocated is freed by dir_finish()
+ *
+ * @param scan      The scan the job belongs to
+ * @param base      The path of the directory containing NAME
+ * @param parent    The job of the parent directory, NULL if sizes should not
+ * be tracked
+ * @param name      The name of the directory
+ * @param blocks    The blocks used by the directory itself
+ *
+ * @return          A pointer to a struct of type dir_t
+ */
+static dir_t *dir_create(mdu_scan_t *restrict scan, const char *restrict base,
+                         dir_t *restrict parent, const char *restrict name,
+                         const long blocks);
+
+/**
+ * @brief Mark the directory DIR as counted and add BLOCKS to its total. If
+ * the whole subtree is done the total is propagated to its parent, which may
+ * in turn be finished.
+ *
+ * @param dir       The job to finish
+ * @param blocks    The blocks counted directly inside DIR
+ * @param entries   The amount of entries directly inside DIR
+ */
+static void dir_finish(dir_t *dir, const long blocks, const long entries);
+
+/**
+ * @brief Hand the total of a finished directory to the features which need
+ * it: the largest directories, mdu_options_t.on_dir, the hints and the
+ * snapshot
+ *
+ * @param scan      The scan the directory belongs to
+ * @param local     The local data of the calling worker
+ * @param path      The path of the directory
+ * @param blocks    The blocks used by the whole subtree
+ * @param entries   The entries in the whole subtree
+ */
+static void dir_report(mdu_scan_t *restrict scan, local_t *restrict local,
+                       const char *restrict path, const long blocks,
+                       const long entries);
+
+/**
+ * @brief Count a whole tree on the calling worker, the job of the root of a
+ * sequential scan. Finishes ROOT and the scan
+ *
+ * @param root      The job of the root directory
+ */
+static void count_tree(dir_t *root);
+
+/**
+ * @brief Walk the tree of ROOT depth first, see count_tree()
+ *
+ * @param root      The job of the root directory
+ * @param local     The local data of the calling worker
+ * @param features  The F_* flags of the scan, a constant in every copy
+ */
+static inline __attribute__((always_inline)) void
+count_tree_kernel(dir_t *restrict root, local_t *restrict local,
+                  const unsigned features);
+
+/**
+ * @brief Count the entries of the directory on top of the stack of a
+ * sequential scan. Files are added to its frame and the names of
+ * subdirectories to tree_t.names
+ *
+ * @param tree      The state of the scan
+ * @param scan      The scan
+ * @param local     The local data of the calling worker
+ * @param buf       A buffer of TREE_BUF_SIZE bytes for getdents
+ * @param features  The F_* flags of the scan
+ */
+static inline __attribute__((always_inline)) void
+tree_read(tree_t *restrict tree, mdu_scan_t *restrict scan,
+          local_t *restrict local, char *restrict buf,
+          const unsigned features);
+
+/**
+ * @brief Push the subdirectory NAME of the directory on top of the stack of a
+ * sequential scan
+ *
+ * @param tree      The state of the scan
+ * @param name      The name of the subdirectory
+ * @param len       The length of NAME
+ * @param blocks    The blocks the subtree starts with
+ */
+static void tree_push(tree_t *restrict tree, const char *restrict name,
+                      const size_t len, const long blocks);
+
+/**
+ * @brief Save a subdirectory to visit after the current directory is read
+ *
+ * @param tree      The state of the scan
+ * @param name      The name of the subdirectory
+ * @param blocks    The blocks the subtree starts with
+ */
+static inline void tree_add_name(tree_t *restrict tree,
+                                 const char *restrict name,
+                                 const long blocks);
+
+/**
+ * @brief Add a job for a subdirectory, with a priority if it is known to be
+ * large from mdu_options_t.hints
+ *
+ * @param scan      The scan the job belongs to
+ * @param dir       The job to add
+ */
+static inline void dir_add_work(mdu_scan_t *restrict scan,
+                                dir_t *restrict dir);
+
+/**
+ * @brief Get the device with the id DEV, adding it to the scan if it is new
+ *
+ * @param scan      The scan to get the device of
+ * @param hint      The device of the parent directory, usually the same
+ * @param dev       The st_dev of the directory
+ * @return          A pointer to a struct of type device_t, NULL if the scan
+ * has MAX_DEVICES already
+ */
+static device_t *scan_device(mdu_scan_t *restrict scan,
+                             device_t *restrict hint, const dev_t dev);
+
+/**
+ * @brief Pick the slots of a device for MDU_DEVICE_AUTO. Rotational disks get
+ * DEVICE_HDD_JOBS, everything else, such as SSDs and network file systems, is
+ * not limited
+ *
+ * @param dev       The st_dev of the device
+ * @param workers   The workers of the pool
+ * @return          The amount of slots
+ */
+static int device_auto_limit(const dev_t dev, const int workers);
+
+/**
+ * @brief Take a slot of the device of DIR, or park DIR on the device if there
+ * is none left
+ *
+ * @param dir       The job about to be counted
+ * @return          true if DIR may be counted now
+ */
+static bool device_acquire(dir_t *dir);
+
+/**
+ * @brief Release the slot held by DIR. A parked job takes the slot over and is
+ * added to the pool again
+ *
+ * @param dir       The job which is done reading its directory
+ */
+static void device_release(dir_t *dir);
+
+/**
+ * @brief Remember a result for a directory
+ *
+ * @param records   The records of the calling worker to add to
+ * @param path      The path of the directory, copied
+ * @param val       The result
+ */
+static void records_add(records_t *restrict records, const char *restrict path,
+                        const long val);
+
+/**
+ * @brief Mark one job of SCAN as done. The last job signals the scan
+ *
+ * @param scan      The scan the job belonged to
+ */
+static void scan_job_done(mdu_scan_t *scan);
+
+/**
+ * @brief Add a counted directory, or part of one, to the progress of the
+ * calling thread. A plain load and store, as only the owner writes
+ *
+ * @param local     The local data of the calling thread
+ * @param blocks    The blocks counted
+ * @param entries   The entries counted
+ */
+static inline void progress_add(local_t *restrict local, const long blocks,
+                                const long entries);
+
+/**
+ * @brief Take a token for one I/O from the batch of the calling thread, and a
+ * new batch from the bucket of the scan when it is spent. Only called when the
+ * scan has a limit
+ *
+ * @param scan      The scan doing the I/O
+ * @param local     The local data of the calling thread
+ */
+static inline void scan_io(mdu_scan_t *restrict scan,
+                           local_t *restrict local);
+
+/**
+ * @brief Collect a scan once its last job is done: stop the stat threads and
+ * merge the results
+ *
+ * @param scan      a pointer to a struct of type mdu_scan_t
+ */
+static void scan_finish(mdu_scan_t *scan);
+
+/**
+ * @brief Get the local data of the calling worker or stat thread
+ *
+ * @param scan      The scan to get the data of
+ * @return          A pointer to a struct of type local_t
+ */
+static inline local_t *scan_local(mdu_scan_t *scan);
+
+/**
+ * @brief Read the entries of a directory into batches and queue them for the
+ * stat threads. A batch is counted directly if the queue is full
+ *
+ * @param dir       The job of the directory
+ * @param fd        An open file descriptor of the directory, owned by DIR from
+ * now on
+ */
+static void enumerate_dir(dir_t *dir, const int fd);
+
+/**
+ * @brief Count the entries of a batch and release it
+ *
+ * @param batch     The batch to count
+ */
+static void batch_count(batch_t *batch);
+
+/**
+ * @brief Drop a reference to the file descriptor of a directory. The last one
+ * closes it
+ *
+ * @param dir       The directory
+ */
+static inline void dir_release_fd(dir_t *dir);
+
+/**
+ * @brief Main function of a stat thread: count batches until the scan is done
+ *
+ * @param arg       A pointer to a struct of type mdu_scan_t
+ */
+static void *stat_thread(void *arg);
+
+/**
+ * @brief Start the stat threads of a pipelined scan
+ *
+ * @param scan      a pointer to a struct of type mdu_scan_t
+ */
+static void stage_start(mdu_scan_t *scan);
+
+/**
+ * @brief Stop and join the stat threads of a pipelined scan once it is done
+ *
+ * @param scan      a pointer to a struct of type mdu_scan_t
+ */
+static void stage_stop(mdu_scan_t *scan);
+
+/**
+ * @brief Appends two filenames into the aboslute path for f2. The memory
+ * allocated needs to be freed by the caller
+ *
+ * @param f1      The base name of the file
+ * @param f2      The file to be appended
+ *
+ * @return        A pointer to the full name
+ */
+static inline char *append_filename(const char *restrict f1,
+                                    const char *restrict f2);
+
+/**
+ * @brief Add the entry described by FILESTAT to a summary
+ *
+ * @param summary   The summary to add to
+ * @param filestat  The stat result of the entry
+ */
+static inline void summary_add(mdu_summary_t *restrict summary,
+                               const struct stat *restrict filestat);
+
+/**
+ * @brief Open a directory of a scan, like openat(2)
+ *
+ * @param scan      a pointer to a struct of type mdu_scan_t
+ * @param dirfd     the directory PATH is relative to, or AT_FDCWD
+ * @param path      the directory to open
+ * @return          a file descriptor, -1 on error
+ */
+static inline int scan_open(const mdu_scan_t *restrict scan, const int dirfd,
+                            const char *restrict path);
+
+/**
+ * @brief Read entries of a directory of a scan, like getdents64(2)
+ *
+ * @param scan      a pointer to a struct of type mdu_scan_t
+ * @param fd        a file descriptor from scan_open()
+ * @param buf       the buffer to fill with linux_dirent64 records
+ * @param size      the size of BUF
+ * @return          the bytes read, 0 at the end and -1 on error
+ */
+static inline int scan_getdents(const mdu_scan_t *restrict scan,
+                                const int fd, char *restrict buf,
+                                const int size);
+
+/**
+ * @brief Close a file descriptor from scan_open()
+ *
+ * @param scan      a pointer to a struct of type mdu_scan_t
+ * @param fd        the file descriptor
+ */
+static inline void scan_close(const mdu_scan_t *scan, const int fd);
+
+/**
+ * @brief Add blocks just counted to the running total of a scan with
+ * mdu_options_t.exceeds, and cancel the scan once the total passes it
+ *
+ * @param scan      a pointer to a struct of type mdu_scan_t
+ * @param blocks    the blocks to add
+ */
+static inline void scan_count(mdu_scan_t *scan, const long blocks);
+
+/**
+ * @brief Merge the results of every worker into the first local_t, the
+ * summary of the scan and mdu_options_t.hints_out
+ *
+ * @param scan      a pointer to a struct of type mdu_scan_t
+ */
+static void scan_merge(mdu_scan_t *scan);
+
+/**
+ * @brief Hold a job taken while a checkpoint is cut, see
+ * mdu_scan_checkpoint()
+ *
+ * @param dir       The job taken
+ * @return          true if DIR is held, false if the cut is over and DIR is
+ * to be counted
+ */
+static bool scan_hold(dir_t *dir);
+
+/**
+ * @brief Start counting from a checkpoint instead of the root: add its totals
+ * and a job for every directory left in it
+ *
+ * @param scan      a pointer to a struct of type mdu_scan_t
+ * @param cp        the checkpoint, see mdu_options_t.resume
+ */
+static void scan_resume(mdu_scan_t *restrict scan,
+                        const checkpoint_t *restrict cp);
+
+/**
+ * @brief Main function of a process of mdu_du_procs(): scan the root if it is
+ * the first one, then resume from the directories it takes from the queue
+ * until the scan is done. Exits with 0 on success
+ *
+ * @param shard     the state shared by the processes
+ * @param id        the process, in [0, NR_PROCS)
+ * @param path      the file or directory scanned
+ * @param opts      the options of mdu_du_procs()
+ */
+static _Noreturn void procs_run(shard_t *restrict shard, const int id,
+                                const char *restrict path,
+                                const mdu_options_t *restrict opts);
+
+/**
+ * @brief Run one scan of a process of mdu_du_procs() and add its totals to
+ * the results of the process
+ *
+ * @param path      the file or directory scanned
+ * @param opts      the options of the scan
+ * @param result    the results of the process
+ * @return          0 on success, -1 if PATH could not be scanned
+ */
+static int procs_scan(const char *restrict path,
+                      const mdu_options_t *restrict opts,
+                      shard_result_t *restrict result);
+
+// --------------- Thread local vars ---------------------------------------- //
+
+static thread_local short stage_id = -1; /* Id of a stat thread in its scan */
+
+// --------------- Kernels -------------------------------------------------- //
+
+#ifndef MDU_GENERIC_KERNEL
+#define DEFINE_KERNEL(f)                                                       \
+  static void count_buffer_##f(dir_t *restrict dir, local_t *restrict local,   \
+                               const int fd, char *restrict buf,               \
+                               const int len, long *restrict blocks,           \
+                               long *restrict entries) {                       \
+    count_buffer_kernel(dir, local, fd, buf, len, blocks, entries, f);         \
+  }
+#define KERNEL_ENTRY(f) count_buffer_##f,
+
+FEATURE_SETS(DEFINE_KERNEL)
+
+static const kernel_t kernels[NR_KERNELS] = {FEATURE_SETS(KERNEL_ENTRY)};
+#endif /* ifndef MDU_GENERIC_KERNEL */
+
+// --------------- Definition of external functions ------------------------- //
+
+void mdu_options_init(mdu_options_t *opts) {
+  memset(opts, 0, sizeof(mdu_options_t));
+  opts->nr_threads = 1;
+}
+
+tpool_t *mdu_pool_create(const short nr_threads) {
+  return tpool_create(nr_threads, count_dir);
+}
+
+tpool_t *mdu_pool_create_schedule(const short nr_threads,
+                                  const tpool_schedule_t schedule) {
+  return tpool_create_schedule(nr_threads, count_dir, schedule);
+}
+
+int mdu_background(void) {
+  const struct sched_param param = {0};
+  int err = pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+
+  if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_IDLE)) {
+    err = -1;
+  }
+
+  return err ? -1 : 0;
+}
+
+mdu_scan_t *mdu_scan_start(const char *restrict path,
+                           const mdu_options_t *restrict opts) {
+  struct stat filestat;
+  if (opts->fs ? opts->fs->fstatat(opts->fs, AT_FDCWD, path, &filestat)
+               : lstat(path, &filestat)) {
+    return NULL;
+  }
+
+  mdu_scan_t *scan = calloc(1, sizeof(mdu_scan_t));
+  scan->opts = *opts;
+  scan->own_pool = !opts->pool;
+  scan->pool = scan->own_pool ? mdu_pool_create(opts->nr_threads) : opts->pool;
+  scan->track_dirs = opts->top_dirs || opts->on_dir || opts->hints_out ||
+                     opts->snapshot_out;
+  scan->pipelined = opts->stat_threads > 0;
+  // a shared pool may run other scans, which must not wait for the whole tree
+  scan->sequential = scan->own_pool && tpool_nr_threads(scan->pool) == 1 &&
+                     !scan->pipelined && !opts->device_jobs &&
+                     !opts->inode_order && !opts->checkpoints &&
+                     !opts->resume && !opts->shard;
+
+  scan->features = (scan->track_dirs ? F_TRACK_DIRS : 0) |
+                   (opts->top_files ? F_TOP_FILES : 0) |
+                   (opts->summary ? F_SUMMARY : 0) |
+                   (opts->on_entry ? F_ON_ENTRY : 0) |
+                   (opts->max_iops > 0 ? F_LIMIT : 0) |
+                   (opts->inodes ? F_INODES : 0) | (opts->fs ? F_FS : 0) |
+                   (opts->group_by ? F_GROUP : 0) | (opts->where ? F_WHERE : 0);
+#ifdef MDU_GENERIC_KERNEL
+  scan->kernel = count_buffer_generic;
+#else
+  scan->kernel = kernels[scan->features & (NR_KERNELS - 1)];
+#endif /* ifdef MDU_GENERIC_KERNEL */
+  if (scan->features & F_RUNTIME) {
+    scan->kernel = count_buffer_runtime;
+  }
+  if (opts->inode_order) {
+    scan->kernel = count_buffer_sorted;
+  }
+
+  if (opts->device_jobs) {
+    scan->devices = calloc(MAX_DEVICES, sizeof(device_t));
+    atomic_init(&scan->nr_devices, 0);
+    pthread_mutex_init(&scan->devices_lock, NULL);
+  }
+
+  atomic_init(&scan->blocks, 0);
+  atomic_init(&scan->pending, 0);
+  atomic_init(&scan->cancelled, false);
+  atomic_init(&scan->unscanned, 0);
+  atomic_init(&scan->counted, 0);
+  sem_init(&scan->finished, 0, 0);
+  scan->root = strdup(path);
+  atomic_init(&scan->holding, false);
+  pthread_mutex_init(&scan->hold_lock, NULL);
+  scan->held = NULL;
+  scan->nr_held = 0;
+
+  // every age of mdu_options_t.group_by is taken at the start
+  const time_t now = opts->resume ? opts->resume->now : time(NULL);
+  scan->now = now;
+  scan->nr_workers = tpool_nr_threads(scan->pool);
+  scan->nr_locals =
+      scan->nr_workers + (scan->pipelined ? opts->stat_threads : 0);
+  scan->locals =
+      aligned_alloc(_Alignof(local_t), scan->nr_locals * sizeof(local_t));
+  for (short i = 0; i < scan->nr_locals; i++) {
+    local_t *l = &scan->locals[i];
+    l->top_files = opts->top_files ? heap_create(opts->top_n) : NULL;
+    l->top_dirs = opts->top_dirs ? heap_create(opts->top_n) : NULL;
+    memset(&l->summary, 0, sizeof(mdu_summary_t));
+    l->groups = opts->group_by ? groups_create(opts->group_by, now) : NULL;
+    memset(&l->hints, 0, sizeof(records_t));
+    memset(&l->dirs, 0, sizeof(records_t));
+    atomic_init(&l->done_entries, 0);
+    atomic_init(&l->done_blocks, 0);
+    atomic_init(&l->peak_pending, 0);
+    l->tokens = 0;
+    l->stats = opts->stats && i < opts->stats->nr_threads
+                   ? stats_thread(opts->stats, i)
+                   : NULL;
+  }
+
+  if (opts->stats) {
+    atomic_fetch_add(&opts->stats->scans, 1);
+    atomic_store(&opts->stats->block_size, opts->inodes ? 0 : 512);
+    atomic_store(&opts->stats->phase, STATS_SCANNING);
+  }
+
+  if (opts->max_iops > 0) {
+    scan->limit = ratelimit_create(opts->max_iops, opts->iops_backoff);
+  }
+
+  // the root was counted before the checkpoint
+  if (opts->resume) {
+    scan_resume(scan, opts->resume);
+    return scan;
+  }
+
+  // a root not matching is walked like any other directory
+  const bool matches = !opts->where || where_match(opts->where, &filestat);
+  if (opts->summary && matches) {
+    summary_add(&scan->summary, &filestat);
+  }
+
+  const long size = !matches ? 0 : opts->inodes ? 1 : filestat.st_blocks;
+  if (opts->group_by && matches) {
+    const char *base = strrchr(path, '/');
+    groups_add(scan->locals[0].groups, &filestat, base ? base + 1 : path,
+               size);
+  }
+  if (opts->exceeds > 0) {
+    scan_count(scan, size);
+  }
+  dir_t *root;
+  if (scan->track_dirs) {
+    root = dir_create(scan, path, NULL, "", size);
+  } else {
+    atomic_fetch_add(&scan->blocks, size);
+    root = dir_create(scan, path, NULL, "", 0);
+  }
+  root->path[strlen(path)] = '\0'; // no trailing slash
+  if (scan->devices) {
+    root->device = scan_device(scan, NULL, filestat.st_dev);
+  }
+
+  if (scan->pipelined) {
+    stage_start(scan);
+  }
+
+  tpool_add_work(scan->pool, root);
+
+  return scan;
+}
+
+void mdu_scan_wait(mdu_scan_t *scan) {
+  if (scan->done) {
+    return;
+  }
+
+  sem_wait(&scan->finished);
+  scan_finish(scan);
+}
+
+bool mdu_scan_timedwait(mdu_scan_t *restrict scan,
+                        const struct timespec *restrict abstime) {
+  if (scan->done) {
+    return true;
+  }
+
+  if (sem_timedwait(&scan->finished, abstime)) {
+    return false; // timed out or interrupted
+  }
+
+  scan_finish(scan);
+  return true;
+}
+
+void mdu_scan_cancel(mdu_scan_t *scan) {
+  atomic_store(&scan->cancelled, true);
+}
+
+long mdu_scan_unscanned(const mdu_scan_t *scan) {
+  return atomic_load(&scan->unscanned);
+}
+
+bool mdu_scan_exceeded(mdu_scan_t *scan) {
+  mdu_scan_wait(scan);
+
+  // every block counted reaches the total, also in a cancelled scan
+  return scan->opts.exceeds > 0 && mdu_scan_blocks(scan) > scan->opts.exceeds;
+}
+
+void mdu_scan_progress(const mdu_scan_t *restrict scan,
+                       mdu_progress_t *restrict progress) {
+  progress->entries = 0;
+  progress->blocks = 0;
+  progress->peak_pending = 0;
+  progress->pending = atomic_load_explicit(&scan->pending,
+                                           memory_order_relaxed);
+
+  for (short i = 0; i < scan->nr_locals; i++) {
+    const local_t *l = &scan->locals[i];
+    progress->entries +=
+        atomic_load_explicit(&l->done_entries, memory_order_relaxed);
+    progress->blocks +=
+        atomic_load_explicit(&l->done_blocks, memory_order_relaxed);
+
+    const long peak =
+        atomic_load_explicit(&l->peak_pending, memory_order_relaxed);
+    if (peak > progress->peak_pending) {
+      progress->peak_pending = peak;
+    }
+  }
+}
+
+int mdu_scan_checkpoint(mdu_scan_t *restrict scan,
+                        const char *restrict file) {
+  const mdu_options_t *opts = &scan->opts;
+  if (!opts->checkpoints) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  checkpoint_t *cp =
+      checkpoint_create(scan->root, opts->summary ? SUMMARY_COUNTERS : 0);
+  cp->flags = (opts->inodes ? CHECKPOINT_INODES : 0) |
+              (opts->summary ? CHECKPOINT_SUMMARY : 0);
+  cp->where = opts->where ? strdup(where_expr(opts->where)) : NULL;
+  cp->now = opts->where ? where_now(opts->where) : scan->now;
+
+  // jobs running now finish and add to PENDING, so it is read every time
+  const struct timespec poll = {0, HOLD_POLL_NS};
+  pthread_mutex_lock(&scan->hold_lock);
+  atomic_store(&scan->holding, true);
+  while (scan->nr_held != atomic_load(&scan->pending)) {
+    pthread_mutex_unlock(&scan->hold_lock);
+    nanosleep(&poll, NULL);
+    pthread_mutex_lock(&scan->hold_lock);
+  }
+
+  cp->blocks = atomic_load(&scan->blocks);
+  mdu_summary_t summary = scan->summary;
+  for (short i = 0; i < scan->nr_locals; i++) {
+    const local_t *l = &scan->locals[i];
+    cp->entries += atomic_load_explicit(&l->done_entries,
+                                        memory_order_relaxed);
+
+    // merged into the summary of the scan once it is done
+    if (!scan->merged) {
+      summary.files += l->summary.files;
+      summary.dirs += l->summary.dirs;
+      summary.symlinks += l->summary.symlinks;
+      summary.others += l->summary.others;
+      for (short k = 0; k < MDU_HIST_BUCKETS; k++) {
+        summary.hist[k] += l->summary.hist[k];
+      }
+    }
+  }
+  // only longs, so it is saved as it is
+  memcpy(cp->counters, &summary, cp->nr_counters * sizeof(long));
+
+  for (const dir_t *d = scan->held; d; d = d->next) {
+    checkpoint_add_dir(cp, d->path);
+  }
+  dir_t *held = scan->held;
+  scan->held = NULL;
+  scan->nr_held = 0;
+  atomic_store(&scan->holding, false);
+  pthread_mutex_unlock(&scan->hold_lock);
+
+  // back to work before the file is written
+  while (held) {
+    dir_t *next = held->next;
+    held->next = NULL;
+    dir_add_work(scan, held);
+    held = next;
+  }
+
+  const int ret = checkpoint_save(cp, file);
+  checkpoint_destroy(cp);
+
+  return ret;
+}
+
+void mdu_scan_destroy(mdu_scan_t *scan) {
+  if (!scan) {
+    return;
+  }
+
+  mdu_scan_wait(scan);
+
+  for (short i = 0; i < scan->nr_locals; i++) {
+    heap_destroy(scan->locals[i].top_files);
+    heap_destroy(scan->locals[i].top_dirs);
+    groups_destroy(scan->locals[i].groups);
+    for (long k = 0; k < scan->locals[i].hints.len; k++) {
+      free(scan->locals[i].hints.v[k].path);
+    }
+    free(scan->locals[i].hints.v);
+    for (long k = 0; k < scan->locals[i].dirs.len; k++) {
+      free(scan->locals[i].dirs.v[k].path);
+    }
+    free(scan->locals[i].dirs.v);
+  }
+  free(scan->locals);
+
+  if (scan->own_pool) {
+    tpool_destroy(scan->pool);
+  }
+
+  if (scan->devices) {
+    for (int i = 0; i < atomic_load(&scan->nr_devices); i++) {
+      pthread_mutex_destroy(&scan->devices[i].lock);
+    }
+    pthread_mutex_destroy(&scan->devices_lock);
+    free(scan->devices);
+  }
+
+  ratelimit_destroy(scan->limit);
+  sem_destroy(&scan->finished);
+  pthread_mutex_destroy(&scan->hold_lock);
+  free(scan->root);
+  free(scan);
+}
+
+long mdu_scan_blocks(const mdu_scan_t *scan) {
+  return atomic_load(&scan->blocks);
+}
+
+const heap_entry_t *mdu_scan_top(mdu_scan_t *restrict scan, const bool files,
+                                 int *restrict len) {
+  mdu_scan_wait(scan);
+
+  heap_t *h = files ? scan->locals[0].top_files : scan->locals[0].top_dirs;
+  if (!h) {
+    *len = 0;
+    return NULL;
+  }
+
+  return heap_sorted(h, len);
+}
+
+const group_entry_t *mdu_scan_groups(mdu_scan_t *restrict scan,
+                                     const group_kind_t kind,
+                                     long *restrict len) {
+  mdu_scan_wait(scan);
+
+  groups_t *groups = scan->locals[0].groups;
+  if (!groups) {
+    *len = 0;
+    return NULL;
+  }
+
+  return groups_get(groups, kind, len);
+}
+
+const mdu_summary_t *mdu_scan_summary(const mdu_scan_t *scan) {
+  return scan->opts.summary ? &scan->summary : NULL;
+}
+
+long mdu_du(const char *restrict path, const mdu_options_t *restrict opts) {
+  mdu_options_t defaults;
+  if (!opts) {
+    mdu_options_init(&defaults);
+    opts = &defaults;
+  }
+
+  mdu_scan_t *scan = mdu_scan_start(path, opts);
+  if (!scan) {
+    return -1;
+  }
+
+  mdu_scan_wait(scan);
+  const long blocks = mdu_scan_blocks(scan);
+  mdu_scan_destroy(scan);
+
+  return blocks;
+}
+
+long mdu_du_procs(const char *restrict path, const mdu_options_t *restrict opts,
+                  const int nr_procs, mdu_summary_t *restrict summary) {
+  shard_t *shard = shard_create(nr_procs);
+  if (!shard) {
+    return -1;
+  }
+
+  pid_t *pids = malloc(nr_procs * sizeof(pid_t));
+  int started = 0;
+  bool failed = false;
+  for (; started < nr_procs && !failed; started++) {
+    pids[started] = fork();
+    if (pids[started] == 0) {
+      procs_run(shard, started, path, opts);
+    }
+    failed = pids[started] < 0;
+  }
+  started -= failed;
+
+  // a process lost would leave its directories pending, and the rest waiting
+  for (int left = started; left > 0; left--) {
+    int status;
+    pid_t pid;
+    while ((pid = wait(&status)) < 0 && errno == EINTR) {
+    }
+    if (pid < 0) {
+      failed = true;
+      break;
+    }
+    for (int i = 0; i < started; i++) {
+      pids[i] = pids[i] == pid ? 0 : pids[i];
+    }
+
+    if (!failed && (!WIFEXITED(status) || WEXITSTATUS(status))) {
+      failed = true;
+    }
+    for (int i = 0; i < started && failed; i++) {
+      if (pids[i] > 0) {
+        kill(pids[i], SIGKILL);
+      }
+    }
+  }
+  free(pids);
+
+  long blocks = -1;
+  if (!failed) {
+    blocks = 0;
+    if (summary) {
+      memset(summary, 0, sizeof(mdu_summary_t));
+    }
+
+    for (int i = 0; i < nr_procs; i++) {
+      const shard_result_t *result = shard_result(shard, i);
+      blocks += result->blocks;
+      for (size_t k = 0; summary && k < SUMMARY_COUNTERS; k++) {
+        ((long *)summary)[k] += result->counters[k];
+      }
+    }
+  }
+  shard_destroy(shard);
+
+  return blocks;
+}
+
+int mdu_exceeds(const char *restrict path, const long limit,
+                const mdu_options_t *restrict opts) {
+  mdu_options_t limited;
+  if (opts) {
+    limited = *opts;
+  } else {
+    mdu_options_init(&limited);
+  }
+  limited.exceeds = limit;
+
+  mdu_scan_t *scan = mdu_scan_start(path, &limited);
+  if (!scan) {
+    return -1;
+  }
+
+  const bool exceeded = mdu_scan_exceeded(scan);
+  mdu_scan_destroy(scan);
+
+  return exceeded;
+}
+
+// --------------- Definition of internal functions ------------------------- //
+
+void *count_dir(void *arg) {
+  dir_t *dir = (dir_t *)arg;
+  mdu_scan_t *scan = dir->scan;
+
+  if (scan->sequential) {
+    count_tree(dir);
+    return NULL;
+  }
+
+  if (atomic_load_explicit(&scan->holding, memory_order_relaxed) &&
+      scan_hold(dir)) {
+    return NULL; // added to the pool again when the cut is copied
+  }
+
+  if (dir->device && !device_acquire(dir)) {
+    return NULL; // parked until a directory of the same device is done
+  }
+
+  // a cancelled scan drains the pool by skipping every directory left
+  if (atomic_load_explicit(&scan->cancelled, memory_order_relaxed)) {
+    atomic_fetch_add_explicit(&scan->unscanned, 1, memory_order_relaxed);
+    device_release(dir);
+    dir_finish(dir, 0, 0);
+    scan_job_done(scan);
+    return NULL;
+  }
+
+  local_t *local = scan_local(scan);
+  if (scan->limit) {
+    scan_io(scan, local);
+  }
+
+  const int fd = scan_open(scan, AT_FDCWD, dir->path);
+  if (fd < 0) {
+    device_release(dir);
+    dir_finish(dir, 0, 0);
+    scan_job_done(scan);
+    return NULL;
+  }
+
+  if (scan->pipelined) {
+    enumerate_dir(dir, fd);
+    return NULL;
+  }
+
+  long blocks = 0; // summed locally, added once when the directory is done
+  long entries = 0;
+
+  // inode order sorts what one call returns, so it gets a larger buffer
+  char buf[BATCH_BUF_SIZE];
+  const int size = scan->opts.inode_order ? BATCH_BUF_SIZE : DIR_BUF_SIZE;
+  int nread;
+
+  long counted = 0; // of BLOCKS, added to the total of a limited scan
+
+  while ((nread = scan_getdents(scan, fd, buf, size)) > 0) {
+    count_buffer(dir, local, fd, buf, nread, &blocks, &entries);
+
+    if (scan->opts.exceeds > 0) {
+      scan_count(scan, blocks - counted);
+      counted = blocks;
+    }
+    if (atomic_load_explicit(&scan->cancelled, memory_order_relaxed)) {
+      break;
+    }
+  }
+
+  // left before the end, so the directory is only partly counted
+  if (nread > 0) {
+    atomic_fetch_add_explicit(&scan->unscanned, 1, memory_order_relaxed);
+  }
+
+  scan_close(scan, fd);
+  device_release(dir);
+  progress_add(local, blocks, entries);
+  dir_finish(dir, blocks, entries);
+  scan_job_done(scan);
+  return NULL;
+}
+
+static inline __attribute__((always_inline)) void
+count_entry(dir_t *restrict dir, local_t *restrict local, const int fd,
+            const char *restrict name, const unsigned char type,
+            long *restrict blocks, long *restrict entries,
+            const unsigned features) {
+  mdu_scan_t *scan = dir->scan;
+  if (features & F_LIMIT) {
+    scan_io(scan, local);
+  }
+
+  struct stat filestat;
+  long size;
+  const int is_dir =
+      entry_size(scan->opts.fs, fd, name, type, &filestat, &size, features);
+  if (is_dir < 0) {
+    return;
+  }
+  (*entries)++;
+
+#ifdef DEBUG
+  fprintf(stderr, "sum file: %s\n", name);
+#endif /* ifdef DEBUG */
+
+  // a directory not matching is still walked, for the entries below it
+  const bool matches =
+      !(features & F_WHERE) || where_match(scan->opts.where, &filestat);
+  if (!matches) {
+    if (!is_dir) {
+      return;
+    }
+    size = 0;
+  }
+
+  if ((features & F_SUMMARY) && matches) {
+    summary_add(&local->summary, &filestat);
+  }
+
+  if ((features & F_GROUP) && matches) {
+    groups_add(local->groups, &filestat, name, size);
+  }
+
+  if ((features & F_ON_ENTRY) && matches) {
+    const mdu_entry_t entry = {dir->path, name, &filestat};
+    scan->opts.on_entry(&entry, scan->opts.user);
+  }
+
+  if (!is_dir) {
+    *blocks += size;
+
+    // ranked by blocks, also when inodes are counted
+    if ((features & F_TOP_FILES) &&
+        heap_accepts(local->top_files, filestat.st_blocks)) {
+      heap_push(local->top_files, filestat.st_blocks,
+                append_filename(dir->path, name));
+    }
+    return; // dont add files to jobs
+  }
+
+  // a tracked directory keeps its own blocks, the limit must see them now
+  dir_t *sub;
+  if (features & F_TRACK_DIRS) {
+    sub = dir_create(scan, dir->path, dir, name, size);
+    if (scan->opts.exceeds > 0) {
+      scan_count(scan, size);
+    }
+  } else {
+    *blocks += size;
+    sub = dir_create(scan, dir->path, NULL, name, 0);
+  }
+
+  // the device of a directory not stat'ed is taken to be that of its parent
+  if (scan->devices) {
+    sub->device = (features & F_INODES) && type != DT_UNKNOWN &&
+                          !(features & F_NEEDS_STAT)
+                      ? dir->device
+                      : scan_device(scan, dir->device, filestat.st_dev);
+  }
+
+  // the peak is reached right after some add, so the adders see all of them
+  const long pending =
+      atomic_load_explicit(&scan->pending, memory_order_relaxed);
+  if (pending >
+      atomic_load_explicit(&local->peak_pending, memory_order_relaxed)) {
+    atomic_store_explicit(&local->peak_pending, pending, memory_order_relaxed);
+  }
+
+  // its blocks are counted here, only what is below it is handed over
+  if (scan->opts.shard && shard_hungry(scan->opts.shard) &&
+      shard_push(scan->opts.shard, sub->path)) {
+    dir_finish(sub, 0, 0);
+    scan_job_done(scan);
+    return;
+  }
+  dir_add_work(scan, sub);
+}
+
+static inline __attribute__((always_inline)) int
+entry_size(fs_t *restrict fs, const int fd, const char *restrict name,
+           const unsigned char type, struct stat *restrict filestat,
+           long *restrict size, const unsigned features) {
+  if ((features & F_INODES) && !(features & F_NEEDS_STAT) &&
+      type != DT_UNKNOWN) {
+    *size = 1;
+    return type == DT_DIR;
+  }
+
+  if ((features & F_FS) ? fs->fstatat(fs, fd, name, filestat)
+                         : fstatat(fd, name, filestat, AT_SYMLINK_NOFOLLOW)) {
+    return -1;
+  }
+
+  *size = features & F_INODES ? 1 : filestat->st_blocks;
+  return S_ISDIR(filestat->st_mode);
+}
+
+static inline void count_buffer(dir_t *restrict dir,
+                                local_t *restrict local, const int fd,
+                                char *restrict buf, const int len,
+                                long *restrict blocks,
+                                long *restrict entries) {
+  dir->scan->kernel(dir, local, fd, buf, len, blocks, entries);
+}
+
+static inline __attribute__((always_inline)) void
+count_buffer_kernel(dir_t *restrict dir, local_t *restrict local, const int fd,
+                    char *restrict buf, const int len, long *restrict blocks,
+                    long *restrict entries, const unsigned features) {
+  for (register int bpos = 0; bpos < len;) {
+    struct linux_dirent64 *d = (struct linux_dirent64 *)(buf + bpos);
+    bpos += d->d_reclen;
+
+    if (is_dot(d->d_name)) {
+      continue; // skip current and parent directory
+    }
+
+    count_entry(dir, local, fd, d->d_name, d->d_type, blocks, entries,
+                features);
+  }
+}
+
+static void count_buffer_runtime(dir_t *restrict dir, local_t *restrict local,
+                                 const int fd, char *restrict buf,
+                                 const int len, long *restrict blocks,
+                                 long *restrict entries) {
+  count_buffer_kernel(dir, local, fd, buf, len, blocks, entries,
+                      dir->scan->features);
+}
+
+#ifdef MDU_GENERIC_KERNEL
+static void count_buffer_generic(dir_t *restrict dir, local_t *restrict local,
+                                 const int fd, char *restrict buf,
+                                 const int len, long *restrict blocks,
+                                 long *restrict entries) {
+  count_buffer_kernel(dir, local, fd, buf, len, blocks, entries,
+                      dir->scan->features);
+}
+#endif /* ifdef MDU_GENERIC_KERNEL */
+
+static void count_buffer_sorted(dir_t *restrict dir, local_t *restrict local,
+                                const int fd, char *restrict buf,
+                                const int len, long *restrict blocks,
+                                long *restrict entries) {
+  dent_t dents[BATCH_MAX];
+  int n = 0;
+
+  for (int bpos = 0; bpos < len;) {
+    struct linux_dirent64 *d = (struct linux_dirent64 *)(buf + bpos);
+
+    if (!is_dot(d->d_name)) {
+      dents[n].ino = d->d_ino;
+      dents[n].name = bpos + offsetof(linux_dirent64, d_name);
+      dents[n].type = d->d_type;
+      n++;
+    }
+
+    bpos += d->d_reclen;
+  }
+
+  // inode numbers follow the on-disk inode tables, so the stats below walk
+  // them in one direction instead of jumping around in hash order
+  qsort(dents, n, sizeof(dent_t), dent_cmp_ino);
+
+  const unsigned features = dir->scan->features;
+  for (int i = 0; i < n; i++) {
+    count_entry(dir, local, fd, buf + dents[i].name, dents[i].type, blocks,
+                entries, features);
+  }
+}
+
+static int dent_cmp_ino(const void *a, const void *b) {
+  const uint64_t ia = ((const dent_t *)a)->ino;
+  const uint64_t ib = ((const dent_t *)b)->ino;
+
+  return (ia > ib) - (ia < ib);
+}
+
+static inline bool is_dot(const char *name) {
+  return name[0] == '.' &&
+         (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+}
+
+static dir_t *dir_create(mdu_scan_t *restrict scan, const char *restrict base,
+                         dir_t *restrict parent, const char *restrict name,
+                         const long blocks) {
+  short base_len = strlen(base);
+  short name_len = strlen(name);
+  dir_t *dir = malloc(sizeof(dir_t) + base_len + name_len + 2);
+
+  memcpy(dir->path, base, base_len);
+
+  if (base[base_len - 1] != '/')
+    dir->path[base_len++] = '/';
+
+  memcpy(dir->path + base_len, name, name_len);
+  dir->path[base_len + name_len] = '\0';
+
+  dir->scan = scan;
+  dir->parent = parent;
+  atomic_init(&dir->blocks, blocks);
+  atomic_init(&dir->entries, 0);
+  atomic_init(&dir->pending, 1);
+
+  if (parent) {
+    atomic_fetch_add(&parent->pending, 1);
+  }
+
+  dir->fd = -1;
+  atomic_init(&dir->fd_refs, 1);
+  dir->device = NULL;
+  dir->slot = false;
+  dir->next = NULL;
+
+  // the creating job is still pending, so this can not bring the scan to 0
+  atomic_fetch_add_explicit(&scan->pending, 1, memory_order_relaxed);
+
+  return dir;
+}
+
+static void dir_finish(dir_t *dir, const long blocks, const long entries) {
+  mdu_scan_t *scan = dir->scan;
+
+  if (!scan->track_dirs && !scan->pipelined) {
+    atomic_fetch_add(&scan->blocks, blocks);
+    free(dir);
+    return;
+  }
+
+  atomic_fetch_add(&dir->blocks, blocks);
+  atomic_fetch_add(&dir->entries, entries);
+
+  // the last one out of a directory reports it and moves on to the parent
+  while (dir && atomic_fetch_sub(&dir->pending, 1) == 1) {
+    const long total = atomic_load(&dir->blocks);
+    const long total_entries = atomic_load(&dir->entries);
+    dir_report(scan, scan_local(scan), dir->path, total, total_entries);
+
+    dir_t *parent = dir->parent;
+    if (parent) {
+      atomic_fetch_add(&parent->blocks, total);
+      atomic_fetch_add(&parent->entries, total_entries);
+    } else {
+      atomic_fetch_add(&scan->blocks, total);
+    }
+
+    free(dir);
+    dir = parent;
+  }
+}
+
+static void dir_report(mdu_scan_t *restrict scan, local_t *restrict local,
+                       const char *restrict path, const long blocks,
+                       const long entries) {
+  if (local->top_dirs && heap_accepts(local->top_dirs, blocks)) {
+    heap_push(local->top_dirs, blocks, strdup(path));
+  }
+
+  if (scan->opts.on_dir) {
+    scan->opts.on_dir(path, blocks, scan->opts.user);
+  }
+
+  if (scan->opts.hints_out && entries >= HINT_MIN_ENTRIES) {
+    records_add(&local->hints, path, entries);
+  }
+
+  if (scan->opts.snapshot_out) {
+    records_add(&local->dirs, path, blocks);
+  }
+}
+
+static void count_tree(dir_t *root) {
+  mdu_scan_t *scan = root->scan;
+  local_t *local = scan_local(scan);
+
+  // plain scans get copies of the walk without any of the features
+  if (scan->features == 0) {
+    count_tree_kernel(root, local, 0);
+  } else if (scan->features == F_INODES) {
+    count_tree_kernel(root, local, F_INODES);
+  } else {
+    count_tree_kernel(root, local, scan->features);
+  }
+}
+
+static inline __attribute__((always_inline)) void
+count_tree_kernel(dir_t *restrict root, local_t *restrict local,
+                  const unsigned features) {
+  mdu_scan_t *scan = root->scan;
+  char buf[TREE_BUF_SIZE];
+
+  tree_t tree;
+  const size_t root_len = strlen(root->path);
+  tree.path_cap = root_len + 1 > TREE_MIN_CAP ? root_len + 1 : TREE_MIN_CAP;
+  tree.path = malloc(tree.path_cap);
+  memcpy(tree.path, root->path, root_len + 1);
+  tree.names_len = 0;
+  tree.names_cap = TREE_MIN_CAP;
+  tree.names = malloc(tree.names_cap);
+  tree.frames_cap = 64;
+  tree.frames = malloc(tree.frames_cap * sizeof(frame_t));
+  tree.depth = 1;
+  tree.frames[0] = (frame_t){root_len, 0, -1, 0, 0, 0, 0};
+
+  tree_read(&tree, scan, local, buf, features);
+
+  while (tree.depth > 1 || tree.frames[0].next < tree.names_len) {
+    frame_t *top = &tree.frames[tree.depth - 1];
+
+    if (top->next < tree.names_len) {
+      long blocks;
+      memcpy(&blocks, tree.names + top->next, sizeof(long));
+      const char *name = tree.names + top->next + sizeof(long);
+      const size_t len = strlen(name);
+      top->next += sizeof(long) + len + 1;
+
+      tree_push(&tree, name, len, blocks);
+      tree_read(&tree, scan, local, buf, features);
+      continue;
+    }
+
+    // every subdirectory is done, so the directory is
+    if (features & F_TRACK_DIRS) {
+      dir_report(scan, local, tree.path, top->blocks, top->entries);
+    }
+
+    if (top->fd >= 0) {
+      scan_close(scan, top->fd);
+    }
+
+    frame_t *parent = top - 1;
+    parent->blocks += top->blocks;
+    parent->entries += top->entries;
+    tree.names_len = top->first;
+    tree.path[parent->path_len] = '\0';
+    tree.depth--;
+  }
+
+  if (tree.frames[0].fd >= 0) {
+    scan_close(scan, tree.frames[0].fd);
+  }
+
+  const long blocks = tree.frames[0].blocks;
+  const long entries = tree.frames[0].entries;
+  free(tree.path);
+  free(tree.names);
+  free(tree.frames);
+
+  // the root job holds its own blocks, as in a parallel scan
+  dir_finish(root, blocks, entries);
+  scan_job_done(scan);
+}
+
+static inline __attribute__((always_inline)) void
+tree_read(tree_t *restrict tree, mdu_scan_t *restrict scan,
+          local_t *restrict local, char *restrict buf,
+          const unsigned features) {
+  frame_t *frame = &tree->frames[tree->depth - 1];
+  frame->first = tree->names_len;
+  frame->next = tree->names_len;
+
+  // a cancelled scan skips every directory left, which stay on the stack
+  if (atomic_load_explicit(&scan->cancelled, memory_order_relaxed)) {
+    atomic_fetch_add_explicit(&scan->unscanned, 1, memory_order_relaxed);
+    return;
+  }
+
+  if (features & F_LIMIT) {
+    scan_io(scan, local);
+  }
+
+  // opened from the parent when it is open, which saves the path lookup
+  const frame_t *parent =
+      tree->depth > 1 ? &tree->frames[tree->depth - 2] : NULL;
+  const int fd = parent && parent->fd >= 0
+                     ? scan_open(scan, parent->fd, tree->path + frame->name)
+                     : scan_open(scan, AT_FDCWD, tree->path);
+  if (fd < 0) {
+    return;
+  }
+
+  long blocks = 0;
+  long entries = 0;
+  long counted = 0;
+  int nread;
+
+  while ((nread = scan_getdents(scan, fd, buf, TREE_BUF_SIZE)) > 0) {
+    for (int bpos = 0; bpos < nread;) {
+      struct linux_dirent64 *d = (struct linux_dirent64 *)(buf + bpos);
+      bpos += d->d_reclen;
+
+      if (is_dot(d->d_name)) {
+        continue;
+      }
+
+      if (features & F_LIMIT) {
+        scan_io(scan, local);
+      }
+
+      struct stat filestat;
+      long size;
+      const int is_dir =
+          entry_size(scan->opts.fs, fd, d->d_name, d->d_type, &filestat,
+                     &size, features);
+      if (is_dir < 0) {
+        continue;
+      }
+      entries++;
+
+      const bool matches =
+          !(features & F_WHERE) || where_match(scan->opts.where, &filestat);
+      if (!matches) {
+        if (!is_dir) {
+          continue;
+        }
+        size = 0;
+      }
+
+      if ((features & F_SUMMARY) && matches) {
+        summary_add(&local->summary, &filestat);
+      }
+
+      if ((features & F_GROUP) && matches) {
+        groups_add(local->groups, &filestat, d->d_name, size);
+      }
+
+      if ((features & F_ON_ENTRY) && matches) {
+        const mdu_entry_t entry = {tree->path, d->d_name, &filestat};
+        scan->opts.on_entry(&entry, scan->opts.user);
+      }
+
+      if (!is_dir) {
+        blocks += size;
+
+        if ((features & F_TOP_FILES) &&
+            heap_accepts(local->top_files, filestat.st_blocks)) {
+          heap_push(local->top_files, filestat.st_blocks,
+                    append_filename(tree->path, d->d_name));
+        }
+      } else if (features & F_TRACK_DIRS) {
+        tree_add_name(tree, d->d_name, size);
+        if (scan->opts.exceeds > 0) {
+          scan_count(scan, size);
+        }
+      } else {
+        blocks += size;
+        tree_add_name(tree, d->d_name, 0);
+      }
+    }
+
+    if (scan->opts.exceeds > 0) {
+      scan_count(scan, blocks - counted);
+      counted = blocks;
+    }
+    if (atomic_load_explicit(&scan->cancelled, memory_order_relaxed)) {
+      break;
+    }
+  }
+
+  // left before the end, so the directory is only partly counted
+  if (nread > 0) {
+    atomic_fetch_add_explicit(&scan->unscanned, 1, memory_order_relaxed);
+  }
+
+  // kept open for the subdirectories, as long as few are open
+  if (tree->names_len > frame->first && tree->depth <= TREE_MAX_FDS) {
+    frame->fd = fd;
+  } else {
+    scan_close(scan, fd);
+  }
+
+  progress_add(local, blocks, entries);
+  frame->blocks += blocks;
+  frame->entries += entries;
+}
+
+static void tree_push(tree_t *restrict tree, const char *restrict name,
+                      const size_t len, const long blocks) {
+  size_t path_len = tree->frames[tree->depth - 1].path_len;
+
+  if (path_len + len + 2 > tree->path_cap) {
+    while (path_len + len + 2 > tree->path_cap) {
+      tree->path_cap *= 2;
+    }
+    tree->path = realloc(tree->path, tree->path_cap);
+  }
+
+  if (tree->path[path_len - 1] != '/') {
+    tree->path[path_len++] = '/';
+  }
+  memcpy(tree->path + path_len, name, len + 1);
+
+  if (tree->depth == tree->frames_cap) {
+    tree->frames_cap *= 2;
+    tree->frames = realloc(tree->frames, tree->frames_cap * sizeof(frame_t));
+  }
+
+  tree->frames[tree->depth++] = (frame_t){
+      path_len + len, path_len, -1, tree->names_len, tree->names_len, blocks,
+      0};
+}
+
+static inline void tree_add_name(tree_t *restrict tree,
+                                 const char *restrict name,
+                                 const long blocks) {
+  const size_t size = sizeof(long) + strlen(name) + 1;
+
+  if (tree->names_len + size > tree->names_cap) {
+    while (tree->names_len + size > tree->names_cap) {
+      tree->names_cap *= 2;
+    }
+    tree->names = realloc(tree->names, tree->names_cap);
+  }
+
+  memcpy(tree->names + tree->names_len, &blocks, sizeof(long));
+  memcpy(tree->names + tree->names_len + sizeof(long), name,
+         size - sizeof(long));
+  tree->names_len += size;
+}
+
+static inline void dir_add_work(mdu_scan_t *restrict scan,
+                                dir_t *restrict dir) {
+  if (!scan->opts.hints) {
+    tpool_add_work(scan->pool, dir);
+    return;
+  }
+
+  // one level per factor of 10 above the smallest hint
+  short prio = 0;
+  for (long cost = hints_get(scan->opts.hints, dir->path);
+       cost >= HINT_MIN_ENTRIES; cost /= 10) {
+    prio++;
+  }
+
+  tpool_add_work_prio(scan->pool, dir, prio);
+}
+
+static device_t *scan_device(mdu_scan_t *restrict scan,
+                             device_t *restrict hint, const dev_t dev) {
+  if (hint && hint->dev == dev) {
+    return hint;
+  }
+
+  // devices are published by NR_DEVICES, so they can be searched unlocked
+  int n = atomic_load_explicit(&scan->nr_devices, memory_order_acquire);
+  for (int i = 0; i < n; i++) {
+    if (scan->devices[i].dev == dev) {
+      return &scan->devices[i];
+    }
+  }
+
+  pthread_mutex_lock(&scan->devices_lock);
+
+  device_t *device = NULL;
+  n = atomic_load_explicit(&scan->nr_devices, memory_order_relaxed);
+  for (int i = 0; i < n && !device; i++) {
+    if (scan->devices[i].dev == dev) {
+      device = &scan->devices[i]; // added while waiting for the lock
+    }
+  }
+
+  if (!device && n < MAX_DEVICES) {
+    device = &scan->devices[n];
+    pthread_mutex_init(&device->lock, NULL);
+    device->dev = dev;
+    device->limit = scan->opts.device_jobs == MDU_DEVICE_AUTO
+                        ? device_auto_limit(dev, scan->nr_workers)
+                        : scan->opts.device_jobs;
+    atomic_store_explicit(&scan->nr_devices, n + 1, memory_order_release);
+  }
+
+  pthread_mutex_unlock(&scan->devices_lock);
+  return device;
+}
+
+static int device_auto_limit(const dev_t dev, const int workers) {
+  // a partition has no queue of its own, the disk above it has
+  static const char *const paths[] = {"/sys/dev/block/%u:%u/queue/rotational",
+                                      "/sys/dev/block/%u:%u/../queue/"
+                                      "rotational"};
+
+  for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), paths[i], major(dev), minor(dev));
+
+    FILE *f = fopen(path, "r");
+    if (!f) {
+      continue;
+    }
+
+    const int rotational = fgetc(f) == '1';
+    fclose(f);
+    return rotational ? DEVICE_HDD_JOBS : workers;
+  }
+
+  return workers;
+}
+
+static bool device_acquire(dir_t *dir) {
+  device_t *device = dir->device;
+  if (dir->slot) {
+    return true; // handed over by device_release()
+  }
+
+  pthread_mutex_lock(&device->lock);
+
+  const bool free_slot = device->active < device->limit;
+  if (free_slot) {
+    device->active++;
+    dir->slot = true;
+  } else {
+    dir->next = device->waiting;
+    device->waiting = dir;
+  }
+
+  pthread_mutex_unlock(&device->lock);
+  return free_slot;
+}
+
+static void device_release(dir_t *dir) {
+  if (!dir->slot) {
+    return;
+  }
+
+  device_t *device = dir->device;
+  dir->slot = false;
+
+  pthread_mutex_lock(&device->lock);
+
+  dir_t *next = device->waiting;
+  if (next) {
+    device->waiting = next->next;
+    next->slot = true; // the slot goes straight to the parked job
+  } else {
+    device->active--;
+  }
+
+  pthread_mutex_unlock(&device->lock);
+
+  if (next) {
+    dir_add_work(dir->scan, next);
+  }
+}
+
+static void records_add(records_t *restrict r, const char *restrict path,
+                        const long val) {
+  if (r->len == r->cap) {
+    r->cap = r->cap ? 2 * r->cap : 16;
+    r->v = realloc(r->v, r->cap * sizeof(record_t));
+  }
+
+  r->v[r->len].path = strdup(path);
+  r->v[r->len].val = val;
+  r->len++;
+}
+
+static void scan_job_done(mdu_scan_t *scan) {
+  if (atomic_fetch_sub(&scan->pending, 1) != 1) {
+    return;
+  }
+
+  if (scan->opts.on_done) {
+    scan->opts.on_done(scan, scan->opts.user);
+  }
+
+  // the scan may be destroyed as soon as this is posted
+  sem_post(&scan->finished);
+}
+
+static inline void progress_add(local_t *restrict local, const long blocks,
+                                const long entries) {
+  atomic_store_explicit(
+      &local->done_blocks,
+      atomic_load_explicit(&local->done_blocks, memory_order_relaxed) + blocks,
+      memory_order_relaxed);
+  atomic_store_explicit(
+      &local->done_entries,
+      atomic_load_explicit(&local->done_entries, memory_order_relaxed) +
+          entries,
+      memory_order_relaxed);
+
+  // shared between the scans of the segment, which may run at once
+  if (local->stats) {
+    atomic_fetch_add_explicit(&local->stats->blocks, blocks,
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&local->stats->entries, entries,
+                              memory_order_relaxed);
+  }
+}
+
+static inline void scan_io(mdu_scan_t *restrict scan,
+                           local_t *restrict local) {
+  if (--local->tokens >= 0) {
+    return;
+  }
+
+  const long batch = ratelimit_batch(scan->limit);
+  ratelimit_take(scan->limit, batch);
+  local->tokens = batch - 1;
+}
+
+static void scan_finish(mdu_scan_t *scan) {
+  scan->done = true;
+  stats_t *stats = scan->opts.stats;
+
+  if (stats) {
+    atomic_store(&stats->phase, STATS_MERGING);
+  }
+
+  if (scan->pipelined) {
+    stage_stop(scan);
+  }
+
+  scan_merge(scan);
+
+  // idle once the last scan running is done
+  if (stats && atomic_fetch_add(&stats->scans_done, 1) + 1 ==
+                   atomic_load(&stats->scans)) {
+    atomic_store(&stats->phase, STATS_IDLE);
+  }
+}
+
+static inline local_t *scan_local(mdu_scan_t *scan) {
+  const short id = tpool_worker_id();
+
+  return &scan->locals[id >= 0 ? id : scan->nr_workers + stage_id];
+}
+
+static void enumerate_dir(dir_t *dir, const int fd) {
+  mdu_scan_t *scan = dir->scan;
+  dir->fd = fd;
+
+  bool read_all = false;
+  while (!atomic_load_explicit(&scan->cancelled, memory_order_relaxed)) {
+    batch_t *batch = malloc(sizeof(batch_t));
+    batch->len = scan_getdents(scan, fd, batch->buf, sizeof(batch->buf));
+    if (batch->len <= 0) {
+      free(batch);
+      read_all = true;
+      break;
+    }
+
+    // the batch keeps the directory and the scan pending until it is counted
+    batch->dir = dir;
+    atomic_fetch_add(&dir->fd_refs, 1);
+    atomic_fetch_add(&dir->pending, 1);
+    atomic_fetch_add_explicit(&scan->pending, 1, memory_order_relaxed);
+
+    if (queue_push(scan->batches, batch)) {
+      sem_post(&scan->batch_ready);
+    } else {
+      batch_count(batch); // the stat threads are behind, help them
+    }
+  }
+
+  // stopped by a cancel before the end, so only partly counted
+  if (!read_all) {
+    atomic_fetch_add_explicit(&scan->unscanned, 1, memory_order_relaxed);
+  }
+
+  dir_release_fd(dir);
+  device_release(dir);
+  dir_finish(dir, 0, 0);
+  scan_job_done(scan);
+}
+
+static void batch_count(batch_t *batch) {
+  dir_t *dir = batch->dir;
+  mdu_scan_t *scan = dir->scan;
+  long blocks = 0;
+  long entries = 0;
+
+  local_t *local = scan_local(scan);
+  count_buffer(dir, local, dir->fd, batch->buf, batch->len, &blocks,
+               &entries);
+  free(batch);
+  if (scan->opts.exceeds > 0) {
+    scan_count(scan, blocks);
+  }
+  progress_add(local, blocks, entries);
+
+  dir_release_fd(dir);
+  dir_finish(dir, blocks, entries);
+  scan_job_done(scan);
+}
+
+static inline void dir_release_fd(dir_t *dir) {
+  if (atomic_fetch_sub(&dir->fd_refs, 1) == 1) {
+    scan_close(dir->scan, dir->fd);
+  }
+}
+
+static void *stat_thread(void *arg) {
+  mdu_scan_t *scan = (mdu_scan_t *)arg;
+  stage_id = atomic_fetch_add(&scan->stage_ids, 1);
+
+  for (;;) {
+    sem_wait(&scan->batch_ready);
+
+    // NULL either means stop or that a push ahead of ours is not done yet
+    batch_t *batch;
+    while (!(batch = queue_pop(scan->batches))) {
+      if (atomic_load(&scan->stage_stop)) {
+        return NULL;
+      }
+      sched_yield();
+    }
+
+    batch_count(batch);
+  }
+}
+
+static void stage_start(mdu_scan_t *scan) {
+  const short n = scan->opts.stat_threads;
+
+  scan->batches = queue_create(STAGE_QUEUE_LEN);
+  sem_init(&scan->batch_ready, 0, 0);
+  atomic_init(&scan->stage_stop, false);
+  atomic_init(&scan->stage_ids, 0);
+
+  scan->stat_thrds = calloc(n, sizeof(pthread_t));
+  for (short i = 0; i < n; i++) {
+    pthread_create(&scan->stat_thrds[i], NULL, stat_thread, scan);
+  }
+}
+
+static void stage_stop(mdu_scan_t *scan) {
+  const short n = scan->opts.stat_threads;
+
+  // every batch is counted once the scan is done, so the queue is empty
+  atomic_store(&scan->stage_stop, true);
+  for (short i = 0; i < n; i++) {
+    sem_post(&scan->batch_ready);
+  }
+  for (short i = 0; i < n; i++) {
+    pthread_join(scan->stat_thrds[i], NULL);
+  }
+
+  free(scan->stat_thrds);
+  queue_destroy(scan->batches);
+  sem_destroy(&scan->batch_ready);
+}
+
+static inline char *append_filename(const char *restrict f1,
+                                    const char *restrict f2) {
+  short base_len = strlen(f1);
+  short name_len = strlen(f2);
+  short tot_len = name_len + base_len + 2;
+  char *new_file = malloc(tot_len * sizeof(char));
+
+  memcpy(new_file, f1, base_len);
+
+  if (f1[base_len - 1] != '/')
+    new_file[base_len++] = '/';
+
+  memcpy(new_file + base_len, f2, name_len);
+  new_file[base_len + name_len] = '\0';
+
+  return new_file;
+}
+
+static inline void summary_add(mdu_summary_t *restrict summary,
+                               const struct stat *restrict filestat) {
+  if (S_ISREG(filestat->st_mode)) {
+    const unsigned long size = filestat->st_size;
+    summary->files++;
+    summary->hist[size ? 64 - __builtin_clzl(size) : 0]++;
+  } else if (S_ISDIR(filestat->st_mode)) {
+    summary->dirs++;
+  } else if (S_ISLNK(filestat->st_mode)) {
+    summary->symlinks++;
+  } else {
+    summary->others++;
+  }
+}
+
+static inline int scan_open(const mdu_scan_t *restrict scan, const int dirfd,
+                            const char *restrict path) {
+  fs_t *fs = scan->opts.fs;
+  if (fs) {
+    return fs->openat(fs, dirfd, path);
+  }
+
+  return openat(dirfd, path, O_RDONLY | O_DIRECTORY | O_NONBLOCK);
+}
+
+static inline int scan_getdents(const mdu_scan_t *restrict scan,
+                                const int fd, char *restrict buf,
+                                const int size) {
+  fs_t *fs = scan->opts.fs;
+  if (fs) {
+    return fs->getdents(fs, fd, buf, size);
+  }
+
+  return syscall(SYS_getdents64, fd, buf, size);
+}
+
+static inline void scan_close(const mdu_scan_t *scan, const int fd) {
+  fs_t *fs = scan->opts.fs;
+  if (fs) {
+    fs->close(fs, fd);
+  } else {
+    close(fd);
+  }
+}
+
+static inline void scan_count(mdu_scan_t *scan, const long blocks) {
+  const long total =
+      atomic_fetch_add_explicit(&scan->counted, blocks, memory_order_relaxed) +
+      blocks;
+
+  if (total > scan->opts.exceeds) {
+    mdu_scan_cancel(scan);
+  }
+}
+
+static void scan_merge(mdu_scan_t *scan) {
+  if (scan->merged) {
+    return;
+  }
+
+  local_t *all = &scan->locals[0];
+  mdu_summary_t *total = &scan->summary;
+
+  if (all->groups) {
+    groups_t **groups = malloc(scan->nr_locals * sizeof(groups_t *));
+    for (short i = 0; i < scan->nr_locals; i++) {
+      groups[i] = scan->locals[i].groups;
+    }
+    groups_merge(groups, scan->nr_locals);
+    free(groups);
+  }
+
+  for (short i = 0; i < scan->nr_locals; i++) {
+    local_t *l = &scan->locals[i];
+
+    if (i > 0 && all->top_files) {
+      heap_merge(all->top_files, l->top_files);
+    }
+    if (i > 0 && all->top_dirs) {
+      heap_merge(all->top_dirs, l->top_dirs);
+    }
+
+    total->files += l->summary.files;
+    total->dirs += l->summary.dirs;
+    total->symlinks += l->summary.symlinks;
+    total->others += l->summary.others;
+    for (short k = 0; k < MDU_HIST_BUCKETS; k++) {
+      total->hist[k] += l->summary.hist[k];
+    }
+
+    for (long k = 0; k < l->hints.len; k++) {
+      hints_put(scan->opts.hints_out, l->hints.v[k].path, l->hints.v[k].val);
+    }
+
+    // the snapshot takes the paths over
+    for (long k = 0; k < l->dirs.len; k++) {
+      snapshot_builder_add(scan->opts.snapshot_out, l->dirs.v[k].path,
+                           l->dirs.v[k].val);
+    }
+    l->dirs.len = 0;
+  }
+
+  scan->merged = true;
+}
+
+static bool scan_hold(dir_t *dir) {
+  mdu_scan_t *scan = dir->scan;
+
+  // HOLDING may have been cleared since it was read
+  pthread_mutex_lock(&scan->hold_lock);
+  const bool hold = atomic_load(&scan->holding);
+  if (hold) {
+    dir->next = scan->held;
+    scan->held = dir;
+    scan->nr_held++;
+  }
+  pthread_mutex_unlock(&scan->hold_lock);
+
+  return hold;
+}
+
+static void scan_resume(mdu_scan_t *restrict scan,
+                        const checkpoint_t *restrict cp) {
+  local_t *local = &scan->locals[0];
+
+  atomic_store(&scan->blocks, cp->blocks);
+  atomic_store(&scan->counted, cp->blocks);
+  progress_add(local, cp->blocks, cp->entries);
+  if (scan->opts.summary && cp->nr_counters == SUMMARY_COUNTERS) {
+    memcpy(&scan->summary, cp->counters, sizeof(mdu_summary_t));
+  }
+
+  // the start is a pending job until every directory is added, so the scan
+  // can not end in between, and ends here if none is left
+  atomic_fetch_add(&scan->pending, 1);
+  for (const char *p = cp->dirs; p < cp->dirs + cp->dirs_len;
+       p += strlen(p) + 1) {
+    dir_t *dir = dir_create(scan, p, NULL, "", 0);
+    dir->path[strlen(p)] = '\0'; // no trailing slash
+    dir_add_work(scan, dir);
+  }
+  scan_job_done(scan);
+}
+
+static _Noreturn void procs_run(shard_t *restrict shard, const int id,
+                                const char *restrict path,
+                                const mdu_options_t *restrict opts) {
+  mdu_options_t o = *opts;
+  o.pool = mdu_pool_create(opts->nr_threads); // threads are not forked
+  o.shard = shard;
+  o.stats = NULL;
+  shard_result_t *result = shard_result(shard, id);
+
+  // the others wait for the root, so its process hands it back either way
+  int ret = 0;
+  if (id == 0) {
+    ret = procs_scan(path, &o, result);
+    shard_done(shard, 1);
+  }
+
+  checkpoint_t *cp = checkpoint_create(path, 0);
+  long n;
+  while ((n = shard_take(shard, cp)) > 0) {
+    o.resume = cp;
+    ret = procs_scan(path, &o, result) || ret ? -1 : 0;
+    shard_done(shard, n);
+
+    cp->dirs_len = 0;
+    cp->nr_dirs = 0;
+  }
+  checkpoint_destroy(cp);
+
+  tpool_destroy(o.pool);
+  _exit(ret ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+static int procs_scan(const char *restrict path,
+                      const mdu_options_t *restrict opts,
+                      shard_result_t *restrict result) {
+  mdu_scan_t *scan = mdu_scan_start(path, opts);
+  if (!scan) {
+    return -1;
+  }
+
+  mdu_scan_wait(scan);
+  result->blocks += mdu_scan_blocks(scan);
+  const mdu_summary_t *summary = mdu_scan_summary(scan);
+  for (size_t k = 0; summary && k < SUMMARY_COUNTERS; k++) {
+    result->counters[k] += ((const long *)summary)[k];
+  }
+  mdu_scan_destroy(scan);
+
+  return 0;
+}
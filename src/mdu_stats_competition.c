@@ -0,0 +1,278 @@
+/**
+ * This program reads the live counters of an mdu run with --stats-shm NAME,
+ * see stats_competition.h. It prints a line per interval until the run exits:
+ * the phase, the entries and bytes counted with their rates over the
+ * interval, the jobs queued in the pool, the steals and the share of the time
+ * the workers were idle. With -w every thread gets a line as well.
+ *
+ * @file mdu_stats_competition.c
+ * @author Elias Svensson (c24esn@cs.umu.se)
+ * @date 2025-11-14
+ */
+
+// --------------- Headers -------------------------------------------------- //
+
+#include "stats_competition.h"
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// --------------- Constants ------------------------------------------------ //
+
+#define DEFAULT_INTERVAL 1.0 /* Seconds between two samples */
+#define MAX_WORKERS 4096
+
+// --------------- Structs -------------------------------------------------- //
+
+/**
+ * @typedef sample_t
+ * @brief the counters of a segment at one moment, summed over the threads
+ *
+ */
+typedef struct sample_t {
+  long time;    /* CLOCK_MONOTONIC in ns */
+  long entries;
+  long blocks;
+  long queued;  /* Jobs added but not taken */
+  long steals;
+  long idle_ns; /* Over every worker, including the waits going on */
+  long worker_idle_ns[MAX_WORKERS];
+} sample_t;
+
+// --------------- Declaration of internal functions ------------------------ //
+
+/**
+ * @brief Read the counters of a segment
+ *
+ * @param stats     the segment
+ * @param sample    set to the counters
+ */
+static void sample_read(const stats_t *restrict stats,
+                        sample_t *restrict sample);
+
+/**
+ * @brief Print a sample and its rates since the last one
+ *
+ * @param stats     the segment
+ * @param now       the sample to print
+ * @param last      the sample before it
+ * @param workers   print a line per thread as well
+ */
+static void sample_print(const stats_t *restrict stats,
+                         const sample_t *restrict now,
+                         const sample_t *restrict last, const bool workers);
+
+/**
+ * @brief Format a size in bytes with a binary unit
+ *
+ * @param buf       a buffer of at least 16 bytes
+ * @param bytes     the size
+ */
+static void format_size(char *buf, const double bytes);
+
+/**
+ * @brief Get the time of CLOCK_MONOTONIC in ns
+ */
+static long now_ns(void);
+
+/**
+ * @brief Find out if the writer of a segment is gone
+ *
+ * @param stats     the segment
+ * @return          true if the writer exited
+ */
+static bool writer_exited(const stats_t *stats);
+
+// --------------- Definition of functions ---------------------------------- //
+
+int main(int argc, char *argv[]) {
+  double interval = DEFAULT_INTERVAL;
+  long count = 0;
+  bool workers = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "i:n:w")) != -1) {
+    if (opt == 'i') {
+      interval = atof(optarg);
+    } else if (opt == 'n') {
+      count = atol(optarg);
+    } else if (opt == 'w') {
+      workers = true;
+    } else {
+      optind = argc; // prints the usage below
+      break;
+    }
+  }
+
+  if (optind != argc - 1 || interval <= 0 || count < 0) {
+    fprintf(stderr, "usage: %s [-i SECONDS] [-n COUNT] [-w] NAME\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  const stats_t *stats = stats_open(argv[optind]);
+  if (!stats) {
+    fprintf(stderr, "%s: cannot open '%s': %s\n", argv[0], argv[optind],
+            errno == EPROTO ? "not a segment of this version"
+                            : strerror(errno));
+    return EXIT_FAILURE;
+  }
+  if (stats->nr_workers > MAX_WORKERS) {
+    fprintf(stderr, "%s: too many workers\n", argv[0]);
+    stats_close(stats);
+    return EXIT_FAILURE;
+  }
+
+  sample_t *samples = malloc(2 * sizeof(sample_t));
+  sample_t *last = &samples[0];
+  sample_t *now = &samples[1];
+  sample_read(stats, last);
+
+  // the first line covers the run so far
+  last->time = stats->started;
+  last->entries = last->blocks = last->steals = last->idle_ns = 0;
+  memset(last->worker_idle_ns, 0, sizeof(last->worker_idle_ns));
+
+  const struct timespec ts = {(time_t)interval,
+                              (long)((interval - (long)interval) * 1e9)};
+  for (long i = 0; count == 0 || i < count; i++) {
+    if (i > 0) {
+      nanosleep(&ts, NULL);
+    }
+
+    const bool exited = writer_exited(stats);
+    sample_read(stats, now);
+    sample_print(stats, now, last, workers);
+    if (exited) {
+      break;
+    }
+
+    sample_t *tmp = last;
+    last = now;
+    now = tmp;
+  }
+
+  free(samples);
+  stats_close(stats);
+
+  return EXIT_SUCCESS;
+}
+
+static void sample_read(const stats_t *restrict stats,
+                        sample_t *restrict sample) {
+  const tpool_counters_t *pool = stats_pool(stats);
+  long added = 0;
+  long jobs = 0;
+
+  memset(sample, 0, sizeof(sample_t));
+  sample->time = now_ns();
+
+  // the jobs taken are read before the jobs added, so QUEUED is never
+  // negative: a job is counted as added before it can be taken
+  for (short i = 0; i <= stats->nr_workers; i++) {
+    jobs += atomic_load_explicit(&pool[i].jobs, memory_order_relaxed);
+  }
+  for (short i = 0; i <= stats->nr_workers; i++) {
+    added += atomic_load_explicit(&pool[i].added, memory_order_relaxed);
+  }
+  sample->queued = added - jobs;
+
+  for (short i = 0; i < stats->nr_workers; i++) {
+    const long since =
+        atomic_load_explicit(&pool[i].idle_since, memory_order_relaxed);
+    long idle = atomic_load_explicit(&pool[i].idle_ns, memory_order_relaxed);
+    if (since > 0 && since < sample->time) {
+      idle += sample->time - since;
+    }
+
+    sample->worker_idle_ns[i] = idle;
+    sample->idle_ns += idle;
+    sample->steals +=
+        atomic_load_explicit(&pool[i].steals, memory_order_relaxed);
+  }
+
+  for (short i = 0; i < stats->nr_threads; i++) {
+    const stats_thread_t *t = stats_thread(stats, i);
+    sample->entries += atomic_load_explicit(&t->entries, memory_order_relaxed);
+    sample->blocks += atomic_load_explicit(&t->blocks, memory_order_relaxed);
+  }
+}
+
+static void sample_print(const stats_t *restrict stats,
+                         const sample_t *restrict now,
+                         const sample_t *restrict last, const bool workers) {
+  const double seconds = (now->time - last->time) / 1e9;
+  const double span = seconds > 0 ? seconds : 1;
+  const int block_size = atomic_load(&stats->block_size);
+  char size[16];
+  char rate[16];
+
+  format_size(size, (double)now->blocks * block_size);
+  format_size(rate, (now->blocks - last->blocks) * (double)block_size / span);
+
+  double idle = (now->idle_ns - last->idle_ns) /
+                (span * 1e9 * stats->nr_workers);
+  idle = idle < 0 ? 0 : idle > 1 ? 1 : idle;
+
+  const int phase = atomic_load(&stats->phase);
+  printf("%-8s\t%ld entries\t%.0f entries/s\t", stats_phase_name(phase),
+         now->entries, (now->entries - last->entries) / span);
+  if (block_size > 0) {
+    printf("%s\t%s/s\t", size, rate);
+  }
+  printf("%ld queued\t%ld steals\t%.0f%% idle\n", now->queued, now->steals,
+         idle * 100);
+
+  if (!workers) {
+    fflush(stdout);
+    return;
+  }
+
+  const tpool_counters_t *pool = stats_pool(stats);
+  for (short i = 0; i < stats->nr_threads; i++) {
+    const stats_thread_t *t = stats_thread(stats, i);
+    const long entries =
+        atomic_load_explicit(&t->entries, memory_order_relaxed);
+
+    if (i >= stats->nr_workers) {
+      printf("  stat %d\t%ld entries\n", i - stats->nr_workers, entries);
+      continue;
+    }
+
+    const double worker_idle =
+        (now->worker_idle_ns[i] - last->worker_idle_ns[i]) / (span * 1e9);
+    printf("  worker %d\t%ld entries\t%ld jobs\t%ld steals\t%.0f%% idle\n", i,
+           entries, atomic_load_explicit(&pool[i].jobs, memory_order_relaxed),
+           atomic_load_explicit(&pool[i].steals, memory_order_relaxed),
+           (worker_idle < 0 ? 0 : worker_idle > 1 ? 1 : worker_idle) * 100);
+  }
+  fflush(stdout);
+}
+
+static void format_size(char *buf, const double bytes) {
+  static const char units[] = "BKMGTPE";
+
+  double size = bytes;
+  short unit = 0;
+  for (; size >= 1024 && units[unit + 1]; unit++) {
+    size /= 1024;
+  }
+
+  snprintf(buf, 16, "%.1f%c", size, units[unit]);
+}
+
+static long now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static bool writer_exited(const stats_t *stats) {
+  return atomic_load(&stats->phase) == STATS_EXITED ||
+         (kill(stats->pid, 0) && errno == ESRCH);
+}
@@ -0,0 +1,126 @@
+/**
+ * This module implements the bounded queue, see queue_competition.h. It is the
+ * ring of Dmitry Vyukov: a cell at position pos is free for a push when its
+ * sequence is pos and holds a value for a pop when its sequence is pos + 1.
+ * A pop hands the cell on to the push one lap later by setting the sequence
+ * to pos + capacity.
+ *
+ * @file queue_competition.c
+ * @author Elias Svensson (c24esn@cs.umu.se)
+ * @date 2025-11-07
+ */
+
+// --------------- Headers -------------------------------------------------- //
+
+#include "queue_competition.h"
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+// --------------- Structs -------------------------------------------------- //
+
+typedef struct cell_t {
+  atomic_size_t seq;
+  void *val;
+} cell_t;
+
+struct queue_t {
+  _Alignas(64) atomic_size_t head; /* Position of the next pop */
+  _Alignas(64) atomic_size_t tail; /* Position of the next push */
+  _Alignas(64) cell_t *cells;
+  size_t mask; /* capacity - 1 */
+};
+
+// --------------- Definition of external functions ------------------------- //
+
+queue_t *queue_create(const long capacity) {
+  size_t cap = 2;
+  while ((long)cap < capacity) {
+    cap *= 2;
+  }
+
+  queue_t *q = aligned_alloc(_Alignof(queue_t), sizeof(queue_t));
+  q->cells = malloc(cap * sizeof(cell_t));
+  q->mask = cap - 1;
+  atomic_init(&q->head, 0);
+  atomic_init(&q->tail, 0);
+
+  for (size_t i = 0; i < cap; i++) {
+    atomic_init(&q->cells[i].seq, i);
+  }
+
+  return q;
+}
+
+void queue_destroy(queue_t *q) {
+  if (!q) {
+    return;
+  }
+
+  free(q->cells);
+  free(q);
+}
+
+bool queue_push(queue_t *restrict q, void *restrict val) {
+  size_t pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+  cell_t *cell;
+
+  for (;;) {
+    cell = &q->cells[pos & q->mask];
+    const size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+    const ptrdiff_t diff = (ptrdiff_t)(seq - pos);
+
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&q->tail, &pos, pos + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      return false; // the cell of the last lap is not popped yet
+    } else {
+      pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    }
+  }
+
+  cell->val = val;
+  atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+
+  return true;
+}
+
+void *queue_pop(queue_t *q) {
+  size_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+  cell_t *cell;
+
+  for (;;) {
+    cell = &q->cells[pos & q->mask];
+    const size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+    const ptrdiff_t diff = (ptrdiff_t)(seq - (pos + 1));
+
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&q->head, &pos, pos + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      return NULL; // the cell is not pushed yet
+    } else {
+      pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    }
+  }
+
+  void *val = cell->val;
+  atomic_store_explicit(&cell->seq, pos + q->mask + 1, memory_order_release);
+
+  return val;
+}
+
+long queue_size(const queue_t *q) {
+  const size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+  const size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+  // the two loads are not atomic together, a pop between them may pass tail
+  return tail > head ? (long)(tail - head) : 0;
+}
@@ -0,0 +1,201 @@
+/**
+ * This module implements the token bucket, see ratelimit_competition.h. The
+ * bucket is a single timestamp, the time at which the next tokens are handed
+ * out (the "theoretical arrival time" of GCRA). Taking N tokens moves it N
+ * token costs ahead with a CAS and sleeps until the old time, so the threads
+ * queue up in time without any lock.
+ *
+ * With backoff, the first thread to take tokens after PSI_INTERVAL reads the
+ * stall time of /proc/pressure/io. If tasks stalled on I/O for more than
+ * PSI_HIGH of the interval the cost of a token is doubled, below PSI_LOW it is
+ * lowered by a quarter. The scan itself adds to the pressure, so the cost is
+ * never raised above PSI_MAX_SLOWDOWN times that of the cap. This keeps a
+ * predictable lower bound on the rate.
+ *
+ * @file ratelimit_competition.c
+ * @author Elias Svensson (c24esn@cs.umu.se)
+ * @date 2025-11-11
+ */
+
+// --------------- Headers -------------------------------------------------- //
+
+#include "ratelimit_competition.h"
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// --------------- Constants ------------------------------------------------ //
+
+#define NS_PER_SEC 1000000000L
+#define BATCHES_PER_SEC 64      /* Aim for this many batches per second */
+#define MAX_BATCH 64            /* The most tokens taken at a time */
+#define PSI_FILE "/proc/pressure/io"
+#define PSI_INTERVAL 250000000L /* ns between two reads of PSI_FILE */
+#define PSI_HIGH 0.10           /* Stalled share that halves the rate */
+#define PSI_LOW 0.02            /* Stalled share where the rate recovers */
+#define PSI_MAX_SLOWDOWN 16     /* Lowest rate is the cap divided by this */
+
+// --------------- Structs -------------------------------------------------- //
+
+struct ratelimit_t {
+  _Alignas(64) atomic_long tat; /* Time the next tokens are handed out, ns */
+  atomic_long cost;             /* ns per token at the current rate */
+  long min_cost;                /* Cost at the cap */
+  long batch;
+
+  int psi_fd;            /* PSI_FILE, -1 without backoff */
+  atomic_long psi_next;  /* Time of the next read of PSI_FILE */
+  atomic_long psi_time;  /* Time of the last read */
+  atomic_long psi_total; /* Stall time in us at the last read */
+};
+
+// --------------- Declaration of internal functions ------------------------ //
+
+/**
+ * @brief Get the time of CLOCK_MONOTONIC in ns
+ */
+static inline long now_ns(void);
+
+/**
+ * @brief Read the total stall time of PSI_FILE
+ *
+ * @param fd        an open file descriptor of PSI_FILE
+ * @return          the "some" stall time in us, -1 on error
+ */
+static long psi_read(const int fd);
+
+/**
+ * @brief Adjust the cost of a token to the I/O pressure since the last call
+ *
+ * @param rl        a pointer to a struct of type ratelimit_t
+ * @param now       the time now
+ */
+static void psi_adjust(ratelimit_t *rl, const long now);
+
+// --------------- Definition of external functions ------------------------- //
+
+ratelimit_t *ratelimit_create(const long rate, const bool backoff) {
+  ratelimit_t *rl = aligned_alloc(_Alignof(ratelimit_t), sizeof(ratelimit_t));
+
+  rl->min_cost = NS_PER_SEC / (rate > 0 ? rate : 1);
+  rl->batch = rate / BATCHES_PER_SEC;
+  if (rl->batch < 1) {
+    rl->batch = 1;
+  } else if (rl->batch > MAX_BATCH) {
+    rl->batch = MAX_BATCH;
+  }
+
+  const long now = now_ns();
+  atomic_init(&rl->tat, now);
+  atomic_init(&rl->cost, rl->min_cost);
+
+  rl->psi_fd = backoff ? open(PSI_FILE, O_RDONLY) : -1;
+  atomic_init(&rl->psi_next, now + PSI_INTERVAL);
+  atomic_init(&rl->psi_time, now);
+  atomic_init(&rl->psi_total, rl->psi_fd >= 0 ? psi_read(rl->psi_fd) : 0);
+
+  return rl;
+}
+
+void ratelimit_destroy(ratelimit_t *rl) {
+  if (!rl) {
+    return;
+  }
+
+  if (rl->psi_fd >= 0) {
+    close(rl->psi_fd);
+  }
+  free(rl);
+}
+
+long ratelimit_batch(const ratelimit_t *rl) {
+  return rl->batch;
+}
+
+void ratelimit_take(ratelimit_t *rl, const long n) {
+  const long now = now_ns();
+
+  if (rl->psi_fd >= 0) {
+    long next = atomic_load_explicit(&rl->psi_next, memory_order_relaxed);
+    if (now >= next &&
+        atomic_compare_exchange_strong(&rl->psi_next, &next,
+                                       now + PSI_INTERVAL)) {
+      psi_adjust(rl, now); // only the thread which moved PSI_NEXT
+    }
+  }
+
+  const long cost =
+      n * atomic_load_explicit(&rl->cost, memory_order_relaxed);
+  long tat = atomic_load_explicit(&rl->tat, memory_order_relaxed);
+  long grant;
+
+  // an idle bucket does not save up tokens, it starts over from now
+  do {
+    grant = tat > now ? tat : now;
+  } while (!atomic_compare_exchange_weak_explicit(&rl->tat, &tat,
+                                                  grant + cost,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed));
+
+  if (grant > now) {
+    const struct timespec ts = {grant / NS_PER_SEC, grant % NS_PER_SEC};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)) {
+      // interrupted, sleep for the rest
+    }
+  }
+}
+
+long ratelimit_rate(const ratelimit_t *rl) {
+  return NS_PER_SEC / atomic_load_explicit(&rl->cost, memory_order_relaxed);
+}
+
+// --------------- Definition of internal functions ------------------------- //
+
+static inline long now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+static long psi_read(const int fd) {
+  char buf[256];
+  const ssize_t len = pread(fd, buf, sizeof(buf) - 1, 0);
+  if (len <= 0) {
+    return -1;
+  }
+  buf[len] = '\0';
+
+  // the first line is "some avg10=... avg60=... avg300=... total=US"
+  const char *total = strstr(buf, "total=");
+  return total ? atol(total + strlen("total=")) : -1;
+}
+
+static void psi_adjust(ratelimit_t *rl, const long now) {
+  const long total = psi_read(rl->psi_fd);
+  const long last_total = atomic_exchange(&rl->psi_total, total);
+  const long last_time = atomic_exchange(&rl->psi_time, now);
+  if (total < 0 || last_total < 0 || now <= last_time) {
+    return;
+  }
+
+  const double stalled = (total - last_total) * 1000.0 / (now - last_time);
+  long cost = atomic_load_explicit(&rl->cost, memory_order_relaxed);
+
+  if (stalled > PSI_HIGH) {
+    cost *= 2;
+    if (cost > PSI_MAX_SLOWDOWN * rl->min_cost) {
+      cost = PSI_MAX_SLOWDOWN * rl->min_cost;
+    }
+  } else if (stalled < PSI_LOW) {
+    cost -= cost / 4;
+    if (cost < rl->min_cost) {
+      cost = rl->min_cost;
+    }
+  }
+
+  atomic_store_explicit(&rl->cost, cost, memory_order_relaxed);
+}
@@ -0,0 +1,962 @@
+/**
+ * This module implements the mdu query server, see server_competition.h. A
+ * single thread owns every client, request and cache entry and multiplexes
+ * them with poll(). Workers only talk back to it through a pipe, either when
+ * a scan is done or when a directory somebody is waiting for inside a running
+ * scan has been counted.
+ *
+ * @file server_competition.c
+ * @author Elias Svensson (c24esn@cs.umu.se)
+ * @date 2025-11-03
+ */
+
+// --------------- Preprocessor directives ---------------------------------- //
+
+#define _GNU_SOURCE // pipe2() and accept4()
+
+// --------------- Headers -------------------------------------------------- //
+
+#include "server_competition.h"
+#include "mdu_scan_competition.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+// --------------- Constants ------------------------------------------------ //
+
+#define IN_BUF_SIZE 4096     /* Max length of a request line */
+#define CACHE_BUCKETS 4096   /* Buckets in the result cache */
+#define CACHE_MAX 65536      /* Entries kept before the cache is purged */
+#define POLL_TIMEOUT_MS 1000 /* Max time between cache purges */
+
+#define DEFAULT_TTL 60
+#define DEFAULT_MAX_ACTIVE 8
+#define DEFAULT_MAX_PER_CLIENT 2
+
+// --------------- Structs -------------------------------------------------- //
+
+typedef struct client_t client_t;
+
+/**
+ * @typedef request_t
+ * @brief a path asked for by a client, not answered yet
+ *
+ */
+typedef struct request_t {
+  client_t *client;
+  char *path;             /* The path as sent by the client */
+  char *real;             /* The canonical path */
+  struct request_t *next; /* Next request in the same list */
+} request_t;
+
+struct client_t {
+  int fd;
+  char in[IN_BUF_SIZE];
+  size_t in_len;
+  char *out; /* Answers not written yet */
+  size_t out_len;
+  size_t out_cap;
+
+  request_t *queue; /* Requests waiting for a scan to be started */
+  request_t *queue_tail;
+  int active; /* Scans started for this client and still running */
+  int refs;   /* Requests and scans still referring to the client */
+  bool closed;
+
+  client_t *next;
+};
+
+/**
+ * @typedef interest_t
+ * @brief a directory inside a running scan which requests are waiting for
+ *
+ */
+typedef struct interest_t {
+  char *path;
+  long blocks; /* Set together with FOUND by a worker */
+  bool found;
+  request_t *waiters; /* Only touched by the server thread */
+  struct interest_t *next;
+} interest_t;
+
+typedef struct server_t server_t;
+
+/**
+ * @typedef inflight_t
+ * @brief a running scan and everyone waiting for it
+ *
+ */
+typedef struct inflight_t {
+  server_t *server;
+  char *path;
+  mdu_scan_t *scan;
+  client_t *owner;    /* The client the scan was started for */
+  request_t *waiters; /* Requests for PATH itself */
+
+  pthread_mutex_t lock;    /* Protects INTERESTS against the workers */
+  atomic_int nr_interests; /* Lets workers skip the lock when there are none */
+  interest_t *interests;
+
+  struct inflight_t *next;
+} inflight_t;
+
+typedef struct cache_entry_t {
+  char *path;
+  long blocks;
+  time_t expires;
+  struct cache_entry_t *next;
+} cache_entry_t;
+
+/**
+ * @typedef message_t
+ * @brief sent from a worker to the server thread through the pipe
+ *
+ */
+typedef struct message_t {
+  enum { MSG_DONE, MSG_INTEREST } type;
+  void *ptr; /* An inflight_t for MSG_DONE, else an interest_t */
+  inflight_t *inflight;
+} message_t;
+
+struct server_t {
+  server_options_t opts;
+  int listen_fd;
+  int pipe_fd[2];
+
+  client_t *clients;
+  unsigned turn; /* Round robin position among the clients */
+  inflight_t *inflight;
+  int nr_active;
+
+  cache_entry_t *cache[CACHE_BUCKETS];
+  int cache_len;
+};
+
+// --------------- Declaration of internal functions ------------------------ //
+
+/**
+ * @brief Create the listening socket and the pipe used by the workers
+ *
+ * @param s             the server
+ * @param socket_path   the path to bind to
+ * @return              0 on success, -1 on error
+ */
+static int server_open(server_t *restrict s, const char *restrict socket_path);
+
+/**
+ * @brief Wait for all running scans and free everything owned by the server
+ *
+ * @param s         the server
+ */
+static void server_close(server_t *s);
+
+/**
+ * @brief Accept a new client
+ *
+ * @param s         the server
+ */
+static void server_accept(server_t *s);
+
+/**
+ * @brief Read from a client and handle every complete line
+ *
+ * @param s         the server
+ * @param c         the client to read from
+ */
+static void client_read(server_t *restrict s, client_t *restrict c);
+
+/**
+ * @brief Write as much of the pending answers as the socket takes
+ *
+ * @param c         the client to write to
+ */
+static void client_flush(client_t *c);
+
+/**
+ * @brief Mark a client as closed. Queued requests are dropped and the
+ * structure is freed by server_reap() when nothing refers to it
+ *
+ * @param c         the client to close
+ */
+static void client_close(client_t *c);
+
+/**
+ * @brief Free every closed client which nothing refers to anymore
+ *
+ * @param s         the server
+ */
+static void server_reap(server_t *s);
+
+/**
+ * @brief Handle a new line from a client
+ *
+ * @param s         the server
+ * @param c         the client which sent it
+ * @param path      the line, without the newline
+ */
+static void server_request(server_t *restrict s, client_t *restrict c,
+                           const char *restrict path);
+
+/**
+ * @brief Answer a request from the cache or attach it to a running scan
+ *
+ * @param s         the server
+ * @param req       the request
+ * @return          true if the request was taken care of
+ */
+static bool server_dispatch(server_t *restrict s, request_t *restrict req);
+
+/**
+ * @brief Start scans for queued requests, taking one client at a time, while
+ * there is room for more scans
+ *
+ * @param s         the server
+ */
+static void server_admit(server_t *s);
+
+/**
+ * @brief Handle every message from the workers
+ *
+ * @param s         the server
+ */
+static void server_read_pipe(server_t *s);
+
+/**
+ * @brief Answer everyone waiting for a finished scan and free it
+ *
+ * @param s         the server
+ * @param in        the finished scan
+ */
+static void server_scan_done(server_t *restrict s, inflight_t *restrict in);
+
+/**
+ * @brief Answer a request and free it
+ *
+ * @param req       the request
+ * @param blocks    the answer, -1 for an error
+ */
+static void reply(request_t *req, const long blocks);
+
+/**
+ * @brief Called by the workers for every finished directory of a scan
+ */
+static void server_on_dir(const char *path, const long blocks, void *user);
+
+/**
+ * @brief Called by a worker when a scan is done
+ */
+static void server_on_done(mdu_scan_t *scan, void *user);
+
+/**
+ * @brief Send a message to the server thread
+ *
+ * @param s         the server
+ * @param msg       the message to send
+ */
+static void server_notify(server_t *restrict s,
+                          const message_t *restrict msg);
+
+/**
+ * @brief Look up a path in the cache
+ *
+ * @param s         the server
+ * @param path      the canonical path
+ * @return          the cached blocks, -1 if missing or expired
+ */
+static long cache_get(server_t *restrict s, const char *restrict path);
+
+/**
+ * @brief Insert or refresh a path in the cache
+ *
+ * @param s         the server
+ * @param path      the canonical path
+ * @param blocks    the blocks to store
+ */
+static void cache_put(server_t *restrict s, const char *restrict path,
+                      const long blocks);
+
+/**
+ * @brief Remove expired entries, or everything if the cache is still full
+ *
+ * @param s         the server
+ */
+static void cache_purge(server_t *s);
+
+/**
+ * @brief Hash a path for the cache (FNV-1a)
+ */
+static unsigned hash_path(const char *path);
+
+/**
+ * @brief Check if the directory ANCESTOR contains PATH
+ */
+static bool is_ancestor(const char *restrict ancestor,
+                        const char *restrict path);
+
+/**
+ * @brief Stop the server loop
+ */
+static void handle_stop(int sig);
+
+// --------------- Global vars ---------------------------------------------- //
+
+static volatile sig_atomic_t stop_server = 0;
+
+// --------------- Definition of external functions ------------------------- //
+
+void server_options_init(server_options_t *opts) {
+  opts->pool = NULL;
+  opts->ttl = DEFAULT_TTL;
+  opts->max_active = DEFAULT_MAX_ACTIVE;
+  opts->max_per_client = DEFAULT_MAX_PER_CLIENT;
+}
+
+int mdu_serve(const char *restrict socket_path,
+              const server_options_t *restrict opts) {
+  server_t *s = calloc(1, sizeof(server_t));
+  s->opts = *opts;
+
+  if (server_open(s, socket_path)) {
+    free(s);
+    return -1;
+  }
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = handle_stop;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  struct pollfd *fds = NULL;
+  client_t **polled = NULL;
+  size_t fds_cap = 0;
+
+  while (!stop_server) {
+    size_t nr_clients = 0;
+    for (client_t *c = s->clients; c; c = c->next) {
+      nr_clients++;
+    }
+
+    if (nr_clients + 2 > fds_cap) {
+      fds_cap = 2 * (nr_clients + 2);
+      fds = realloc(fds, fds_cap * sizeof(struct pollfd));
+      polled = realloc(polled, fds_cap * sizeof(client_t *));
+    }
+
+    fds[0] = (struct pollfd){s->listen_fd, POLLIN, 0};
+    fds[1] = (struct pollfd){s->pipe_fd[0], POLLIN, 0};
+    size_t nfds = 2;
+
+    for (client_t *c = s->clients; c; c = c->next) {
+      if (c->closed) {
+        continue;
+      }
+
+      polled[nfds] = c;
+      fds[nfds++] =
+          (struct pollfd){c->fd, POLLIN | (c->out_len ? POLLOUT : 0), 0};
+    }
+
+    if (poll(fds, nfds, POLL_TIMEOUT_MS) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("poll");
+      break;
+    }
+
+    if (fds[1].revents & POLLIN) {
+      server_read_pipe(s);
+    }
+
+    for (size_t i = 2; i < nfds; i++) {
+      if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+        client_read(s, polled[i]);
+      }
+    }
+
+    if (fds[0].revents & POLLIN) {
+      server_accept(s);
+    }
+
+    server_admit(s);
+
+    for (client_t *c = s->clients; c; c = c->next) {
+      if (!c->closed && c->out_len) {
+        client_flush(c);
+      }
+    }
+
+    server_reap(s);
+
+    if (s->cache_len > CACHE_MAX) {
+      cache_purge(s);
+    }
+  }
+
+  free(fds);
+  free(polled);
+
+  unlink(socket_path);
+  server_close(s);
+
+  return 0;
+}
+
+// --------------- Definition of internal functions ------------------------- //
+
+static int server_open(server_t *restrict s, const char *restrict socket_path) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+
+  if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "mdu: socket path too long: %s\n", socket_path);
+    return -1;
+  }
+  strcpy(addr.sun_path, socket_path);
+
+  s->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+  if (s->listen_fd < 0) {
+    perror("socket");
+    return -1;
+  }
+
+  unlink(socket_path);
+  if (bind(s->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+      listen(s->listen_fd, SOMAXCONN)) {
+    perror(socket_path);
+    close(s->listen_fd);
+    return -1;
+  }
+
+  if (pipe2(s->pipe_fd, O_CLOEXEC)) {
+    perror("pipe");
+    close(s->listen_fd);
+    return -1;
+  }
+  fcntl(s->pipe_fd[0], F_SETFL, O_NONBLOCK);
+
+  return 0;
+}
+
+static void server_close(server_t *s) {
+  close(s->listen_fd);
+
+  while (s->inflight) {
+    mdu_scan_wait(s->inflight->scan);
+    server_read_pipe(s); // delivers MSG_DONE for every finished scan
+  }
+
+  for (client_t *c = s->clients; c; c = c->next) {
+    client_close(c);
+  }
+  server_reap(s);
+
+  for (int b = 0; b < CACHE_BUCKETS; b++) {
+    while (s->cache[b]) {
+      cache_entry_t *e = s->cache[b];
+      s->cache[b] = e->next;
+      free(e->path);
+      free(e);
+    }
+  }
+
+  close(s->pipe_fd[0]);
+  close(s->pipe_fd[1]);
+  free(s);
+}
+
+static void server_accept(server_t *s) {
+  int fd;
+  while ((fd = accept4(s->listen_fd, NULL, NULL,
+                       SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+    client_t *c = calloc(1, sizeof(client_t));
+    c->fd = fd;
+    c->next = s->clients;
+    s->clients = c;
+  }
+}
+
+static void client_read(server_t *restrict s, client_t *restrict c) {
+  const ssize_t n = read(c->fd, c->in + c->in_len, IN_BUF_SIZE - c->in_len);
+  if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+    return;
+  }
+  if (n <= 0) {
+    client_close(c);
+    return;
+  }
+
+  c->in_len += n;
+
+  char *line = c->in;
+  char *end;
+  while ((end = memchr(line, '\n', c->in + c->in_len - line))) {
+    *end = '\0';
+    if (end > line && end[-1] == '\r') {
+      end[-1] = '\0';
+    }
+    if (*line) {
+      server_request(s, c, line);
+    }
+    line = end + 1;
+  }
+
+  // keep the start of an unfinished line
+  c->in_len -= line - c->in;
+  memmove(c->in, line, c->in_len);
+
+  if (c->in_len == IN_BUF_SIZE) {
+    client_close(c); // line too long
+  }
+}
+
+static void client_flush(client_t *c) {
+  const ssize_t n = send(c->fd, c->out, c->out_len, MSG_NOSIGNAL);
+  if (n < 0) {
+    if (errno != EAGAIN && errno != EINTR) {
+      client_close(c);
+    }
+    return;
+  }
+
+  c->out_len -= n;
+  memmove(c->out, c->out + n, c->out_len);
+}
+
+static void client_close(client_t *c) {
+  if (c->closed) {
+    return;
+  }
+
+  c->closed = true;
+  close(c->fd);
+
+  while (c->queue) {
+    request_t *req = c->queue;
+    c->queue = req->next;
+    reply(req, -1);
+  }
+  c->queue_tail = NULL;
+}
+
+static void server_reap(server_t *s) {
+  client_t **prev = &s->clients;
+
+  while (*prev) {
+    client_t *c = *prev;
+    if (!c->closed || c->refs > 0) {
+      prev = &c->next;
+      continue;
+    }
+
+    *prev = c->next;
+    free(c->out);
+    free(c);
+  }
+}
+
+static void server_request(server_t *restrict s, client_t *restrict c,
+                           const char *restrict path) {
+  request_t *req = calloc(1, sizeof(request_t));
+  req->client = c;
+  req->path = strdup(path);
+  c->refs++;
+
+  req->real = realpath(path, NULL);
+  if (!req->real) {
+    reply(req, -1);
+    return;
+  }
+
+  if (server_dispatch(s, req)) {
+    return;
+  }
+
+  // wait for the client's turn to start a scan
+  if (c->queue_tail) {
+    c->queue_tail->next = req;
+  } else {
+    c->queue = req;
+  }
+  c->queue_tail = req;
+}
+
+static bool server_dispatch(server_t *restrict s, request_t *restrict req) {
+  const long cached = cache_get(s, req->real);
+  if (cached >= 0) {
+    reply(req, cached);
+    return true;
+  }
+
+  // the same path is already being scanned
+  for (inflight_t *in = s->inflight; in; in = in->next) {
+    if (strcmp(in->path, req->real) == 0) {
+      req->next = in->waiters;
+      in->waiters = req;
+      return true;
+    }
+  }
+
+  // a running scan will pass the path, wait for it there
+  for (inflight_t *in = s->inflight; in; in = in->next) {
+    if (!is_ancestor(in->path, req->real)) {
+      continue;
+    }
+
+    pthread_mutex_lock(&in->lock);
+
+    interest_t *i = in->interests;
+    while (i && strcmp(i->path, req->real) != 0) {
+      i = i->next;
+    }
+
+    if (i && i->found) {
+      const long blocks = i->blocks;
+      pthread_mutex_unlock(&in->lock);
+      reply(req, blocks);
+      return true;
+    }
+
+    if (!i) {
+      i = calloc(1, sizeof(interest_t));
+      i->path = strdup(req->real);
+      i->next = in->interests;
+      in->interests = i;
+      atomic_fetch_add(&in->nr_interests, 1);
+    }
+
+    req->next = i->waiters;
+    i->waiters = req;
+
+    pthread_mutex_unlock(&in->lock);
+    return true;
+  }
+
+  return false;
+}
+
+static void server_admit(server_t *s) {
+  while (s->nr_active < s->opts.max_active) {
+    unsigned nr_clients = 0;
+    for (client_t *c = s->clients; c; c = c->next) {
+      nr_clients++;
+    }
+
+    // the next client in turn with a queued request and room for a scan
+    client_t *next = NULL;
+    for (unsigned k = 0; k < nr_clients && !next; k++) {
+      const unsigned pos = (s->turn + k) % nr_clients;
+      client_t *c = s->clients;
+      for (unsigned j = 0; j < pos; j++) {
+        c = c->next;
+      }
+
+      if (c->queue && c->active < s->opts.max_per_client) {
+        next = c;
+        s->turn = pos + 1;
+      }
+    }
+
+    if (!next) {
+      return;
+    }
+
+    request_t *req = next->queue;
+    next->queue = req->next;
+    if (!next->queue) {
+      next->queue_tail = NULL;
+    }
+    req->next = NULL;
+
+    // a scan started since the request was queued may answer it
+    if (server_dispatch(s, req)) {
+      continue;
+    }
+
+    inflight_t *in = calloc(1, sizeof(inflight_t));
+    in->server = s;
+    in->path = strdup(req->real);
+    in->owner = next;
+    in->waiters = req;
+    pthread_mutex_init(&in->lock, NULL);
+    atomic_init(&in->nr_interests, 0);
+
+    mdu_options_t opts;
+    mdu_options_init(&opts);
+    opts.pool = s->opts.pool;
+    opts.on_dir = server_on_dir;
+    opts.on_done = server_on_done;
+    opts.user = in;
+
+    in->scan = mdu_scan_start(in->path, &opts);
+    if (!in->scan) {
+      pthread_mutex_destroy(&in->lock);
+      free(in->path);
+      free(in);
+      reply(req, -1);
+      continue;
+    }
+
+    in->next = s->inflight;
+    s->inflight = in;
+    s->nr_active++;
+    next->active++;
+    next->refs++;
+  }
+}
+
+static void server_read_pipe(server_t *s) {
+  message_t msg;
+
+  while (read(s->pipe_fd[0], &msg, sizeof(msg)) == sizeof(msg)) {
+    if (msg.type == MSG_DONE) {
+      server_scan_done(s, (inflight_t *)msg.ptr);
+      continue;
+    }
+
+    interest_t *i = (interest_t *)msg.ptr;
+    inflight_t *in = msg.inflight;
+
+    pthread_mutex_lock(&in->lock);
+    const long blocks = i->blocks;
+    request_t *waiters = i->waiters;
+    i->waiters = NULL;
+    pthread_mutex_unlock(&in->lock);
+
+    cache_put(s, i->path, blocks);
+
+    while (waiters) {
+      request_t *req = waiters;
+      waiters = req->next;
+      reply(req, blocks);
+    }
+  }
+}
+
+static void server_scan_done(server_t *restrict s, inflight_t *restrict in) {
+  mdu_scan_wait(in->scan);
+  const long blocks = mdu_scan_blocks(in->scan);
+
+  cache_put(s, in->path, blocks);
+
+  while (in->waiters) {
+    request_t *req = in->waiters;
+    in->waiters = req->next;
+    reply(req, blocks);
+  }
+
+  // off the list first, or a request below PATH would wait on it again
+  inflight_t **prev = &s->inflight;
+  while (*prev != in) {
+    prev = &(*prev)->next;
+  }
+  *prev = in->next;
+
+  // directories the scan never reported, e.g. files, get a scan of their own
+  while (in->interests) {
+    interest_t *i = in->interests;
+    in->interests = i->next;
+
+    while (i->waiters) {
+      request_t *req = i->waiters;
+      i->waiters = req->next;
+      req->next = NULL;
+
+      client_t *c = req->client;
+      if (c->closed) {
+        reply(req, -1);
+        continue;
+      }
+      if (server_dispatch(s, req)) {
+        continue;
+      }
+
+      req->next = c->queue;
+      c->queue = req;
+      if (!c->queue_tail) {
+        c->queue_tail = req;
+      }
+    }
+
+    free(i->path);
+    free(i);
+  }
+
+  s->nr_active--;
+  in->owner->active--;
+  in->owner->refs--;
+
+  mdu_scan_destroy(in->scan);
+  pthread_mutex_destroy(&in->lock);
+  free(in->path);
+  free(in);
+}
+
+static void reply(request_t *req, const long blocks) {
+  client_t *c = req->client;
+
+  if (!c->closed) {
+    const size_t len = strlen(req->path) + 32;
+    if (c->out_len + len > c->out_cap) {
+      c->out_cap = 2 * (c->out_len + len);
+      c->out = realloc(c->out, c->out_cap);
+    }
+
+    if (blocks < 0) {
+      c->out_len += sprintf(c->out + c->out_len, "error\t%s\n", req->path);
+    } else {
+      c->out_len +=
+          sprintf(c->out + c->out_len, "%ld\t%s\n", blocks, req->path);
+    }
+  }
+
+  c->refs--;
+  free(req->path);
+  free(req->real);
+  free(req);
+}
+
+static void server_on_dir(const char *path, const long blocks, void *user) {
+  inflight_t *in = (inflight_t *)user;
+
+  if (atomic_load_explicit(&in->nr_interests, memory_order_relaxed) == 0) {
+    return;
+  }
+
+  pthread_mutex_lock(&in->lock);
+
+  for (interest_t *i = in->interests; i; i = i->next) {
+    if (!i->found && strcmp(i->path, path) == 0) {
+      i->found = true;
+      i->blocks = blocks;
+
+      const message_t msg = {MSG_INTEREST, i, in};
+      server_notify(in->server, &msg);
+      break;
+    }
+  }
+
+  pthread_mutex_unlock(&in->lock);
+}
+
+static void server_on_done(mdu_scan_t *scan, void *user) {
+  (void)scan;
+  inflight_t *in = (inflight_t *)user;
+
+  const message_t msg = {MSG_DONE, in, in};
+  server_notify(in->server, &msg);
+}
+
+static void server_notify(server_t *restrict s,
+                          const message_t *restrict msg) {
+  // smaller than PIPE_BUF, so the write is atomic
+  while (write(s->pipe_fd[1], msg, sizeof(message_t)) < 0 && errno == EINTR) {
+  }
+}
+
+static long cache_get(server_t *restrict s, const char *restrict path) {
+  cache_entry_t **prev = &s->cache[hash_path(path) % CACHE_BUCKETS];
+  const time_t now = time(NULL);
+
+  for (cache_entry_t *e = *prev; e; prev = &e->next, e = e->next) {
+    if (strcmp(e->path, path) != 0) {
+      continue;
+    }
+
+    if (e->expires > now) {
+      return e->blocks;
+    }
+
+    *prev = e->next;
+    free(e->path);
+    free(e);
+    s->cache_len--;
+    return -1;
+  }
+
+  return -1;
+}
+
+static void cache_put(server_t *restrict s, const char *restrict path,
+                      const long blocks) {
+  if (s->opts.ttl <= 0) {
+    return;
+  }
+
+  const unsigned b = hash_path(path) % CACHE_BUCKETS;
+  cache_entry_t *e = s->cache[b];
+  while (e && strcmp(e->path, path) != 0) {
+    e = e->next;
+  }
+
+  if (!e) {
+    e = malloc(sizeof(cache_entry_t));
+    e->path = strdup(path);
+    e->next = s->cache[b];
+    s->cache[b] = e;
+    s->cache_len++;
+  }
+
+  e->blocks = blocks;
+  e->expires = time(NULL) + s->opts.ttl;
+}
+
+static void cache_purge(server_t *s) {
+  const time_t now = time(NULL);
+  const bool all = s->cache_len > 2 * CACHE_MAX;
+
+  for (int b = 0; b < CACHE_BUCKETS; b++) {
+    cache_entry_t **prev = &s->cache[b];
+    while (*prev) {
+      cache_entry_t *e = *prev;
+      if (!all && e->expires > now) {
+        prev = &e->next;
+        continue;
+      }
+
+      *prev = e->next;
+      free(e->path);
+      free(e);
+      s->cache_len--;
+    }
+  }
+}
+
+static unsigned hash_path(const char *path) {
+  unsigned h = 2166136261u;
+  for (; *path; path++) {
+    h = (h ^ (unsigned char)*path) * 16777619u;
+  }
+
+  return h;
+}
+
+static bool is_ancestor(const char *restrict ancestor,
+                        const char *restrict path) {
+  const size_t len = strlen(ancestor);
+
+  if (strncmp(ancestor, path, len) != 0) {
+    return false;
+  }
+
+  // "/" is the ancestor of every other path
+  return (len == 1 && path[1] != '\0') || path[len] == '/';
+}
+
+static void handle_stop(int sig) {
+  (void)sig;
+  stop_server = 1;
+}
@@ -0,0 +1,174 @@
+/**
+ * This module implements the state of a sharded scan, see
+ * shard_competition.h. The mapping holds the header, the result slots and
+ * then the queue. The queue is a stack of records, each a path with its '\0'
+ * followed by its length, so the last record can be found from the top.
+ *
+ * @file shard_competition.c
+ * @author Elias Svensson (c24esn@cs.umu.se)
+ * @date 2025-11-18
+ */
+
+// --------------- Headers -------------------------------------------------- //
+
+#include "shard_competition.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+// --------------- Constants ------------------------------------------------ //
+
+#define CACHE_LINE 64
+#define QUEUE_SIZE (1 << 20) /* Bytes of paths queued, more are kept local */
+#define TAKE_MAX 64          /* Most directories taken at once */
+#define HEADER_SIZE                                                            \
+  ((sizeof(shard_t) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE)
+
+// --------------- Structs -------------------------------------------------- //
+
+struct shard_t {
+  pthread_mutex_t lock; /* Process shared, protects the queue and PENDING */
+  pthread_cond_t ready; /* Signalled when a directory is queued or at the end */
+  long pending; /* Directories queued, or taken and not handed back */
+  size_t top;   /* Bytes used of the queue */
+  size_t size;  /* Bytes of the mapping */
+  int nr_procs;
+
+  /* Read without the lock for every directory, see shard_hungry() */
+  _Alignas(CACHE_LINE) atomic_int waiting; /* Processes in shard_take() */
+  atomic_long queued;                      /* Directories in the queue */
+};
+
+// --------------- Declaration of internal functions ------------------------ //
+
+/**
+ * @brief Get the queue of the shared state
+ *
+ * @param shard     a pointer to a struct of type shard_t
+ * @return          QUEUE_SIZE bytes after the result slots
+ */
+static inline char *shard_queue(shard_t *shard);
+
+// --------------- Definition of external functions ------------------------- //
+
+shard_t *shard_create(const int nr_procs) {
+  const size_t size =
+      HEADER_SIZE + nr_procs * sizeof(shard_result_t) + QUEUE_SIZE;
+  shard_t *shard = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (shard == MAP_FAILED) {
+    return NULL;
+  }
+
+  pthread_mutexattr_t mattr;
+  pthread_mutexattr_init(&mattr);
+  pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+  pthread_mutex_init(&shard->lock, &mattr);
+  pthread_mutexattr_destroy(&mattr);
+
+  pthread_condattr_t cattr;
+  pthread_condattr_init(&cattr);
+  pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
+  pthread_cond_init(&shard->ready, &cattr);
+  pthread_condattr_destroy(&cattr);
+
+  // the mapping is zeroed, only what is not 0 is set
+  shard->pending = 1;
+  shard->size = size;
+  shard->nr_procs = nr_procs;
+  atomic_init(&shard->waiting, 0);
+  atomic_init(&shard->queued, 0);
+
+  return shard;
+}
+
+void shard_destroy(shard_t *shard) {
+  if (!shard) {
+    return;
+  }
+
+  pthread_cond_destroy(&shard->ready);
+  pthread_mutex_destroy(&shard->lock);
+  munmap(shard, shard->size);
+}
+
+bool shard_hungry(const shard_t *shard) {
+  return atomic_load_explicit(&shard->waiting, memory_order_relaxed) >
+         atomic_load_explicit(&shard->queued, memory_order_relaxed);
+}
+
+bool shard_push(shard_t *restrict shard, const char *restrict path) {
+  const uint32_t len = strlen(path) + 1;
+
+  pthread_mutex_lock(&shard->lock);
+  if (shard->top + len + sizeof(len) > QUEUE_SIZE) {
+    pthread_mutex_unlock(&shard->lock);
+    return false;
+  }
+
+  char *queue = shard_queue(shard);
+  memcpy(queue + shard->top, path, len);
+  memcpy(queue + shard->top + len, &len, sizeof(len));
+  shard->top += len + sizeof(len);
+  shard->pending++;
+  atomic_fetch_add_explicit(&shard->queued, 1, memory_order_relaxed);
+
+  pthread_cond_signal(&shard->ready);
+  pthread_mutex_unlock(&shard->lock);
+
+  return true;
+}
+
+long shard_take(shard_t *restrict shard, checkpoint_t *restrict cp) {
+  pthread_mutex_lock(&shard->lock);
+
+  atomic_fetch_add_explicit(&shard->waiting, 1, memory_order_relaxed);
+  while (shard->top == 0 && shard->pending > 0) {
+    pthread_cond_wait(&shard->ready, &shard->lock);
+  }
+  const int waiting =
+      atomic_fetch_sub_explicit(&shard->waiting, 1, memory_order_relaxed) - 1;
+
+  // a fair share, so every waiting process gets some of a long queue
+  const long queued = atomic_load_explicit(&shard->queued,
+                                           memory_order_relaxed);
+  long n = queued / (waiting + 1);
+  n = n < 1 ? 1 : n > TAKE_MAX ? TAKE_MAX : n;
+
+  char *queue = shard_queue(shard);
+  long taken = 0;
+  for (; taken < n && shard->top > 0; taken++) {
+    uint32_t len;
+    memcpy(&len, queue + shard->top - sizeof(len), sizeof(len));
+    shard->top -= len + sizeof(len);
+    checkpoint_add_dir(cp, queue + shard->top);
+  }
+  atomic_fetch_sub_explicit(&shard->queued, taken, memory_order_relaxed);
+
+  pthread_mutex_unlock(&shard->lock);
+
+  return taken;
+}
+
+void shard_done(shard_t *shard, const long n) {
+  pthread_mutex_lock(&shard->lock);
+
+  shard->pending -= n;
+  if (shard->pending == 0) {
+    pthread_cond_broadcast(&shard->ready); // every waiting process is done
+  }
+
+  pthread_mutex_unlock(&shard->lock);
+}
+
+shard_result_t *shard_result(shard_t *shard, const int id) {
+  return (shard_result_t *)((char *)shard + HEADER_SIZE) + id;
+}
+
+// --------------- Definition of internal functions ------------------------- //
+
+static inline char *shard_queue(shard_t *shard) {
+  return (char *)shard_result(shard, shard->nr_procs);
+}
@@ -0,0 +1,694 @@
+/**
+ * This module implements snapshots, see snapshot_competition.h. Paths are
+ * decoded with a cursor which walks forward from a restart point. Two
+ * snapshots are compared with a merge join of their sorted paths: the first
+ * snapshot is split into ranges at restart points, the matching ranges of the
+ * second are found by binary search and every pair of ranges is joined by a
+ * thread of its own.
+ *
+ * @file snapshot_competition.c
+ * @author Elias Svensson (c24esn@cs.umu.se)
+ * @date 2025-11-09
+ */
+
+// --------------- Headers -------------------------------------------------- //
+
+#include "snapshot_competition.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// --------------- Constants ------------------------------------------------ //
+
+#define SNAP_MAGIC "MDUSNAP1"
+#define NO_PARENT UINT32_MAX /* SNAPSHOT_NO_PARENT in the file */
+#define DEFAULT_CAPACITY 1024
+
+// --------------- Structs -------------------------------------------------- //
+
+/**
+ * @typedef snap_header_t
+ * @brief the start of a snapshot file. Offsets are from the start of the file
+ * and every column is aligned to 8 bytes
+ *
+ */
+typedef struct snap_header_t {
+  char magic[8];         /* SNAP_MAGIC */
+  uint64_t len;          /* Directories in the table */
+  uint64_t blocks_off;   /* int64_t[len], blocks of each subtree */
+  uint64_t parents_off;  /* uint32_t[len], index of each parent */
+  uint64_t restarts_off; /* uint64_t[], offset in NAMES of every restart */
+  uint64_t names_off;    /* Front coded paths */
+  uint64_t names_len;
+} snap_header_t;
+
+typedef struct snap_dir_t {
+  char *path;
+  long blocks;
+} snap_dir_t;
+
+struct snapshot_builder_t {
+  snap_dir_t *dirs;
+  long len;
+  long cap;
+};
+
+struct snapshot_t {
+  void *map;
+  size_t size;
+  long len;
+  const int64_t *blocks;
+  const uint32_t *parents;
+  const uint64_t *restarts;
+  const uint8_t *names;
+};
+
+/**
+ * @typedef cursor_t
+ * @brief decodes the paths of a snapshot one after the other
+ *
+ */
+typedef struct cursor_t {
+  const snapshot_t *snap;
+  const uint8_t *next; /* Encoding of the path after PATH */
+  char *path;          /* The decoded path (null-terminated) */
+  size_t len;
+  size_t cap;
+} cursor_t;
+
+/**
+ * @typedef diff_part_t
+ * @brief a pair of ranges joined by one thread of snapshot_diff()
+ *
+ */
+typedef struct diff_part_t {
+  const snapshot_t *a;
+  const snapshot_t *b;
+  long a_begin, a_end; /* Range of A */
+  long b_begin, b_end; /* Range of B holding the same paths */
+  heap_t *grew;
+  heap_t *shrank;
+} diff_part_t;
+
+// --------------- Declaration of internal functions ------------------------ //
+
+/**
+ * @brief Compare two paths in depth first order, where '/' sorts before every
+ * other character
+ *
+ * @param a         the first path
+ * @param b         the second path
+ * @return          less than, equal to or greater than 0 like strcmp()
+ */
+static inline int path_cmp(const char *a, const char *b);
+
+/**
+ * @brief Compare two snap_dir_t by path for qsort
+ */
+static int dir_cmp(const void *a, const void *b);
+
+/**
+ * @brief Check if PARENT is an ancestor of PATH
+ *
+ * @param parent    a path
+ * @param len       the length of PARENT
+ * @param path      another path
+ * @return          true if PATH is below PARENT
+ */
+static inline bool is_below(const char *parent, const size_t len,
+                           const char *path);
+
+/**
+ * @brief Get the length of the prefix two strings share
+ */
+static inline size_t shared_len(const char *a, const char *b);
+
+/**
+ * @brief Write V as a LEB128 varint
+ *
+ * @param fp        the file to write to
+ * @param v         the number
+ */
+static void varint_put(FILE *fp, uint64_t v);
+
+/**
+ * @brief Get the length of V as a LEB128 varint
+ */
+static inline size_t varint_len(uint64_t v);
+
+/**
+ * @brief Read a LEB128 varint and move P past it
+ */
+static inline uint64_t varint_get(const uint8_t **p);
+
+/**
+ * @brief Read a LEB128 varint of at most 64 bits ending before END
+ *
+ * @param p         the varint, moved past it
+ * @param end       the end of the encoding
+ * @param v         set to the number
+ * @return          false if the varint runs past END or is too long
+ */
+static inline bool varint_get_checked(const uint8_t **restrict p,
+                                      const uint8_t *end,
+                                      uint64_t *restrict v);
+
+/**
+ * @brief Check that a column of N elements of SIZE bytes at OFF is aligned to
+ * 8 bytes and fits in a file of FILE_SIZE bytes
+ */
+static inline bool column_fits(const uint64_t off, const uint64_t n,
+                               const size_t size, const uint64_t file_size);
+
+/**
+ * @brief Decode every path once and check that no later decoding can read
+ * past the names, and that every parent is an earlier directory
+ *
+ * @param snap      a pointer to a struct of type snapshot_t
+ * @param names_len the bytes of the names
+ * @return          true if the snapshot is safe to decode
+ */
+static bool snap_check(const snapshot_t *snap, const uint64_t names_len);
+
+/**
+ * @brief Place a cursor on directory I
+ *
+ * @param c         the cursor, with SNAP set
+ * @param i         the index of the directory
+ */
+static void cursor_seek(cursor_t *c, const long i);
+
+/**
+ * @brief Decode the path after the current one. The caller makes sure that
+ * there is one
+ *
+ * @param c         the cursor
+ */
+static inline void cursor_next(cursor_t *c);
+
+/**
+ * @brief Find the first directory with a path not sorting before KEY
+ *
+ * @param snap      a pointer to a struct of type snapshot_t
+ * @param key       the path to look for
+ * @return          an index in [0, snapshot_len()]
+ */
+static long lower_bound(const snapshot_t *restrict snap,
+                        const char *restrict key);
+
+/**
+ * @brief Join a pair of ranges, main function of the threads of
+ * snapshot_diff()
+ *
+ * @param arg       a pointer to a struct of type diff_part_t
+ */
+static void *diff_part(void *arg);
+
+// --------------- Definition of external functions ------------------------- //
+
+snapshot_builder_t *snapshot_builder_create(void) {
+  snapshot_builder_t *b = malloc(sizeof(snapshot_builder_t));
+  b->cap = DEFAULT_CAPACITY;
+  b->dirs = malloc(b->cap * sizeof(snap_dir_t));
+  b->len = 0;
+
+  return b;
+}
+
+void snapshot_builder_add(snapshot_builder_t *restrict b, char *restrict path,
+                          const long blocks) {
+  if (b->len == b->cap) {
+    b->cap *= 2;
+    b->dirs = realloc(b->dirs, b->cap * sizeof(snap_dir_t));
+  }
+
+  b->dirs[b->len].path = path;
+  b->dirs[b->len].blocks = blocks;
+  b->len++;
+}
+
+int snapshot_builder_write(snapshot_builder_t *restrict b,
+                           const char *restrict file) {
+  const long n = b->len;
+  const long nr_restarts = (n + SNAPSHOT_RESTART - 1) / SNAPSHOT_RESTART;
+
+  qsort(b->dirs, n, sizeof(snap_dir_t), dir_cmp);
+
+  snap_header_t h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, SNAP_MAGIC, sizeof(h.magic));
+  h.len = n;
+  h.blocks_off = sizeof(h);
+  h.parents_off = h.blocks_off + n * sizeof(int64_t);
+  h.restarts_off = h.parents_off + (n * sizeof(uint32_t) + 7) / 8 * 8;
+  h.names_off = h.restarts_off + nr_restarts * sizeof(uint64_t);
+
+  // offsets of the restarts first, so every column is written in one pass
+  uint64_t *restarts = malloc((nr_restarts + 1) * sizeof(uint64_t));
+  for (long i = 0; i < n; i++) {
+    const char *path = b->dirs[i].path;
+    const size_t shared = i % SNAPSHOT_RESTART
+                              ? shared_len(b->dirs[i - 1].path, path)
+                              : 0;
+    const size_t suffix = strlen(path) - shared;
+
+    if (i % SNAPSHOT_RESTART == 0) {
+      restarts[i / SNAPSHOT_RESTART] = h.names_len;
+    }
+    h.names_len += varint_len(shared) + varint_len(suffix) + suffix;
+  }
+
+  const size_t len = strlen(file);
+  char *tmp = malloc(len + 5);
+  memcpy(tmp, file, len);
+  memcpy(tmp + len, ".tmp", 5);
+
+  FILE *fp = fopen(tmp, "w");
+  if (!fp) {
+    free(restarts);
+    free(tmp);
+    return -1;
+  }
+
+  fwrite(&h, sizeof(h), 1, fp);
+
+  for (long i = 0; i < n; i++) {
+    const int64_t blocks = b->dirs[i].blocks;
+    fwrite(&blocks, sizeof(blocks), 1, fp);
+  }
+
+  // the parent is the closest ancestor on the stack of open directories
+  long *open = malloc((n + 1) * sizeof(long));
+  long depth = 0;
+  for (long i = 0; i < n; i++) {
+    const char *path = b->dirs[i].path;
+    while (depth > 0) {
+      const char *top = b->dirs[open[depth - 1]].path;
+      if (is_below(top, strlen(top), path)) {
+        break;
+      }
+      depth--;
+    }
+
+    const uint32_t parent = depth ? (uint32_t)open[depth - 1] : NO_PARENT;
+    fwrite(&parent, sizeof(parent), 1, fp);
+    open[depth++] = i;
+  }
+  free(open);
+
+  const uint64_t pad = 0;
+  fwrite(&pad, 1, h.restarts_off - h.parents_off - n * sizeof(uint32_t), fp);
+  fwrite(restarts, sizeof(uint64_t), nr_restarts, fp);
+  free(restarts);
+
+  for (long i = 0; i < n; i++) {
+    const char *path = b->dirs[i].path;
+    const size_t shared = i % SNAPSHOT_RESTART
+                              ? shared_len(b->dirs[i - 1].path, path)
+                              : 0;
+    const size_t suffix = strlen(path) - shared;
+
+    varint_put(fp, shared);
+    varint_put(fp, suffix);
+    fwrite(path + shared, 1, suffix, fp);
+  }
+
+  int ret = fclose(fp) ? -1 : rename(tmp, file);
+  free(tmp);
+
+  return ret;
+}
+
+void snapshot_builder_destroy(snapshot_builder_t *b) {
+  if (!b) {
+    return;
+  }
+
+  for (long i = 0; i < b->len; i++) {
+    free(b->dirs[i].path);
+  }
+
+  free(b->dirs);
+  free(b);
+}
+
+snapshot_t *snapshot_open(const char *file) {
+  const int fd = open(file, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) || (size_t)st.st_size < sizeof(snap_header_t)) {
+    close(fd);
+    return NULL;
+  }
+
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return NULL;
+  }
+
+  const snap_header_t *h = (const snap_header_t *)map;
+  const uint64_t size = st.st_size;
+  const uint64_t nr_restarts =
+      (h->len + SNAPSHOT_RESTART - 1) / SNAPSHOT_RESTART;
+
+  // every column within the file, as the header is trusted by nothing else
+  if (memcmp(h->magic, SNAP_MAGIC, sizeof(h->magic)) ||
+      h->len > UINT32_MAX ||
+      !column_fits(h->blocks_off, h->len, sizeof(int64_t), size) ||
+      !column_fits(h->parents_off, h->len, sizeof(uint32_t), size) ||
+      !column_fits(h->restarts_off, nr_restarts, sizeof(uint64_t), size) ||
+      !column_fits(h->names_off, h->names_len, 1, size)) {
+    munmap(map, st.st_size);
+    return NULL;
+  }
+
+  snapshot_t *snap = malloc(sizeof(snapshot_t));
+  snap->map = map;
+  snap->size = st.st_size;
+  snap->len = h->len;
+  snap->blocks = (const int64_t *)((const char *)map + h->blocks_off);
+  snap->parents = (const uint32_t *)((const char *)map + h->parents_off);
+  snap->restarts = (const uint64_t *)((const char *)map + h->restarts_off);
+  snap->names = (const uint8_t *)map + h->names_off;
+
+  if (!snap_check(snap, h->names_len)) {
+    snapshot_close(snap);
+    return NULL;
+  }
+
+  return snap;
+}
+
+void snapshot_close(snapshot_t *snap) {
+  if (!snap) {
+    return;
+  }
+
+  munmap(snap->map, snap->size);
+  free(snap);
+}
+
+long snapshot_len(const snapshot_t *snap) { return snap->len; }
+
+long snapshot_blocks(const snapshot_t *snap, const long i) {
+  return snap->blocks[i];
+}
+
+long snapshot_parent(const snapshot_t *snap, const long i) {
+  return snap->parents[i] == NO_PARENT ? SNAPSHOT_NO_PARENT
+                                       : (long)snap->parents[i];
+}
+
+size_t snapshot_path(const snapshot_t *restrict snap, const long i,
+                     char **restrict buf, size_t *restrict cap) {
+  cursor_t c = {snap, NULL, *buf, 0, *buf ? *cap : 0};
+  cursor_seek(&c, i);
+
+  *buf = c.path;
+  *cap = c.cap;
+  return c.len;
+}
+
+void snapshot_diff(const snapshot_t *a, const snapshot_t *b,
+                   const short nr_threads, const int top_n, heap_t *grew,
+                   heap_t *shrank) {
+  diff_part_t *parts = calloc(nr_threads, sizeof(diff_part_t));
+  pthread_t *threads = calloc(nr_threads, sizeof(pthread_t));
+  char *key = NULL;
+  size_t key_cap = 0;
+
+  // split A at restart points and B where the same paths start
+  for (short t = 0; t <= nr_threads; t++) {
+    long a_at = a->len * t / nr_threads / SNAPSHOT_RESTART * SNAPSHOT_RESTART;
+    long b_at = 0;
+    if (t == nr_threads) {
+      a_at = a->len;
+      b_at = b->len;
+    } else if (t > 0 && a_at < a->len) {
+      snapshot_path(a, a_at, &key, &key_cap);
+      b_at = lower_bound(b, key);
+    } else if (t > 0) {
+      b_at = b->len;
+    }
+
+    if (t < nr_threads) {
+      parts[t].a = a;
+      parts[t].b = b;
+      parts[t].a_begin = a_at;
+      parts[t].b_begin = b_at;
+      parts[t].grew = heap_create(top_n);
+      parts[t].shrank = heap_create(top_n);
+    }
+    if (t > 0) {
+      parts[t - 1].a_end = a_at;
+      parts[t - 1].b_end = b_at;
+    }
+  }
+  free(key);
+
+  for (short t = 0; t < nr_threads; t++) {
+    pthread_create(&threads[t], NULL, diff_part, &parts[t]);
+  }
+
+  for (short t = 0; t < nr_threads; t++) {
+    pthread_join(threads[t], NULL);
+    heap_merge(grew, parts[t].grew);
+    heap_merge(shrank, parts[t].shrank);
+    heap_destroy(parts[t].grew);
+    heap_destroy(parts[t].shrank);
+  }
+
+  free(parts);
+  free(threads);
+}
+
+// --------------- Definition of internal functions ------------------------- //
+
+static inline int path_cmp(const char *a, const char *b) {
+  const unsigned char *pa = (const unsigned char *)a;
+  const unsigned char *pb = (const unsigned char *)b;
+
+  while (*pa && *pa == *pb) {
+    pa++;
+    pb++;
+  }
+
+  // the end of a path first, then '/', then everything else
+  const int ra = *pa == '/' ? 1 : *pa ? *pa + 1 : 0;
+  const int rb = *pb == '/' ? 1 : *pb ? *pb + 1 : 0;
+
+  return ra - rb;
+}
+
+static int dir_cmp(const void *a, const void *b) {
+  return path_cmp(((const snap_dir_t *)a)->path, ((const snap_dir_t *)b)->path);
+}
+
+static inline bool is_below(const char *parent, const size_t len,
+                           const char *path) {
+  return strncmp(parent, path, len) == 0 &&
+         (parent[len - 1] == '/' || path[len] == '/');
+}
+
+static inline size_t shared_len(const char *a, const char *b) {
+  size_t i = 0;
+  while (a[i] && a[i] == b[i]) {
+    i++;
+  }
+
+  return i;
+}
+
+static void varint_put(FILE *fp, uint64_t v) {
+  while (v >= 0x80) {
+    fputc((int)(v & 0x7f) | 0x80, fp);
+    v >>= 7;
+  }
+
+  fputc((int)v, fp);
+}
+
+static inline size_t varint_len(uint64_t v) {
+  size_t len = 1;
+  while (v >= 0x80) {
+    v >>= 7;
+    len++;
+  }
+
+  return len;
+}
+
+static inline uint64_t varint_get(const uint8_t **p) {
+  uint64_t v = 0;
+  for (int shift = 0;; shift += 7) {
+    const uint8_t byte = *(*p)++;
+    v |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return v;
+    }
+  }
+}
+
+static inline bool varint_get_checked(const uint8_t **restrict p,
+                                      const uint8_t *end,
+                                      uint64_t *restrict v) {
+  *v = 0;
+  for (int shift = 0; shift < 64 && *p < end; shift += 7) {
+    const uint8_t byte = *(*p)++;
+    *v |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static inline bool column_fits(const uint64_t off, const uint64_t n,
+                               const size_t size, const uint64_t file_size) {
+  return off % 8 == 0 && off >= sizeof(snap_header_t) && off <= file_size &&
+         n <= (file_size - off) / size;
+}
+
+static bool snap_check(const snapshot_t *snap, const uint64_t names_len) {
+  const uint8_t *p = snap->names;
+  const uint8_t *end = snap->names + names_len;
+  uint64_t len = 0; // of the previous path
+
+  for (long i = 0; i < snap->len; i++) {
+    // a restart is where its path starts and shares nothing with the last
+    const bool restart = i % SNAPSHOT_RESTART == 0;
+    if (restart && snap->restarts[i / SNAPSHOT_RESTART] !=
+                       (uint64_t)(p - snap->names)) {
+      return false;
+    }
+
+    uint64_t shared, suffix;
+    if (!varint_get_checked(&p, end, &shared) ||
+        !varint_get_checked(&p, end, &suffix) ||
+        (restart ? shared != 0 : shared > len) ||
+        suffix > (uint64_t)(end - p)) {
+      return false;
+    }
+
+    const uint32_t parent = snap->parents[i];
+    if (parent != NO_PARENT && parent >= (uint64_t)i) {
+      return false;
+    }
+
+    len = shared + suffix;
+    p += suffix;
+  }
+
+  return true;
+}
+
+static void cursor_seek(cursor_t *c, const long i) {
+  const long r = i / SNAPSHOT_RESTART;
+  c->next = c->snap->names + c->snap->restarts[r];
+
+  for (long k = r * SNAPSHOT_RESTART; k <= i; k++) {
+    cursor_next(c);
+  }
+}
+
+static inline void cursor_next(cursor_t *c) {
+  const size_t shared = varint_get(&c->next);
+  const size_t suffix = varint_get(&c->next);
+
+  if (shared + suffix + 1 > c->cap) {
+    c->cap = 2 * (shared + suffix + 1);
+    c->path = realloc(c->path, c->cap);
+  }
+
+  memcpy(c->path + shared, c->next, suffix);
+  c->len = shared + suffix;
+  c->path[c->len] = '\0';
+  c->next += suffix;
+}
+
+static long lower_bound(const snapshot_t *restrict snap,
+                        const char *restrict key) {
+  if (snap->len == 0) {
+    return 0;
+  }
+
+  cursor_t c = {snap, NULL, NULL, 0, 0};
+
+  // last restart not sorting after KEY, its whole path needs no decoding
+  long lo = 0;
+  long hi = (snap->len + SNAPSHOT_RESTART - 1) / SNAPSHOT_RESTART;
+  while (hi - lo > 1) {
+    const long mid = lo + (hi - lo) / 2;
+    cursor_seek(&c, mid * SNAPSHOT_RESTART);
+    if (path_cmp(c.path, key) <= 0) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+
+  long i = lo * SNAPSHOT_RESTART;
+  cursor_seek(&c, i);
+  while (path_cmp(c.path, key) < 0 && ++i < snap->len) {
+    cursor_next(&c);
+  }
+
+  free(c.path);
+  return i;
+}
+
+static void *diff_part(void *arg) {
+  diff_part_t *p = (diff_part_t *)arg;
+  cursor_t ca = {p->a, NULL, NULL, 0, 0};
+  cursor_t cb = {p->b, NULL, NULL, 0, 0};
+  long ia = p->a_begin;
+  long ib = p->b_begin;
+
+  if (ia < p->a_end) {
+    cursor_seek(&ca, ia);
+  }
+  if (ib < p->b_end) {
+    cursor_seek(&cb, ib);
+  }
+
+  while (ia < p->a_end || ib < p->b_end) {
+    const int cmp = ia == p->a_end   ? 1
+                    : ib == p->b_end ? -1
+                                     : path_cmp(ca.path, cb.path);
+
+    // a directory only found in one snapshot has 0 blocks in the other
+    const long before = cmp <= 0 ? p->a->blocks[ia] : 0;
+    const long after = cmp >= 0 ? p->b->blocks[ib] : 0;
+    const char *path = cmp <= 0 ? ca.path : cb.path;
+    const long delta = after - before;
+
+    if (delta > 0 && heap_accepts(p->grew, delta)) {
+      heap_push(p->grew, delta, strdup(path));
+    } else if (delta < 0 && heap_accepts(p->shrank, -delta)) {
+      heap_push(p->shrank, -delta, strdup(path));
+    }
+
+    if (cmp <= 0 && ++ia < p->a_end) {
+      cursor_next(&ca);
+    }
+    if (cmp >= 0 && ++ib < p->b_end) {
+      cursor_next(&cb);
+    }
+  }
+
+  free(ca.path);
+  free(cb.path);
+  return NULL;
+}
@@ -1,3 +1,29 @@
+/**
+ * This module implements a lock-free stack (Treiber stack). Nodes are never
+ * returned to malloc. They live in chunks of a process wide arena and are
+ * addressed by a 32-bit index, which leaves room for a 32-bit tag next to the
+ * index in the 64-bit head. The tag is bumped on every change of the head so a
+ * recycled node can not be mistaken for the one that was read (ABA), and since
+ * the memory stays a node_t forever a thread reading the next field of a node
+ * that was popped and reused by someone else reads a stale but valid value,
+ * which the CAS on the tagged head then rejects.
+ *
+ * Free nodes are cached per thread and spill over to a shared free list, so a
+ * push and a pop normally never touch malloc or any shared allocator state.
+ *
+ * A push or pop whose CAS on the head fails backs off into an elimination
+ * array (Hendler, Shavit and Yerushalmi). A push and a pop that meet in the
+ * same slot cancel out: the node is handed over directly and neither touches
+ * the head. If nobody shows up the operation retries on the head after an
+ * exponential backoff. A pushed value is therefore either on the stack or
+ * offered in a slot by a push that has not returned yet. Define
+ * STACK_NO_ELIMINATION to build the plain Treiber stack.
+ *
+ * @file stack_competition.c
+ * @author Elias Svensson (c24esn@cs.umu.se)
+ * @date 2025-10-28
+ */
+
 // --------------- Preprocessor directives ---------------------------------- //
 
 // #define DEBUG
@@ -5,37 +31,236 @@
 // --------------- Headers -------------------------------------------------- //
 
 #include "stack_competition.h"
+#include <pthread.h>
 #include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <threads.h>
+
+#ifdef DEBUG
+#include <stdio.h>
+#endif /* ifdef DEBUG */
+
+// --------------- Constants ------------------------------------------------ //
+
+#define CHUNK_BITS 16                /* 2^16 nodes per chunk */
+#define CHUNK_LEN (1 << CHUNK_BITS)  /* Nodes in one chunk */
+#define MAX_CHUNKS (1 << 16)         /* Index space of 2^32 nodes */
+#define NIL 0                        /* Index 0 is never handed out */
+#define BATCH_LEN 64                 /* Nodes moved between caches at once */
+#define CACHE_MAX (4 * BATCH_LEN)    /* Max nodes in a thread cache */
+#define ELIM_SLOTS 8                 /* Slots in the elimination array */
+#define ELIM_SPINS 128               /* Spins waiting for a partner */
+#define BACKOFF_MIN 4                /* First backoff in spins */
+#define BACKOFF_MAX 1024             /* Longest backoff in spins */
+
+/* States of an elimination slot, kept above the node index in the slot */
+#define SLOT_EMPTY 0ULL
+#define SLOT_PUSH (1ULL << 32) /* A push offers the node */
+#define SLOT_POP (2ULL << 32)  /* A pop waits for a node */
+#define SLOT_DONE (3ULL << 32) /* The partner took the offer, hold the node */
 
 // --------------- Structs -------------------------------------------------- //
 
 typedef struct node_t {
   void *val;
-  _Atomic(struct node_t *) next;
+  _Atomic uint32_t next;
 } node_t;
 
+/**
+ * @typedef slot_t
+ * @brief a meeting point of a push and a pop, on its own cache line
+ *
+ */
+typedef struct slot_t {
+  _Alignas(64) _Atomic uint64_t state; /* SLOT_* | index of a node */
+} slot_t;
+
 struct stack_t {
-  _Atomic(node_t *) head;
-  // tail to pop from?
+  _Alignas(64) _Atomic uint64_t head; /* tag << 32 | index of the top node */
+#ifndef STACK_NO_ELIMINATION
+  slot_t slots[ELIM_SLOTS];
+#endif /* ifndef STACK_NO_ELIMINATION */
 };
 
+/**
+ * @typedef node_cache_t
+ * @brief free nodes owned by a single thread
+ *
+ */
+typedef struct node_cache_t {
+  uint32_t head; /* First free node, linked through node_t.next */
+  int len;       /* Amount of nodes in the cache */
+} node_cache_t;
+
 // --------------- Declaration of internal functions ------------------------ //
 
-node_t *node_create(void *val, node_t *next);
+/**
+ * @brief Get the node with index IDX
+ *
+ * @param idx       an index returned by node_alloc()
+ * @return          a pointer to the node
+ */
+static inline node_t *node_at(const uint32_t idx);
 
-void node_destroy(node_t *node);
+/**
+ * @brief Take a free node, from the thread cache if possible
+ *
+ * @return          the index of a node not used by any stack
+ */
+static inline uint32_t node_alloc(void);
 
-// --------------- Definition of external functions ------------------------- //
+/**
+ * @brief Give a node back. It may be reused by any thread directly
+ *
+ * @param idx       the index of the node
+ */
+static inline void node_free(const uint32_t idx);
+
+/**
+ * @brief Register the thread cache so that it is released when the thread
+ * exits
+ */
+static void cache_register(void);
+
+/**
+ * @brief Refill the thread cache from the shared free list or with new nodes
+ * from the arena
+ */
+static void cache_refill(void);
+
+/**
+ * @brief Move BATCH_LEN nodes from the thread cache to the shared free list
+ */
+static void cache_spill(void);
+
+/**
+ * @brief Return every node of a thread cache to the shared free list. Called
+ * when a thread exits
+ *
+ * @param arg       a pointer to the node_cache_t of the thread
+ */
+static void cache_release(void *arg);
+
+/**
+ * @brief Create the key used to release caches of exiting threads
+ */
+static void cache_key_create(void);
+
+/**
+ * @brief Push the chain FIRST..LAST onto a tagged list head
+ *
+ * @param head      the head to push onto
+ * @param first     the first node of the chain
+ * @param last      the last node of the chain
+ */
+static inline void list_push(_Atomic uint64_t *head, const uint32_t first,
+                             const uint32_t last);
+
+/**
+ * @brief Pop a single node from a tagged list head
+ *
+ * @param head      the head to pop from
+ * @return          the index of the node, NIL if the list was empty
+ */
+static inline uint32_t list_pop(_Atomic uint64_t *head);
+
+#ifndef STACK_NO_ELIMINATION
+
+/**
+ * @brief Try to push the chain FIRST..LAST onto a tagged list head once
+ *
+ * @param head      the head to push onto
+ * @param first     the first node of the chain
+ * @param last      the last node of the chain
+ * @return          true if the chain was pushed, false if the CAS failed
+ */
+static inline bool list_try_push(_Atomic uint64_t *head, const uint32_t first,
+                                 const uint32_t last);
+
+/**
+ * @brief Try to pop a single node from a tagged list head once
+ *
+ * @param head      the head to pop from
+ * @param idx       set to the index of the node, NIL if the list was empty
+ * @return          true if IDX was set, false if the CAS failed
+ */
+static inline bool list_try_pop(_Atomic uint64_t *head, uint32_t *idx);
+
+/**
+ * @brief Offer the node IDX to a pop in a random slot of the elimination
+ * array, waiting a while for one to take it
+ *
+ * @param s         the stack
+ * @param idx       the node holding the value to push
+ * @return          true if a pop took the node
+ */
+static bool elim_push(stack_t *s, const uint32_t idx);
+
+/**
+ * @brief Take a node from a push in a random slot of the elimination array,
+ * waiting a while for one to come
+ *
+ * @param s         the stack
+ * @return          the index of the node, NIL if no push came
+ */
+static uint32_t elim_pop(stack_t *s);
+
+/**
+ * @brief Spin for about SPINS iterations
+ *
+ * @param spins     the amount of iterations
+ */
+static inline void backoff(const unsigned spins);
+
+/**
+ * @brief Pick a random slot of the elimination array of a stack
+ *
+ * @param s         the stack
+ * @return          a pointer to the slot
+ */
+static inline slot_t *elim_slot(stack_t *s);
+
+/**
+ * @brief Tell the CPU that this thread is spinning
+ */
+static inline void cpu_relax(void);
+
+#endif /* ifndef STACK_NO_ELIMINATION */
+
+// --------------- Global vars ---------------------------------------------- //
+
+static _Atomic(node_t *) chunks[MAX_CHUNKS];
+static atomic_ulong arena_top = BATCH_LEN; /* first batch is skipped for NIL */
+static pthread_mutex_t arena_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static _Atomic uint64_t free_head; /* shared free list */
+
+static pthread_key_t cache_key;
+static pthread_once_t cache_key_once = PTHREAD_ONCE_INIT;
+
+static thread_local node_cache_t cache = {NIL, -1}; /* len -1 until registered */
+#ifndef STACK_NO_ELIMINATION
+static thread_local uint32_t rand_state; /* xorshift state, seeded on use */
+#endif /* ifndef STACK_NO_ELIMINATION */
 
 #ifdef DEBUG
 thread_local int len = 0;
 thread_local int max_len = 0;
 #endif /* ifdef DEBUG */
 
+// --------------- Definition of external functions ------------------------- //
+
 stack_t *stack_create(void) {
-  stack_t *t = malloc(sizeof(stack_t));
-  atomic_init(&t->head, NULL);
+  stack_t *t = aligned_alloc(_Alignof(stack_t), sizeof(stack_t));
+  atomic_init(&t->head, NIL);
+
+#ifndef STACK_NO_ELIMINATION
+  for (int i = 0; i < ELIM_SLOTS; i++) {
+    atomic_init(&t->slots[i].state, SLOT_EMPTY);
+  }
+#endif /* ifndef STACK_NO_ELIMINATION */
 
   return t;
 }
@@ -46,22 +271,26 @@ void stack_destroy(stack_t *s) {
   }
 
   while (!stack_is_empty(s)) {
-    node_destroy(stack_pop(s));
+    free(stack_pop(s));
   }
 
   free(s);
 }
 
 void stack_push(stack_t *s, void *arg) {
-  node_t *new_head = node_create(arg, NULL);
-  node_t *old_head;
+  const uint32_t idx = node_alloc();
+  node_at(idx)->val = arg;
 
-  do {
-    old_head = atomic_load_explicit(&s->head, memory_order_acquire);
-    new_head->next = old_head;
-  } while (!atomic_compare_exchange_weak_explicit(&s->head, &old_head, new_head,
-                                                  memory_order_release,
-                                                  memory_order_relaxed));
+#ifdef STACK_NO_ELIMINATION
+  list_push(&s->head, idx, idx);
+#else
+  for (unsigned spins = BACKOFF_MIN;; spins = 2 * spins) {
+    if (list_try_push(&s->head, idx, idx) || elim_push(s, idx)) {
+      break;
+    }
+    backoff(spins < BACKOFF_MAX ? spins : BACKOFF_MAX);
+  }
+#endif /* ifdef STACK_NO_ELIMINATION */
 
 #ifdef DEBUG
   ++len;
@@ -69,18 +298,21 @@ void stack_push(stack_t *s, void *arg) {
 }
 
 void *stack_pop(stack_t *s) {
-  node_t *new_head;
-  node_t *old_head;
-
-  do {
-    old_head = atomic_load_explicit(&s->head, memory_order_acquire);
-    if (!old_head) {
-      return NULL;
+#ifdef STACK_NO_ELIMINATION
+  const uint32_t idx = list_pop(&s->head);
+#else
+  uint32_t idx;
+  for (unsigned spins = BACKOFF_MIN;; spins = 2 * spins) {
+    if (list_try_pop(&s->head, &idx) || (idx = elim_pop(s)) != NIL) {
+      break;
     }
-    new_head = old_head->next;
-  } while (!atomic_compare_exchange_weak_explicit(&s->head, &old_head, new_head,
-                                                  memory_order_release,
-                                                  memory_order_relaxed));
+    backoff(spins < BACKOFF_MAX ? spins : BACKOFF_MAX);
+  }
+#endif /* ifdef STACK_NO_ELIMINATION */
+
+  if (idx == NIL) {
+    return NULL;
+  }
 
 #ifdef DEBUG
   if (len > max_len) {
@@ -90,24 +322,304 @@ void *stack_pop(stack_t *s) {
   --len;
 #endif /* ifdef DEBUG */
 
-  void *val = old_head->val;
-  free(old_head);
+  void *val = node_at(idx)->val;
+  node_free(idx);
   return val;
 }
 
 int stack_is_empty(stack_t *s) {
-  return atomic_load_explicit(&s->head, memory_order_acquire) == NULL;
+  return (uint32_t)atomic_load_explicit(&s->head, memory_order_acquire) == NIL;
 }
 
 // --------------- Definition of internal functions ------------------------- //
 
-node_t *node_create(void *val, node_t *next) {
-  node_t *n = malloc(sizeof(node_t));
+static inline node_t *node_at(const uint32_t idx) {
+  node_t *chunk = atomic_load_explicit(&chunks[idx >> CHUNK_BITS],
+                                       memory_order_acquire);
+  return &chunk[idx & (CHUNK_LEN - 1)];
+}
+
+static inline uint32_t node_alloc(void) {
+  if (cache.head == NIL) {
+    cache_refill();
+  }
+
+  const uint32_t idx = cache.head;
+  cache.head = atomic_load_explicit(&node_at(idx)->next, memory_order_relaxed);
+  cache.len--;
+
+  return idx;
+}
+
+static inline void node_free(const uint32_t idx) {
+  if (cache.len < 0) {
+    cache_register();
+  }
+
+  atomic_store_explicit(&node_at(idx)->next, cache.head, memory_order_relaxed);
+  cache.head = idx;
+
+  if (++cache.len > CACHE_MAX) {
+    cache_spill();
+  }
+}
+
+static void cache_register(void) {
+  pthread_once(&cache_key_once, cache_key_create);
+  pthread_setspecific(cache_key, &cache);
+  cache.len = 0;
+}
+
+static void cache_refill(void) {
+  if (cache.len < 0) {
+    cache_register();
+  }
+
+  for (int i = 0; i < BATCH_LEN; i++) {
+    const uint32_t idx = list_pop(&free_head);
+    if (idx == NIL) {
+      break;
+    }
+
+    atomic_store_explicit(&node_at(idx)->next, cache.head,
+                          memory_order_relaxed);
+    cache.head = idx;
+    cache.len++;
+  }
+
+  if (cache.head != NIL) {
+    return;
+  }
+
+  // shared list is empty, cut a new batch from the arena
+  const unsigned long top = atomic_fetch_add(&arena_top, BATCH_LEN);
+  const unsigned long c = top >> CHUNK_BITS;
+  if (c >= MAX_CHUNKS) {
+    abort(); // 2^32 nodes in use
+  }
+
+  const uint32_t first = top;
+  if (!atomic_load_explicit(&chunks[c], memory_order_acquire)) {
+    pthread_mutex_lock(&arena_lock);
+    if (!atomic_load_explicit(&chunks[c], memory_order_relaxed)) {
+      atomic_store_explicit(&chunks[c], calloc(CHUNK_LEN, sizeof(node_t)),
+                            memory_order_release);
+    }
+    pthread_mutex_unlock(&arena_lock);
+  }
 
-  n->val = val;
-  n->next = next;
+  for (uint32_t idx = first + BATCH_LEN - 1; idx >= first; idx--) {
+    atomic_store_explicit(&node_at(idx)->next, cache.head,
+                          memory_order_relaxed);
+    cache.head = idx;
+  }
+  cache.len += BATCH_LEN;
+}
+
+static void cache_spill(void) {
+  const uint32_t first = cache.head;
+  uint32_t last = first;
+
+  for (int i = 1; i < BATCH_LEN; i++) {
+    last = atomic_load_explicit(&node_at(last)->next, memory_order_relaxed);
+  }
+
+  cache.head = atomic_load_explicit(&node_at(last)->next, memory_order_relaxed);
+  cache.len -= BATCH_LEN;
+
+  list_push(&free_head, first, last);
+}
+
+static void cache_release(void *arg) {
+  node_cache_t *c = (node_cache_t *)arg;
+  if (c->head == NIL) {
+    return;
+  }
+
+  uint32_t last = c->head;
+  uint32_t next;
+  while ((next = atomic_load_explicit(&node_at(last)->next,
+                                      memory_order_relaxed)) != NIL) {
+    last = next;
+  }
+
+  list_push(&free_head, c->head, last);
+  c->head = NIL;
+  c->len = 0;
+}
+
+static void cache_key_create(void) {
+  pthread_key_create(&cache_key, cache_release);
+}
+
+static inline void list_push(_Atomic uint64_t *head, const uint32_t first,
+                             const uint32_t last) {
+  node_t *tail = node_at(last);
+  uint64_t old_head = atomic_load_explicit(head, memory_order_relaxed);
+  uint64_t new_head;
+
+  do {
+    atomic_store_explicit(&tail->next, (uint32_t)old_head,
+                          memory_order_relaxed);
+    new_head = ((old_head >> 32) + 1) << 32 | first;
+  } while (!atomic_compare_exchange_weak_explicit(
+      head, &old_head, new_head, memory_order_release, memory_order_relaxed));
+}
+
+static inline uint32_t list_pop(_Atomic uint64_t *head) {
+  uint64_t old_head = atomic_load_explicit(head, memory_order_acquire);
+  uint64_t new_head;
+
+  do {
+    const uint32_t idx = (uint32_t)old_head;
+    if (idx == NIL) {
+      return NIL;
+    }
+
+    // may read a node that was just popped and reused, the tag in the head
+    // makes the CAS fail in that case
+    const uint32_t next =
+        atomic_load_explicit(&node_at(idx)->next, memory_order_relaxed);
+    new_head = ((old_head >> 32) + 1) << 32 | next;
+  } while (!atomic_compare_exchange_weak_explicit(
+      head, &old_head, new_head, memory_order_acquire, memory_order_acquire));
+
+  return (uint32_t)old_head;
+}
+
+#ifndef STACK_NO_ELIMINATION
+
+static inline bool list_try_push(_Atomic uint64_t *head, const uint32_t first,
+                                 const uint32_t last) {
+  uint64_t old_head = atomic_load_explicit(head, memory_order_relaxed);
+  atomic_store_explicit(&node_at(last)->next, (uint32_t)old_head,
+                        memory_order_relaxed);
+  const uint64_t new_head = ((old_head >> 32) + 1) << 32 | first;
+
+  return atomic_compare_exchange_strong_explicit(
+      head, &old_head, new_head, memory_order_release, memory_order_relaxed);
+}
+
+static inline bool list_try_pop(_Atomic uint64_t *head, uint32_t *idx) {
+  uint64_t old_head = atomic_load_explicit(head, memory_order_acquire);
+
+  *idx = (uint32_t)old_head;
+  if (*idx == NIL) {
+    return true;
+  }
+
+  const uint32_t next =
+      atomic_load_explicit(&node_at(*idx)->next, memory_order_relaxed);
+  const uint64_t new_head = ((old_head >> 32) + 1) << 32 | next;
+
+  return atomic_compare_exchange_strong_explicit(
+      head, &old_head, new_head, memory_order_acquire, memory_order_relaxed);
+}
+
+static bool elim_push(stack_t *s, const uint32_t idx) {
+  _Atomic uint64_t *state = &elim_slot(s)->state;
+  uint64_t seen = atomic_load_explicit(state, memory_order_relaxed);
+
+  // a pop is already waiting, hand the node over
+  if (seen == SLOT_POP) {
+    return atomic_compare_exchange_strong_explicit(
+        state, &seen, SLOT_DONE | idx, memory_order_release,
+        memory_order_relaxed);
+  }
+
+  // offer the node and wait for a pop to take it
+  const uint64_t offer = SLOT_PUSH | idx;
+  if (seen != SLOT_EMPTY ||
+      !atomic_compare_exchange_strong_explicit(state, &seen, offer,
+                                               memory_order_release,
+                                               memory_order_relaxed)) {
+    return false;
+  }
+
+  for (int i = 0; i < ELIM_SPINS; i++) {
+    if (atomic_load_explicit(state, memory_order_relaxed) != offer) {
+      break;
+    }
+    cpu_relax();
+  }
+
+  // withdraw, unless a pop took the node in the meantime
+  seen = offer;
+  if (atomic_compare_exchange_strong_explicit(state, &seen, SLOT_EMPTY,
+                                              memory_order_relaxed,
+                                              memory_order_relaxed)) {
+    return false;
+  }
+
+  atomic_store_explicit(state, SLOT_EMPTY, memory_order_release);
+  return true;
+}
+
+static uint32_t elim_pop(stack_t *s) {
+  _Atomic uint64_t *state = &elim_slot(s)->state;
+  uint64_t seen = atomic_load_explicit(state, memory_order_relaxed);
+
+  // a push is already waiting, take its node
+  if ((seen & ~0xffffffffULL) == SLOT_PUSH) {
+    const uint32_t idx = (uint32_t)seen;
+    return atomic_compare_exchange_strong_explicit(state, &seen, SLOT_DONE,
+                                                   memory_order_acquire,
+                                                   memory_order_relaxed)
+               ? idx
+               : NIL;
+  }
+
+  // ask for a node and wait for a push to give one
+  if (seen != SLOT_EMPTY ||
+      !atomic_compare_exchange_strong_explicit(state, &seen, SLOT_POP,
+                                               memory_order_relaxed,
+                                               memory_order_relaxed)) {
+    return NIL;
+  }
+
+  for (int i = 0; i < ELIM_SPINS; i++) {
+    if (atomic_load_explicit(state, memory_order_relaxed) != SLOT_POP) {
+      break;
+    }
+    cpu_relax();
+  }
+
+  // withdraw, unless a push gave a node in the meantime
+  seen = SLOT_POP;
+  if (atomic_compare_exchange_strong_explicit(state, &seen, SLOT_EMPTY,
+                                              memory_order_acquire,
+                                              memory_order_acquire)) {
+    return NIL;
+  }
+
+  atomic_store_explicit(state, SLOT_EMPTY, memory_order_relaxed);
+  return (uint32_t)seen;
+}
+
+static inline void backoff(const unsigned spins) {
+  for (unsigned i = 0; i < spins; i++) {
+    cpu_relax();
+  }
+}
+
+static inline slot_t *elim_slot(stack_t *s) {
+  if (!rand_state) {
+    rand_state = (uint32_t)(uintptr_t)&rand_state | 1;
+  }
+
+  rand_state ^= rand_state << 13;
+  rand_state ^= rand_state >> 17;
+  rand_state ^= rand_state << 5;
+
+  return &s->slots[rand_state % ELIM_SLOTS];
+}
 
-  return n;
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ __volatile__("yield");
+#endif
 }
 
-void node_destroy(node_t *n) { free(n); }
+#endif /* ifndef STACK_NO_ELIMINATION */
@@ -0,0 +1,176 @@
+/**
+ * This module implements the shared memory segment of live counters, see
+ * stats_competition.h. A new segment is filled with zeros by ftruncate(), and
+ * the magic is stored last with release order, so a reader which sees it also
+ * sees the rest of the header.
+ *
+ * @file stats_competition.c
+ * @author Elias Svensson (c24esn@cs.umu.se)
+ * @date 2025-11-14
+ */
+
+// --------------- Headers -------------------------------------------------- //
+
+#include "stats_competition.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// --------------- Constants ------------------------------------------------ //
+
+#define CACHE_LINE 64
+#define HEADER_SIZE                                                            \
+  ((sizeof(stats_t) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE)
+
+// --------------- Declaration of internal functions ------------------------ //
+
+/**
+ * @brief Write the name of a segment with a leading '/', as shm_open() wants
+ *
+ * @param buf       a buffer of STATS_NAME_MAX bytes
+ * @param name      the name, with or without a leading '/'
+ * @return          0 on success, -1 if the name is too long
+ */
+static int shm_name(char *restrict buf, const char *restrict name);
+
+/**
+ * @brief Get the bytes of a segment
+ *
+ * @param nr_workers    the workers of the pool
+ * @param nr_threads    the counting threads
+ * @return              the size
+ */
+static size_t segment_size(const short nr_workers, const short nr_threads);
+
+// --------------- Definition of external functions ------------------------- //
+
+stats_t *stats_create(const char *name, const short nr_workers,
+                      const short nr_threads) {
+  char path[STATS_NAME_MAX];
+  if (shm_name(path, name) || nr_workers < 1 || nr_threads < nr_workers) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  // an old segment, e.g. of a killed run, is replaced
+  shm_unlink(path);
+  const int fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd < 0) {
+    return NULL;
+  }
+
+  const size_t size = segment_size(nr_workers, nr_threads);
+  stats_t *stats = MAP_FAILED;
+  if (!ftruncate(fd, size)) {
+    stats = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (stats == MAP_FAILED) {
+    shm_unlink(path);
+    return NULL;
+  }
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  stats->version = STATS_VERSION;
+  stats->size = size;
+  stats->pid = getpid();
+  stats->nr_workers = nr_workers;
+  stats->nr_threads = nr_threads;
+  stats->started = now.tv_sec * 1000000000L + now.tv_nsec;
+  atomic_init(&stats->phase, STATS_STARTING);
+  atomic_init(&stats->block_size, 512);
+  memcpy(stats->name, path, STATS_NAME_MAX);
+  atomic_store_explicit(&stats->magic, STATS_MAGIC, memory_order_release);
+
+  return stats;
+}
+
+const stats_t *stats_open(const char *name) {
+  char path[STATS_NAME_MAX];
+  if (shm_name(path, name)) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  const int fd = shm_open(path, O_RDONLY, 0);
+  if (fd < 0) {
+    return NULL;
+  }
+
+  struct stat st;
+  const stats_t *stats = MAP_FAILED;
+  if (!fstat(fd, &st) && st.st_size >= (off_t)HEADER_SIZE) {
+    stats = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (stats == MAP_FAILED) {
+    errno = EPROTO;
+    return NULL;
+  }
+
+  if (atomic_load_explicit(&stats->magic, memory_order_acquire) !=
+          STATS_MAGIC ||
+      stats->version != STATS_VERSION || stats->size != st.st_size) {
+    munmap((void *)stats, st.st_size);
+    errno = EPROTO;
+    return NULL;
+  }
+
+  return stats;
+}
+
+void stats_destroy(stats_t *stats) {
+  if (!stats) {
+    return;
+  }
+
+  atomic_store(&stats->phase, STATS_EXITED);
+  shm_unlink(stats->name);
+  munmap(stats, stats->size);
+}
+
+void stats_close(const stats_t *stats) {
+  if (stats) {
+    munmap((void *)stats, stats->size);
+  }
+}
+
+tpool_counters_t *stats_pool(const stats_t *stats) {
+  return (tpool_counters_t *)((char *)stats + HEADER_SIZE);
+}
+
+stats_thread_t *stats_thread(const stats_t *stats, const short i) {
+  return (stats_thread_t *)((char *)stats + HEADER_SIZE +
+                            (stats->nr_workers + 1) *
+                                sizeof(tpool_counters_t)) +
+         i;
+}
+
+const char *stats_phase_name(const int phase) {
+  static const char *const names[] = {"starting", "scanning", "merging",
+                                      "idle", "exited"};
+
+  return phase >= STATS_STARTING && phase <= STATS_EXITED ? names[phase]
+                                                          : "unknown";
+}
+
+// --------------- Definition of internal functions ------------------------- //
+
+static int shm_name(char *restrict buf, const char *restrict name) {
+  const int len =
+      snprintf(buf, STATS_NAME_MAX, "%s%s", name[0] == '/' ? "" : "/", name);
+
+  return len > 1 && len < STATS_NAME_MAX ? 0 : -1;
+}
+
+static size_t segment_size(const short nr_workers, const short nr_threads) {
+  return HEADER_SIZE + (nr_workers + 1) * sizeof(tpool_counters_t) +
+         nr_threads * sizeof(stats_thread_t);
+}
@@ -16,12 +16,20 @@
 // --------------- Headers -------------------------------------------------- //
 
 #include "thread_pool_competition.h"
+#include "queue_competition.h"
 #include "stack_competition.h"
 #include <semaphore.h>
 #include <stdatomic.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 #include <threads.h>
+#include <time.h>
+
+// --------------- Constants ------------------------------------------------ //
+
+#define RING_LEN 4096    /* Jobs in the ring of TPOOL_FIFO and TPOOL_HYBRID */
+#define HYBRID_RAMP 4    /* Ring jobs per thread before TPOOL_HYBRID stacks */
 
 // --------------- Structs -------------------------------------------------- //
 
@@ -33,6 +41,7 @@
 typedef struct worker_t {
   tpool_t *restrict pool;
   stack_t *restrict job_stack;
+  stack_t *prio_stacks[TPOOL_PRIO_LEVELS - 1]; /* Level l at index l - 1 */
   short id;
 } worker_t;
 
@@ -41,6 +50,11 @@ struct tpool_t {
   sem_t done;
 
   stack_t *global_stack;
+  stack_t *global_prio_stacks[TPOOL_PRIO_LEVELS - 1];
+  atomic_int nr_prio_jobs; /* Lets workers skip the priority stacks */
+  tpool_schedule_t schedule;
+  queue_t *ring; /* Shared FIFO of worker jobs, NULL for TPOOL_LIFO */
+  long ramp;     /* Ring length where TPOOL_HYBRID turns to the stacks */
   worker_t **workers;
   pthread_t *threads;
   atomic_int balance_queues;
@@ -49,6 +63,9 @@ struct tpool_t {
   atomic_int nr_working_thrds;
   atomic_bool stop;
 
+  tpool_counters_t *own_counters;       /* Until tpool_set_counters() */
+  _Atomic(tpool_counters_t *) counters; /* One per worker, then the outside */
+
   void *(*func)(void *);
 };
 
@@ -69,6 +86,25 @@ void *worker(void *arg);
  */
 static void *tpool_steal_job(tpool_t *restrict pool, const short wid);
 
+/**
+ * @brief Take the job with the highest priority. Looks in the global stack,
+ * the own stack and then the stacks of the other workers for each level
+ *
+ * @param pool      a pointer to a struct of type pool_t
+ * @param wid       the id of the worker taking a job
+ * @return          a job, NULL if there was no job with a priority
+ */
+static void *tpool_take_prio_job(tpool_t *restrict pool, const short wid);
+
+/**
+ * @brief Take a job added by a worker, in the order of the schedule
+ *
+ * @param pool      a pointer to a struct of type pool_t
+ * @param w         the worker taking a job
+ * @return          a job, NULL if none was found
+ */
+static void *tpool_take_job(tpool_t *restrict pool, worker_t *restrict w);
+
 /**
  * @brief See if there are any jobs left
  *
@@ -78,6 +114,36 @@ static void *tpool_steal_job(tpool_t *restrict pool, const short wid);
  */
 static bool tpool_no_jobs(tpool_t *restrict pool);
 
+/**
+ * @brief Get the counters of a worker
+ *
+ * @param pool      a pointer to a struct of type pool_t
+ * @param wid       the id of the worker, nr_thrds for the outside
+ * @return          a pointer to a struct of type tpool_counters_t
+ */
+static inline tpool_counters_t *tpool_counters(tpool_t *restrict pool,
+                                               const short wid);
+
+/**
+ * @brief Count a job added by the calling thread
+ *
+ * @param pool      a pointer to a struct of type pool_t
+ */
+static inline void tpool_count_added(tpool_t *pool);
+
+/**
+ * @brief Add N to a counter. A plain load and store, as only the owner writes
+ *
+ * @param counter   a counter of the calling worker
+ * @param n         the amount to add
+ */
+static inline void counter_add(atomic_long *counter, const long n);
+
+/**
+ * @brief Get the time of CLOCK_MONOTONIC in ns
+ */
+static inline long now_ns(void);
+
 /**
  * @brief Allocate the memory required for a worker and init all variables. The
  * memory allocated needs to be freed by calling worker_destroy()
@@ -99,6 +165,7 @@ static void worker_destroy(worker_t *restrict worker);
 // --------------- Thread local vars ---------------------------------------- //
 
 thread_local short thread_id = -1;
+thread_local tpool_t *thread_pool = NULL;
 
 #ifdef DEBUG
 #include <stdio.h>
@@ -110,22 +177,41 @@ atomic_int tot_stolen_jobs;
 // --------------- Definition of external functions ------------------------- //
 
 tpool_t *tpool_create(const short nr_threads, void *(*func)(void *)) {
+  return tpool_create_schedule(nr_threads, func, TPOOL_LIFO);
+}
+
+tpool_t *tpool_create_schedule(const short nr_threads, void *(*func)(void *),
+                               const tpool_schedule_t schedule) {
   tpool_t *pool = malloc(sizeof(tpool_t));
 
+  pool->schedule = schedule;
+  pool->ring = schedule == TPOOL_LIFO ? NULL : queue_create(RING_LEN);
+  pool->ramp = HYBRID_RAMP * nr_threads;
+
   sem_init(&pool->done, 0, 0);
   sem_init(&pool->new_job, 0, 0);
   atomic_init(&pool->stop, false);
   atomic_init(&pool->nr_working_thrds, 0);
   atomic_init(&pool->balance_queues, 0);
+  atomic_init(&pool->nr_prio_jobs, 0);
   pool->nr_thrds = nr_threads;
   pool->func = func;
 
+  const size_t counters_size = (nr_threads + 1) * sizeof(tpool_counters_t);
+  pool->own_counters = aligned_alloc(_Alignof(tpool_counters_t),
+                                     counters_size);
+  memset(pool->own_counters, 0, counters_size);
+  atomic_init(&pool->counters, pool->own_counters);
+
 #ifdef DEBUG
   atomic_init(&tot_jobs, 0);
   atomic_init(&tot_stolen_jobs, 0);
 #endif /* ifdef DEBUG */
 
   pool->global_stack = stack_create();
+  for (short l = 0; l < TPOOL_PRIO_LEVELS - 1; l++) {
+    pool->global_prio_stacks[l] = stack_create();
+  }
   pool->workers = calloc(nr_threads, sizeof(worker_t *));
   pool->threads = calloc(nr_threads, sizeof(pthread_t));
 
@@ -158,25 +244,43 @@ void tpool_destroy(tpool_t *pool) {
       sem_post(&pool->new_job);
     }
 
-    // kill threads
+    // kill threads, all of them before any worker is freed since a running
+    // thread may still look at the stacks of the others
     for (short i = 0; i < pool->nr_thrds; i++) {
       pthread_join(pool->threads[i], NULL);
+    }
+    for (short i = 0; i < pool->nr_thrds; i++) {
       worker_destroy(pool->workers[i]);
     }
 
     free(pool->workers);
     free(pool->threads);
     stack_destroy(pool->global_stack);
+    for (short l = 0; l < TPOOL_PRIO_LEVELS - 1; l++) {
+      stack_destroy(pool->global_prio_stacks[l]);
+    }
+    queue_destroy(pool->ring);
   }
 
   sem_destroy(&pool->done);
   sem_destroy(&pool->new_job);
 
+  free(pool->own_counters);
   free(pool);
 }
 
 void tpool_add_work(tpool_t *restrict pool, void *restrict arg) {
-  if (thread_id != -1) {
+  tpool_count_added(pool);
+
+  // the ring takes what fits, a hybrid pool only until the workers are busy
+  if (thread_pool == pool && pool->ring &&
+      (pool->schedule == TPOOL_FIFO || queue_size(pool->ring) < pool->ramp) &&
+      queue_push(pool->ring, arg)) {
+    sem_post(&pool->new_job);
+    return;
+  }
+
+  if (thread_pool == pool) {
     stack_push(pool->workers[thread_id]->job_stack, arg);
   } else {
     stack_push(pool->global_stack, arg);
@@ -185,6 +289,28 @@ void tpool_add_work(tpool_t *restrict pool, void *restrict arg) {
   sem_post(&pool->new_job);
 }
 
+void tpool_add_work_prio(tpool_t *restrict pool, void *restrict arg,
+                         const short prio) {
+  if (prio <= 0) {
+    tpool_add_work(pool, arg);
+    return;
+  }
+
+  const short l = (prio < TPOOL_PRIO_LEVELS ? prio : TPOOL_PRIO_LEVELS - 1) - 1;
+  tpool_count_added(pool);
+
+  // counted before the push so the stacks are never skipped while it is there
+  atomic_fetch_add(&pool->nr_prio_jobs, 1);
+
+  if (thread_pool == pool) {
+    stack_push(pool->workers[thread_id]->prio_stacks[l], arg);
+  } else {
+    stack_push(pool->global_prio_stacks[l], arg);
+  }
+
+  sem_post(&pool->new_job);
+}
+
 void tpool_wait(tpool_t *restrict pool) {
 #ifdef DEBUG
   fprintf(stderr, "[*] waiting...\n");
@@ -197,14 +323,37 @@ void tpool_wait(tpool_t *restrict pool) {
   return;
 }
 
+short tpool_nr_threads(const tpool_t *pool) { return pool->nr_thrds; }
+
+void tpool_set_counters(tpool_t *restrict pool,
+                        tpool_counters_t *restrict counters) {
+  const tpool_counters_t *old = atomic_load(&pool->counters);
+
+  for (short i = 0; i <= pool->nr_thrds; i++) {
+    atomic_store(&counters[i].jobs, atomic_load(&old[i].jobs));
+    atomic_store(&counters[i].added, atomic_load(&old[i].added));
+    atomic_store(&counters[i].steals, atomic_load(&old[i].steals));
+    atomic_store(&counters[i].idle_ns, atomic_load(&old[i].idle_ns));
+    atomic_store(&counters[i].idle_since, atomic_load(&old[i].idle_since));
+  }
+
+  atomic_store(&pool->counters, counters);
+}
+
+short tpool_worker_id(void) { return thread_id; }
+
 // --------------- Definition of internal functions ------------------------- //
 
 void *worker(void *arg) {
   worker_t *w = (worker_t *)arg;
   tpool_t *p = w->pool;
   thread_id = w->id;
+  thread_pool = p;
 
   while (!atomic_load(&p->stop)) {
+    const long wait_start = now_ns();
+    atomic_store_explicit(&tpool_counters(p, w->id)->idle_since, wait_start,
+                          memory_order_relaxed);
 #ifdef DEBUG
     int tmp;
     sem_getvalue(&p->new_job, &tmp);
@@ -213,23 +362,35 @@ void *worker(void *arg) {
 #endif /* ifdef DEBUG */
     sem_wait(&p->new_job);
 
+    // looked up again, the counters may have moved during the wait
+    tpool_counters_t *counters = tpool_counters(p, w->id);
+    counter_add(&counters->idle_ns, now_ns() - wait_start);
+    atomic_store_explicit(&counters->idle_since, 0, memory_order_relaxed);
+
     if (atomic_load(&p->stop)) {
       break;
     }
 
     atomic_fetch_add(&p->nr_working_thrds, 1);
 
-    void *job = stack_pop(w->job_stack);
+    // jobs added from outside the pool are roots of new work. Take them
+    // first so that work which keeps every local stack full can not starve
+    // them
+    void *job = NULL;
+    if (atomic_load_explicit(&p->nr_prio_jobs, memory_order_relaxed) > 0) {
+      job = tpool_take_prio_job(p, w->id);
+    }
 
-    if (!job) {
-      job = tpool_steal_job(p, w->id);
+    if (!job && !stack_is_empty(p->global_stack)) {
+      job = stack_pop(p->global_stack);
     }
 
     if (!job) {
-      job = stack_pop(p->global_stack);
+      job = tpool_take_job(p, w);
     }
 
     if (job) {
+      counter_add(&counters->jobs, 1);
       p->func(job);
 
 #ifdef DEBUG
@@ -262,6 +423,9 @@ void *tpool_steal_job(tpool_t *restrict pool, const short wid) {
     short target = (i + wid) % pool->nr_thrds;
     job = stack_pop(pool->workers[target]->job_stack);
     if (job) {
+      if (target != wid) {
+        counter_add(&tpool_counters(pool, wid)->steals, 1);
+      }
 #ifdef DEBUG
       atomic_fetch_add(&tot_stolen_jobs, 1);
 #endif /* ifdef DEBUG */
@@ -272,7 +436,64 @@ void *tpool_steal_job(tpool_t *restrict pool, const short wid) {
   return job;
 }
 
+static void *tpool_take_prio_job(tpool_t *restrict pool, const short wid) {
+  void *job = NULL;
+
+  for (short l = TPOOL_PRIO_LEVELS - 2; l >= 0 && !job; l--) {
+    job = stack_pop(pool->global_prio_stacks[l]);
+
+    // own stack first, then the others offset with wid like when stealing
+    for (short i = 0; i < pool->nr_thrds && !job; i++) {
+      short target = (i + wid) % pool->nr_thrds;
+      job = stack_pop(pool->workers[target]->prio_stacks[l]);
+      if (job && target != wid) {
+        counter_add(&tpool_counters(pool, wid)->steals, 1);
+      }
+    }
+  }
+
+  if (job) {
+    atomic_fetch_sub(&pool->nr_prio_jobs, 1);
+  }
+
+  return job;
+}
+
+static void *tpool_take_job(tpool_t *restrict pool, worker_t *restrict w) {
+  void *job = NULL;
+
+  // FIFO takes the oldest job, the others their own newest
+  if (pool->schedule == TPOOL_FIFO) {
+    job = queue_pop(pool->ring);
+  }
+
+  if (!job) {
+    job = stack_pop(w->job_stack);
+  }
+
+  if (!job && pool->schedule == TPOOL_HYBRID) {
+    job = queue_pop(pool->ring);
+  }
+
+  if (!job) {
+    job = tpool_steal_job(pool, w->id);
+  }
+
+  return job;
+}
+
 static bool tpool_no_jobs(tpool_t *restrict pool) {
+  if (atomic_load(&pool->nr_prio_jobs) > 0) {
+    sem_post(&pool->new_job);
+    return false;
+  }
+
+  // a pop may miss a job while its push is running, so look again later
+  if (pool->ring && queue_size(pool->ring) > 0) {
+    sem_post(&pool->new_job);
+    return false;
+  }
+
   // Check global queue
   if (!stack_is_empty(pool->global_stack)) {
     // fprintf(stderr, "glob");
@@ -291,18 +512,51 @@ static bool tpool_no_jobs(tpool_t *restrict pool) {
   return true;
 }
 
+static inline tpool_counters_t *tpool_counters(tpool_t *restrict pool,
+                                               const short wid) {
+  return &atomic_load_explicit(&pool->counters, memory_order_acquire)[wid];
+}
+
+static inline void tpool_count_added(tpool_t *pool) {
+  if (thread_pool == pool) {
+    counter_add(&tpool_counters(pool, thread_id)->added, 1);
+  } else {
+    atomic_fetch_add_explicit(&tpool_counters(pool, pool->nr_thrds)->added, 1,
+                              memory_order_relaxed);
+  }
+}
+
+static inline void counter_add(atomic_long *counter, const long n) {
+  atomic_store_explicit(
+      counter, atomic_load_explicit(counter, memory_order_relaxed) + n,
+      memory_order_relaxed);
+}
+
+static inline long now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
 static worker_t *worker_create(tpool_t *restrict pool, const short id) {
   worker_t *worker = malloc(sizeof(worker_t));
 
   worker->pool = pool;
   worker->id = id;
   worker->job_stack = stack_create();
+  for (short l = 0; l < TPOOL_PRIO_LEVELS - 1; l++) {
+    worker->prio_stacks[l] = stack_create();
+  }
 
   return worker;
 }
 
 static void worker_destroy(worker_t *restrict w) {
   stack_destroy(w->job_stack);
+  for (short l = 0; l < TPOOL_PRIO_LEVELS - 1; l++) {
+    stack_destroy(w->prio_stacks[l]);
+  }
 
   free(w);
 }
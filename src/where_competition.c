@@ -0,0 +1,393 @@
+/**
+ * This module implements the predicates, see where_competition.h. An
+ * expression compiles to one test per term, laid out conjunction after
+ * conjunction. A test which holds moves on to the next one, or matches if it
+ * is the last of its conjunction. A test which fails jumps to the first test
+ * of the next conjunction, or past the end, which does not match.
+ *
+ * Negation is folded into the comparison when compiling, and ages are
+ * compared in whole units like find -mtime does, so "mtime>90d" holds for an
+ * entry modified 91 days ago or earlier.
+ *
+ * @file where_competition.c
+ * @author Elias Svensson (c24esn@cs.umu.se)
+ * @date 2025-11-16
+ */
+
+// --------------- Headers -------------------------------------------------- //
+
+#include "where_competition.h"
+#include <ctype.h>
+#include <grp.h>
+#include <pwd.h>
+#include <stdlib.h>
+#include <string.h>
+
+// --------------- Constants ------------------------------------------------ //
+
+#define SEPARATORS " \t\n,"
+#define DAY (24 * 60 * 60)
+
+// --------------- Structs -------------------------------------------------- //
+
+/**
+ * @typedef field_t
+ * @brief what a term tests, ids and types have no order
+ *
+ */
+typedef enum field_t {
+  FIELD_SIZE,
+  FIELD_MTIME,
+  FIELD_ATIME,
+  FIELD_UID,
+  FIELD_GID,
+  FIELD_TYPE
+} field_t;
+
+typedef enum cmp_t { CMP_LT, CMP_LE, CMP_EQ, CMP_NE, CMP_GE, CMP_GT } cmp_t;
+
+/**
+ * @typedef insn_t
+ * @brief a compiled term
+ *
+ */
+typedef struct insn_t {
+  field_t field;
+  cmp_t cmp;
+  long value;
+  long unit; /* Seconds per unit of an age, 0 for other fields */
+  int fail;  /* The test to go on with if this one fails */
+  bool last; /* Last of its conjunction, the entry matches if it holds */
+} insn_t;
+
+struct where_t {
+  char *expr; /* The source, for where_expr() */
+  time_t now;
+  int len;
+  insn_t insns[];
+};
+
+// --------------- Global vars ---------------------------------------------- //
+
+static const char *const field_names[] = {"size", "mtime", "atime",
+                                          "uid",  "gid",   "type"};
+
+/* Longer operators first, so "<=" is not read as "<" */
+static const struct {
+  const char *name;
+  cmp_t cmp;
+} cmp_names[] = {{"<=", CMP_LE}, {">=", CMP_GE}, {"!=", CMP_NE},
+                 {"==", CMP_EQ}, {"<", CMP_LT},  {">", CMP_GT},
+                 {"=", CMP_EQ}};
+
+/* The opposite of a comparison, for '!' */
+static const cmp_t cmp_negated[] = {CMP_GE, CMP_GT, CMP_NE,
+                                    CMP_EQ, CMP_LT, CMP_LE};
+
+static const char type_chars[] = "fdlpscb";
+static const mode_t type_modes[] = {S_IFREG,  S_IFDIR, S_IFLNK, S_IFIFO,
+                                    S_IFSOCK, S_IFCHR, S_IFBLK};
+
+// --------------- Declaration of internal functions ------------------------ //
+
+/**
+ * @brief Compile a term
+ *
+ * @param term      the term, e.g. "size>1G"
+ * @param insn      set to the test, except for its fail and last
+ * @return          0 on success, -1 if the term is not valid
+ */
+static int compile_term(const char *restrict term, insn_t *restrict insn);
+
+/**
+ * @brief Parse the value of a term
+ *
+ * @param value     the value
+ * @param insn      a test with its field set, gets its value and unit
+ * @return          0 on success, -1 if the value is not valid
+ */
+static int parse_value(const char *restrict value, insn_t *restrict insn);
+
+/**
+ * @brief Parse a number followed by one of a set of units
+ *
+ * @param s         the number
+ * @param units     the suffixes accepted
+ * @param scales    what each suffix multiplies by
+ * @param none      what no suffix multiplies by
+ * @param n         set to the number times its scale
+ * @param scale     set to the scale, may be NULL
+ * @return          0 on success, -1 if S is not valid
+ */
+static int parse_scaled(const char *restrict s, const char *restrict units,
+                        const long *restrict scales, const long none,
+                        long *restrict n, long *restrict scale);
+
+/**
+ * @brief Parse a user or group, as a number or a name
+ *
+ * @param s         the user or group
+ * @param group     look up a group rather than a user
+ * @param id        set to the id
+ * @return          0 on success, -1 if there is no such user or group
+ */
+static int parse_id(const char *restrict s, const bool group,
+                    long *restrict id);
+
+// --------------- Definition of external functions ------------------------- //
+
+where_t *where_compile(const char *expr, const time_t now) {
+  char *copy = strdup(expr);
+
+  // one test per token is an upper bound, "and" and "or" take none
+  int max = 1;
+  for (const char *p = expr; *p; p++) {
+    max += strchr(SEPARATORS, *p) != NULL;
+  }
+
+  where_t *w = malloc(sizeof(where_t) + max * sizeof(insn_t));
+  w->now = now;
+  w->len = 0;
+
+  int start = 0; // first test of the conjunction being compiled
+  bool valid = true;
+  char *save;
+  for (char *tok = strtok_r(copy, SEPARATORS, &save); tok && valid;
+       tok = strtok_r(NULL, SEPARATORS, &save)) {
+    if (!strcmp(tok, "and")) {
+      continue;
+    }
+
+    if (!strcmp(tok, "or")) {
+      valid = w->len > start;
+      if (valid) {
+        w->insns[w->len - 1].last = true;
+        for (int i = start; i < w->len; i++) {
+          w->insns[i].fail = w->len;
+        }
+        start = w->len;
+      }
+      continue;
+    }
+
+    valid = !compile_term(tok, &w->insns[w->len]);
+    w->insns[w->len].last = false;
+    w->len++;
+  }
+  free(copy);
+
+  if (!valid || w->len == start) {
+    free(w);
+    return NULL;
+  }
+  w->expr = strdup(expr);
+
+  w->insns[w->len - 1].last = true;
+  for (int i = start; i < w->len; i++) {
+    w->insns[i].fail = w->len;
+  }
+
+  return w;
+}
+
+void where_destroy(where_t *w) {
+  if (w) {
+    free(w->expr);
+  }
+  free(w);
+}
+
+bool where_match(const where_t *restrict w, const struct stat *restrict st) {
+  for (int i = 0; i < w->len;) {
+    const insn_t *in = &w->insns[i];
+
+    long x;
+    switch (in->field) {
+    case FIELD_SIZE:
+      x = st->st_size;
+      break;
+    case FIELD_MTIME:
+      x = (w->now - st->st_mtime) / in->unit;
+      break;
+    case FIELD_ATIME:
+      x = (w->now - st->st_atime) / in->unit;
+      break;
+    case FIELD_UID:
+      x = st->st_uid;
+      break;
+    case FIELD_GID:
+      x = st->st_gid;
+      break;
+    default:
+      x = st->st_mode & S_IFMT;
+      break;
+    }
+
+    bool holds;
+    switch (in->cmp) {
+    case CMP_LT:
+      holds = x < in->value;
+      break;
+    case CMP_LE:
+      holds = x <= in->value;
+      break;
+    case CMP_EQ:
+      holds = x == in->value;
+      break;
+    case CMP_NE:
+      holds = x != in->value;
+      break;
+    case CMP_GE:
+      holds = x >= in->value;
+      break;
+    default:
+      holds = x > in->value;
+      break;
+    }
+
+    if (!holds) {
+      i = in->fail;
+    } else if (in->last) {
+      return true;
+    } else {
+      i++;
+    }
+  }
+
+  return false;
+}
+
+const char *where_expr(const where_t *w) { return w->expr; }
+
+time_t where_now(const where_t *w) { return w->now; }
+
+// --------------- Definition of internal functions ------------------------- //
+
+static int compile_term(const char *restrict term, insn_t *restrict insn) {
+  const bool negated = term[0] == '!';
+  const char *p = term + negated;
+
+  const size_t len = strcspn(p, "<>=!");
+  int f = 0;
+  while (f <= FIELD_TYPE &&
+         (strlen(field_names[f]) != len || strncmp(p, field_names[f], len))) {
+    f++;
+  }
+  if (f > FIELD_TYPE) {
+    return -1;
+  }
+  insn->field = f;
+  p += len;
+
+  size_t c = 0;
+  while (c < sizeof(cmp_names) / sizeof(cmp_names[0]) &&
+         strncmp(p, cmp_names[c].name, strlen(cmp_names[c].name))) {
+    c++;
+  }
+  if (c == sizeof(cmp_names) / sizeof(cmp_names[0])) {
+    return -1;
+  }
+  insn->cmp = cmp_names[c].cmp;
+  p += strlen(cmp_names[c].name);
+
+  // ids and types have no order
+  if (f >= FIELD_UID && insn->cmp != CMP_EQ && insn->cmp != CMP_NE) {
+    return -1;
+  }
+  if (negated) {
+    insn->cmp = cmp_negated[insn->cmp];
+  }
+
+  return parse_value(p, insn);
+}
+
+static int parse_value(const char *restrict value, insn_t *restrict insn) {
+  static const long size_scales[] = {1L << 10, 1L << 20, 1L << 30, 1L << 40};
+  static const long age_scales[] = {1,   60,      60 * 60,
+                                    DAY, 7 * DAY, 365 * DAY};
+
+  insn->unit = 0;
+
+  switch (insn->field) {
+  case FIELD_SIZE:
+    return parse_scaled(value, "KMGT", size_scales, 1, &insn->value, NULL);
+  case FIELD_MTIME:
+  case FIELD_ATIME:
+    if (parse_scaled(value, "smhdwy", age_scales, DAY, &insn->value,
+                     &insn->unit)) {
+      return -1;
+    }
+    insn->value /= insn->unit;
+    return 0;
+  case FIELD_UID:
+    return parse_id(value, false, &insn->value);
+  case FIELD_GID:
+    return parse_id(value, true, &insn->value);
+  default: {
+    const char *t = value[0] ? strchr(type_chars, value[0]) : NULL;
+    if (!t || value[1]) {
+      return -1;
+    }
+    insn->value = type_modes[t - type_chars];
+    return 0;
+  }
+  }
+}
+
+static int parse_scaled(const char *restrict s, const char *restrict units,
+                        const long *restrict scales, const long none,
+                        long *restrict n, long *restrict scale) {
+  if (!isdigit((unsigned char)s[0])) {
+    return -1;
+  }
+
+  char *end;
+  const long number = strtol(s, &end, 10);
+
+  long by = none;
+  if (*end) {
+    const char *u = strchr(units, toupper((unsigned char)*end));
+    if (!u) {
+      u = strchr(units, *end);
+    }
+    if (!u || end[1]) {
+      return -1;
+    }
+    by = scales[u - units];
+  }
+
+  *n = number * by;
+  if (scale) {
+    *scale = by;
+  }
+
+  return 0;
+}
+
+static int parse_id(const char *restrict s, const bool group,
+                    long *restrict id) {
+  if (!s[0]) {
+    return -1;
+  }
+
+  char *end;
+  const long n = strtol(s, &end, 10);
+  if (!*end) {
+    *id = n;
+    return 0;
+  }
+
+  if (group) {
+    const struct group *gr = getgrnam(s);
+    if (gr) {
+      *id = gr->gr_gid;
+    }
+    return gr ? 0 : -1;
+  }
+
+  const struct passwd *pw = getpwnam(s);
+  if (pw) {
+    *id = pw->pw_uid;
+  }
+  return pw ? 0 : -1;
+}
@@ -0,0 +1,106 @@
+#!/bin/bash
+#
+# Regression test of the query server. A tree is created and the queries of
+# every check are sent on one connection to a fresh server, so the later paths
+# wait inside the scan of the first: a parent and a directory inside it, and
+# a parent and a file inside it. Each answer must come within the timeout and
+# match a plain mdu run.
+
+if [[ $# -gt 1 ]]; then
+  echo "usage: $0 [BIG DIR]"
+  exit 1
+fi
+
+big=${1:-/usr}
+mdu="$(dirname "$0")/mdu_competition"
+timeout=10
+work=$(mktemp -d)
+sock="$work/mdu.sock"
+tree="$work/t"
+failed=0
+
+set -o pipefail
+
+cleanup() {
+  [[ -n $server ]] && kill -KILL "$server" 2>/dev/null
+  rm -rf "$work"
+}
+trap cleanup EXIT
+
+mkdir -p "$tree/d1/d2" "$tree/d3"
+for i in $(seq 100); do
+  head -c $((i * 100)) /dev/zero >"$tree/d1/d2/f$i"
+  head -c $((i * 10)) /dev/zero >"$tree/d3/f$i"
+done
+echo hello >"$tree/f"
+
+# a fresh server for every check, so that nothing is answered from its cache.
+# Killed, as a server stuck in a loop would never see a SIGTERM
+start_server() {
+  [[ -n $server ]] && kill -KILL "$server" 2>/dev/null && wait "$server"
+  rm -f "$sock"
+
+  "$mdu" --serve "$sock" &
+  server=$!
+  for ((i = 0; i < 50; i++)); do
+    [[ -S $sock ]] && break
+    sleep 0.1
+  done
+}
+
+# send PATHS on one connection and print the answers, or fail on a timeout
+query() {
+  python3 - "$sock" "$timeout" "$@" <<'EOF'
+import socket, sys
+s = socket.socket(socket.AF_UNIX)
+s.connect(sys.argv[1])
+s.settimeout(float(sys.argv[2]))
+paths = sys.argv[3:]
+s.sendall("".join(p + "\n" for p in paths).encode())
+buf = b""
+try:
+    while buf.count(b"\n") < len(paths):
+        data = s.recv(4096)
+        if not data:
+            break
+        buf += data
+except socket.timeout:
+    sys.exit(1)
+sys.stdout.write(buf.decode())
+sys.exit(0 if buf.count(b"\n") == len(paths) else 1)
+EOF
+}
+
+check() {
+  local name=$1
+  shift
+
+  start_server
+
+  local got
+  if ! got=$(query "$@" | sort); then
+    echo "FAIL $name: no answer within ${timeout}s"
+    failed=1
+    return
+  fi
+
+  local want
+  want=$(for p in "$@"; do "$mdu" "$p"; done | sort)
+  if [[ $got != "$want" ]]; then
+    echo "FAIL $name:"
+    echo "$got"
+    echo "expected:"
+    echo "$want"
+    failed=1
+    return
+  fi
+  echo "ok   $name"
+}
+
+check "parent and nested directory" "$tree" "$tree/d1/d2"
+check "parent and file" "$tree" "$tree/f"
+check "nested directory before parent" "$tree/d3" "$tree"
+check "large parent and nested directory" "$big" "$big/bin"
+check "large parent and file" "$big" "$(find "$big" -type f | head -1)"
+
+exit $failed